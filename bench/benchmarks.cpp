@@ -0,0 +1,502 @@
+module;
+#include <GLFW/glfw3.h>
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+#include <tiny_obj_loader.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+/*
+	CPU side hot paths, and with --gpu the driver's descriptor updates. Timed against the shared velo_engine
+	library, so only a Release build without sanitizers gives numbers worth comparing.
+	Each benchmark is calibrated to at least BENCH_MIN_REP_TIME per repetition, the reported figure is the
+	median over repetitions, with mean/stddev so noisy results are visible. --json writes the results,
+	--baseline compares against an earlier --json and exits 1 on a regression beyond the noise.
+*/
+
+constexpr std::chrono::milliseconds BENCH_MIN_REP_TIME{10};
+const std::filesystem::path BENCH_DATA_DIR = VELO_SOURCE_DIR;
+
+struct BenchOptions {
+	std::uint32_t reps = 15;
+	std::string filter;
+	std::filesystem::path jsonPath;
+	std::filesystem::path baselinePath;
+	/// smallest median change reported as a regression, the noise floor can raise it
+	double threshold = 0.05;
+	/// also time the driver side of descriptor updates, needs a display and a Vulkan device
+	bool gpu{};
+};
+
+struct BenchStats {
+	std::string name;
+	std::uint64_t iterations{};
+	std::uint32_t reps{};
+	double medianNs{};
+	double meanNs{};
+	double stddevNs{};
+	double minNs{};
+};
+
+/// keeps value (and whatever it points to) alive as far as the optimizer is concerned
+template <typename T>
+static void keep(const T& value) {
+	asm volatile("" : : "r"(&value) : "memory");
+}
+
+class BenchRunner {
+public:
+	explicit BenchRunner(const BenchOptions& opts) : options(opts) {}
+
+	void run(const std::string& name, const std::function<void()>& fn) {
+		if (!options.filter.empty() && !name.contains(options.filter)) return;
+		using clock = std::chrono::steady_clock;
+		// doubles as warmup
+		std::uint64_t iterations = 1;
+		while (true) {
+			auto start = clock::now();
+			for (std::uint64_t i = 0; i < iterations; i++) fn();
+			if (clock::now() - start >= BENCH_MIN_REP_TIME || iterations >= (1ull << 30)) break;
+			iterations *= 2;
+		}
+
+		std::vector<double> samples;
+		samples.reserve(options.reps);
+		for (std::uint32_t rep = 0; rep < options.reps; rep++) {
+			auto start = clock::now();
+			for (std::uint64_t i = 0; i < iterations; i++) fn();
+			auto elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+			samples.push_back(elapsed / static_cast<double>(iterations));
+		}
+		std::ranges::sort(samples);
+		BenchStats stats {
+			.name = name,
+			.iterations = iterations,
+			.reps = options.reps,
+			.medianNs = samples[samples.size() / 2],
+			.meanNs = std::accumulate(samples.begin(), samples.end(), 0.0) / static_cast<double>(samples.size()),
+			.minNs = samples.front()
+		};
+		double variance = 0.0;
+		for (double sample : samples) {
+			variance += (sample - stats.meanNs) * (sample - stats.meanNs);
+		}
+		stats.stddevNs = std::sqrt(variance / static_cast<double>(std::max<std::size_t>(samples.size() - 1, 1)));
+		std::println("{:<36} {:>12.1f} ns  mean {:>12.1f} ns +- {:>5.1f}%  min {:>12.1f} ns  ({} x {})",
+			stats.name, stats.medianNs, stats.meanNs, 100.0 * stats.stddevNs / stats.meanNs, stats.minNs, stats.iterations, stats.reps);
+		results.push_back(std::move(stats));
+	}
+
+	std::vector<BenchStats> results;
+
+private:
+	BenchOptions options;
+};
+
+static std::vector<std::filesystem::path> data_files(const std::string& dir, std::initializer_list<std::string_view> extensions) {
+	std::vector<std::filesystem::path> files;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator(BENCH_DATA_DIR / dir, ec)) {
+		auto ext = entry.path().extension().string();
+		if (std::ranges::find(extensions, std::string_view(ext)) != extensions.end()) {
+			files.push_back(entry.path());
+		}
+	}
+	std::ranges::sort(files);
+	return files;
+}
+
+static void bench_meshes(BenchRunner& runner) {
+	for (const auto& path : data_files("models", {".obj"})) {
+		auto file = path.filename().string();
+		auto basedir = path.parent_path().string() + "/";
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> objMaterials;
+		std::string warn, err;
+		if (!tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, path.c_str(), basedir.c_str())) {
+			std::println("skipping {}: {}", file, warn + err);
+			continue;
+		}
+
+		runner.run("obj_parse/" + file, [&]() {
+			tinyobj::attrib_t parsedAttrib;
+			std::vector<tinyobj::shape_t> parsedShapes;
+			std::vector<tinyobj::material_t> parsedMaterials;
+			std::string parseWarn, parseErr;
+			tinyobj::LoadObj(&parsedAttrib, &parsedShapes, &parsedMaterials, &parseWarn, &parseErr, path.c_str(), basedir.c_str());
+			keep(parsedShapes);
+		});
+
+		std::vector<Vertex> vertices;
+		std::vector<std::uint32_t> indices;
+		runner.run("obj_weld/" + file, [&]() {
+			vertices.clear();
+			indices.clear();
+			weld_obj_vertices(attrib, shapes, vertices, indices);
+			keep(vertices);
+		});
+
+		runner.run("vertex_hash/" + file, [&]() {
+			std::size_t combined = 0;
+			for (const auto& vertex : vertices) {
+				combined ^= std::hash<Vertex>()(vertex);
+			}
+			keep(combined);
+		});
+
+		std::vector<GpuVertex> staging(vertices.size());
+		std::vector<std::uint32_t> indexStaging(indices.size());
+		runner.run("staging_fill/" + file, [&]() {
+			write_gpu_vertices(vertices, staging.data());
+			std::memcpy(indexStaging.data(), indices.data(), indices.size() * sizeof(std::uint32_t));
+			keep(staging);
+			keep(indexStaging);
+		});
+
+		// the whole bounded memory path, minus the gpu upload
+		runner.run("obj_stream_import/" + file, [&]() {
+			std::size_t emitted = 0;
+			stream_import_obj(path, 64ull << 20, [&](std::span<const Vertex> chunkVertices, std::span<const std::uint32_t>) {
+				emitted += chunkVertices.size();
+			});
+			keep(emitted);
+		});
+	}
+}
+
+static void bench_mip_chain(BenchRunner& runner, const std::string& name, std::span<const std::uint8_t> level0, vk::Extent2D extent) {
+	runner.run("mip_chain/" + name, [&]() {
+		std::vector<std::uint8_t> level = downsample_rgba(level0, extent);
+		vk::Extent2D levelExtent = {.width = std::max(1u, extent.width >> 1), .height = std::max(1u, extent.height >> 1)};
+		while (levelExtent.width > 1 || levelExtent.height > 1) {
+			level = downsample_rgba(level, levelExtent);
+			levelExtent = {.width = std::max(1u, levelExtent.width >> 1), .height = std::max(1u, levelExtent.height >> 1)};
+		}
+		keep(level);
+	});
+}
+
+static void bench_images(BenchRunner& runner) {
+	auto files = data_files("textures", {".png", ".jpg", ".jpeg", ".tga"});
+	for (const auto& path : files) {
+		auto file = path.filename().string();
+		std::vector<char> bytes = read_file(path.string());
+		auto decode = [&]() {
+			int width = 0, height = 0, channels = 0;
+			stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(bytes.data()), static_cast<int>(bytes.size()), &width, &height, &channels, STBI_rgb_alpha);
+			return std::tuple{pixels, width, height};
+		};
+		auto [pixels, width, height] = decode();
+		if (!pixels) {
+			std::println("skipping {}: {}", file, stbi_failure_reason());
+			continue;
+		}
+		vk::Extent2D extent = {.width = static_cast<std::uint32_t>(width), .height = static_cast<std::uint32_t>(height)};
+		std::vector<std::uint8_t> level0(pixels, pixels + static_cast<std::size_t>(extent.width) * extent.height * 4);
+		stbi_image_free(pixels);
+
+		runner.run("image_decode/" + file, [&]() {
+			auto [decoded, decodedWidth, decodedHeight] = decode();
+			keep(decodedWidth);
+			stbi_image_free(decoded);
+		});
+		bench_mip_chain(runner, file, level0, extent);
+	}
+	if (files.empty()) {
+		// no bundled textures, a gradient keeps the mip generation numbers comparable
+		vk::Extent2D extent = {.width = 1024, .height = 1024};
+		std::vector<std::uint8_t> level0(static_cast<std::size_t>(extent.width) * extent.height * 4);
+		for (std::size_t i = 0; i < level0.size(); i++) {
+			level0[i] = static_cast<std::uint8_t>((i * 7) ^ (i >> 12));
+		}
+		bench_mip_chain(runner, "synthetic_1024", level0, extent);
+	}
+}
+
+static void bench_descriptors(BenchRunner& runner) {
+	constexpr std::uint32_t writeCount = 1024;
+	BindlessTable table;
+	table.reserve(writeCount * 4, BINDLESS_MAX_SAMPLERS);
+	// handles are never dereferenced, only copied into the write structs
+	vk::ImageView view{reinterpret_cast<VkImageView>(std::uintptr_t{0x1000})};
+	vk::DescriptorSet set{reinterpret_cast<VkDescriptorSet>(std::uintptr_t{0x2000})};
+	std::vector<BindlessHandle> handles(writeCount);
+	std::uint64_t frame = 0;
+	runner.run(std::format("bindless_writes/{}", writeCount), [&]() {
+		frame++;
+		for (auto& handle : handles) {
+			handle = table.add_texture(view);
+		}
+		auto writes = table.prepare_set_writes(set);
+		keep(writes);
+		for (const auto& handle : handles) {
+			table.release_texture(handle, frame);
+		}
+		table.recycle(frame);
+	});
+}
+
+/// both backends writing into throwaway single binding layouts on a hidden window's device
+static void bench_descriptor_driver(BenchRunner& runner) {
+	constexpr std::uint32_t count = 16384;
+	glfwInit();
+	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "velo_bench", nullptr, nullptr);
+	if (!window) {
+		glfwTerminate();
+		throw std::runtime_error("Failed to create a window for --gpu");
+	}
+	vk::raii::Context context;
+	VeloContext config;
+	GpuContext gpu;
+	gpu.create_instance(context, config);
+	gpu.create_surface(window);
+	gpu.pick_physical_device(config);
+	gpu.create_logical_device(gpu.surface);
+	gpu.init_vma();
+	{
+		VmaImage image(gpu.allocator, 1, 1, 1, vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Unorm, 0, VMA_MEMORY_USAGE_AUTO);
+		// only ever written into descriptors, never sampled, so its layout doesn't matter
+		auto view = create_image_view(gpu.device, image.image(), vk::Format::eR8G8B8A8Unorm, vk::ImageAspectFlagBits::eColor, 1);
+
+		vk::DescriptorSetLayoutBinding binding {
+			.binding = 0,
+			.descriptorType = vk::DescriptorType::eSampledImage,
+			.descriptorCount = count,
+			.stageFlags = vk::ShaderStageFlagBits::eFragment
+		};
+		vk::DescriptorBindingFlags bindingFlags = vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind;
+		vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {
+			.bindingCount = 1,
+			.pBindingFlags = &bindingFlags
+		};
+		auto layoutExpected = gpu.device.createDescriptorSetLayout({
+			.pNext = &bindingFlagsInfo,
+			.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+			.bindingCount = 1,
+			.pBindings = &binding
+		});
+		if (!layoutExpected.has_value()) {
+			handle_error("Failed to create bench descriptor set layout", layoutExpected.result);
+		}
+		vk::DescriptorPoolSize poolSize {.type = vk::DescriptorType::eSampledImage, .descriptorCount = count};
+		auto poolExpected = gpu.device.createDescriptorPool({
+			.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+			.maxSets = 1,
+			.poolSizeCount = 1,
+			.pPoolSizes = &poolSize
+		});
+		if (!poolExpected.has_value()) {
+			handle_error("Failed to create bench descriptor pool", poolExpected.result);
+		}
+		auto setExpected = gpu.device.allocateDescriptorSets({
+			.descriptorPool = *poolExpected,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &**layoutExpected
+		});
+		if (!setExpected.has_value()) {
+			handle_error("Failed to allocate bench descriptor set", setExpected.result);
+		}
+		vk::DescriptorSet benchSet = *setExpected->front();
+
+		vk::DescriptorImageInfo imageInfo {
+			.imageView = *view,
+			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+		};
+		std::vector<vk::WriteDescriptorSet> writes;
+		writes.reserve(count);
+		for (std::uint32_t i = 0; i < count; i++) {
+			writes.push_back({
+				.dstSet = benchSet,
+				.dstBinding = 0,
+				.dstArrayElement = i,
+				.descriptorCount = 1,
+				.descriptorType = vk::DescriptorType::eSampledImage,
+				.pImageInfo = &imageInfo
+			});
+		}
+		runner.run(std::format("update_descriptor_sets/single/{}", count), [&]() {
+			for (const auto& write : writes) {
+				gpu.device.updateDescriptorSets(write, nullptr);
+			}
+		});
+		runner.run(std::format("update_descriptor_sets/batched/{}", count), [&]() {
+			gpu.device.updateDescriptorSets(writes, nullptr);
+		});
+
+		if (!gpu.descriptorBufferSupported) {
+			std::println("skipping get_descriptor: VK_EXT_descriptor_buffer not supported");
+		} else {
+			auto bufferLayoutExpected = gpu.device.createDescriptorSetLayout({
+				.flags = vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT,
+				.bindingCount = 1,
+				.pBindings = &binding
+			});
+			if (!bufferLayoutExpected.has_value()) {
+				handle_error("Failed to create bench descriptor buffer layout", bufferLayoutExpected.result);
+			}
+			VmaBuffer benchBuff(gpu.allocator, bufferLayoutExpected->getSizeEXT(),
+				vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+				VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+			auto* base = static_cast<char*>(benchBuff.mapped_data()) + bufferLayoutExpected->getBindingOffsetEXT(0);
+			std::size_t size = gpu.descriptorBufferProps.sampledImageDescriptorSize;
+			vk::DescriptorGetInfoEXT getInfo {.type = vk::DescriptorType::eSampledImage};
+			getInfo.data.pSampledImage = &imageInfo;
+			runner.run(std::format("get_descriptor/{}", count), [&]() {
+				for (std::uint32_t i = 0; i < count; i++) {
+					gpu.device.getDescriptorEXT(getInfo, size, base + i * size);
+				}
+			});
+		}
+	}
+	vmaDestroyAllocator(gpu.allocator);
+	gpu.device.clear();
+	// same order as Velo::cleanup, the surface has to go before its window
+	gpu.surface.clear();
+	glfwDestroyWindow(window);
+	glfwTerminate();
+}
+
+static void bench_uniforms(BenchRunner& runner) {
+	float angle = 0.0f;
+	runner.run("view_uniforms", [&]() {
+		angle += 0.01f;
+		UniformBufferObject ubo = make_view_uniforms(glm::vec3(0.0f), angle, {.width = 1920, .height = 1080}, CAMERA_EYE, 10.0f);
+		keep(ubo);
+	});
+}
+
+static void bench_stress_scene(BenchRunner& runner) {
+	// cube, sphere and the three bundled models
+	std::array<float, 5> radii = {0.87f, 1.0f, 1.2f, 2.5f, 40.0f};
+	for (std::uint32_t count : {1'000u, 100'000u, 1'000'000u}) {
+		StressSceneDesc desc{.instances = count, .distribution = StressDistribution::eClusters};
+		runner.run(std::format("stress_generate/{}", count), [&]() {
+			auto instances = generate_stress_instances(desc, radii, desc.materials);
+			keep(instances.back());
+		});
+	}
+}
+
+static void write_json(const std::vector<BenchStats>& results, const std::filesystem::path& path) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error(std::format("Failed to open {}", path.string()));
+	}
+	// one benchmark per line, read_baseline() relies on it
+	file << "{\"benchmarks\": [\n";
+	for (std::size_t i = 0; i < results.size(); i++) {
+		const auto& r = results[i];
+		file << std::format(R"({{"name": "{}", "iterations": {}, "repetitions": {}, "median_ns": {:.3f}, "mean_ns": {:.3f}, "stddev_ns": {:.3f}, "min_ns": {:.3f}}}{})",
+			r.name, r.iterations, r.reps, r.medianNs, r.meanNs, r.stddevNs, r.minNs, i + 1 < results.size() ? "," : "") << '\n';
+	}
+	file << "]}\n";
+	std::println("Wrote {} results to {}", results.size(), path.string());
+}
+
+/// name -> median_ns from a file written by write_json()
+static std::unordered_map<std::string, double> read_baseline(const std::filesystem::path& path) {
+	std::ifstream file(path);
+	if (!file.is_open()) {
+		throw std::runtime_error(std::format("Failed to open baseline {}", path.string()));
+	}
+	std::unordered_map<std::string, double> medians;
+	std::string line;
+	while (std::getline(file, line)) {
+		constexpr std::string_view nameKey = R"("name": ")";
+		constexpr std::string_view medianKey = R"("median_ns": )";
+		auto name = line.find(nameKey);
+		auto median = line.find(medianKey);
+		if (name == std::string::npos || median == std::string::npos) continue;
+		name += nameKey.size();
+		medians[line.substr(name, line.find('"', name) - name)] = std::stod(line.substr(median + medianKey.size()));
+	}
+	return medians;
+}
+
+/// returns how many benchmarks regressed
+static std::uint32_t compare_baseline(const std::vector<BenchStats>& results, const std::filesystem::path& path, double threshold) {
+	auto baseline = read_baseline(path);
+	std::uint32_t regressions = 0;
+	std::println("\nAgainst {}:", path.string());
+	for (const auto& r : results) {
+		auto it = baseline.find(r.name);
+		if (it == baseline.end()) {
+			std::println("{:<36} new", r.name);
+			continue;
+		}
+		double delta = (r.medianNs - it->second) / it->second;
+		// a change inside three standard deviations of this run is noise, not a result
+		double noise = std::max(threshold, 3.0 * r.stddevNs / r.medianNs);
+		const char* verdict = "~";
+		if (delta > noise) {
+			verdict = "REGRESSED";
+			regressions++;
+		} else if (delta < -noise) {
+			verdict = "improved";
+		}
+		std::println("{:<36} {:>+7.1f}%  (noise {:.1f}%)  {}", r.name, 100.0 * delta, 100.0 * noise, verdict);
+	}
+	return regressions;
+}
+
+static BenchOptions parse_options(std::span<char*> args) {
+	BenchOptions options;
+	for (std::size_t i = 1; i < args.size(); i++) {
+		std::string_view arg = args[i];
+		auto value = [&]() -> std::string {
+			if (i + 1 >= args.size()) {
+				throw std::runtime_error(std::format("{} needs a value", arg));
+			}
+			return args[++i];
+		};
+		if (arg == "--reps") {
+			options.reps = std::max(1u, static_cast<std::uint32_t>(std::stoul(value())));
+		} else if (arg == "--filter") {
+			options.filter = value();
+		} else if (arg == "--json") {
+			options.jsonPath = value();
+		} else if (arg == "--baseline") {
+			options.baselinePath = value();
+		} else if (arg == "--threshold") {
+			options.threshold = std::stod(value());
+		} else if (arg == "--gpu") {
+			options.gpu = true;
+		} else {
+			throw std::runtime_error(std::format("Unknown option {} (--reps N, --filter NAME, --json OUT, --baseline IN, --threshold FRACTION, --gpu)", arg));
+		}
+	}
+	return options;
+}
+
+int run_benchmarks(int argc, char** argv) {
+	try {
+		BenchOptions options = parse_options({argv, static_cast<std::size_t>(argc)});
+		BenchRunner runner(options);
+		std::println("velo_bench: {} repetitions, >= {} ms each", options.reps, BENCH_MIN_REP_TIME.count());
+		bench_meshes(runner);
+		bench_images(runner);
+		bench_descriptors(runner);
+		if (options.gpu) {
+			bench_descriptor_driver(runner);
+		}
+		bench_uniforms(runner);
+		bench_stress_scene(runner);
+
+		if (!options.jsonPath.empty()) {
+			write_json(runner.results, options.jsonPath);
+		}
+		if (!options.baselinePath.empty() && compare_baseline(runner.results, options.baselinePath, options.threshold) > 0) {
+			return 1;
+		}
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,6 @@
+import std;
+import velo;
+
+int main(int argc, char** argv) {
+	return run_benchmarks(argc, argv);
+}
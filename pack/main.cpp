@@ -0,0 +1,6 @@
+/// pack/pack.cpp
+int run_pack(int argc, char** argv);
+
+int main(int argc, char** argv) {
+	return run_pack(argc, argv);
+}
@@ -0,0 +1,172 @@
+#include <lz4.h>
+#include <lz4hc.h>
+import std;
+import velo_archive;
+
+/*
+	Bakes loose assets into one archive for AssetArchive. Entries are LZ4 HC compressed one by one so the
+	reader can decompress any of them on its own thread, files that don't shrink (png, jpg) are stored and
+	read straight out of the mapping. Identical content is written once and shared between names.
+*/
+
+const std::filesystem::path PACK_SOURCE_DIR = VELO_SOURCE_DIR;
+/// compressed entries have to save at least 1/PACK_MIN_SAVING of their size, or they're stored
+constexpr std::uint64_t PACK_MIN_SAVING = 16;
+
+struct PackOptions {
+	std::filesystem::path out = "velo.vpak";
+	std::filesystem::path root = PACK_SOURCE_DIR;
+	bool store{};
+	std::vector<std::filesystem::path> files;
+};
+
+static PackOptions parse_pack_options(std::span<char*> args) {
+	PackOptions options;
+	for (std::size_t i = 1; i < args.size(); i++) {
+		std::string_view arg = args[i];
+		auto value = [&]() -> std::string {
+			if (i + 1 >= args.size()) {
+				throw std::runtime_error(std::format("{} needs a value", arg));
+			}
+			return args[++i];
+		};
+		if (arg == "--out") {
+			options.out = value();
+		} else if (arg == "--root") {
+			options.root = value();
+		} else if (arg == "--store") {
+			options.store = true;
+		} else if (arg.starts_with("--")) {
+			throw std::runtime_error(std::format("Unknown option {} (--out FILE, --root DIR, --store, FILES...)", arg));
+		} else {
+			options.files.emplace_back(arg);
+		}
+	}
+	return options;
+}
+
+/// models, textures and compiled shaders under root, what the app loads at runtime
+static std::vector<std::filesystem::path> default_pack_files(const std::filesystem::path& root) {
+	const std::array<std::pair<std::string_view, std::vector<std::string_view>>, 3> sources = {{
+		{"models", {".obj", ".mtl"}},
+		{"textures", {".png", ".jpg", ".jpeg", ".mtl"}},
+		{"shaders", {".spv"}}
+	}};
+	std::vector<std::filesystem::path> files;
+	for (const auto& [dir, extensions] : sources) {
+		if (!std::filesystem::is_directory(root / dir)) continue;
+		for (const auto& item : std::filesystem::directory_iterator(root / dir)) {
+			if (item.is_regular_file() && std::ranges::contains(extensions, item.path().extension().string())) {
+				files.push_back(item.path());
+			}
+		}
+	}
+	return files;
+}
+
+static void write_padding(std::ofstream& out, std::uint64_t& offset) {
+	static constexpr std::array<char, ARCHIVE_ALIGNMENT> zeros{};
+	std::uint64_t aligned = (offset + ARCHIVE_ALIGNMENT - 1) / ARCHIVE_ALIGNMENT * ARCHIVE_ALIGNMENT;
+	out.write(zeros.data(), static_cast<std::streamsize>(aligned - offset));
+	offset = aligned;
+}
+
+int run_pack(int argc, char** argv) {
+	try {
+		PackOptions options = parse_pack_options({argv, static_cast<std::size_t>(argc)});
+		if (options.files.empty()) {
+			options.files = default_pack_files(options.root);
+		}
+		if (options.files.empty()) {
+			throw std::runtime_error(std::format("Nothing to pack under {}", options.root.string()));
+		}
+
+		std::ofstream out(options.out, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			throw std::runtime_error(std::format("Failed to open {}", options.out.string()));
+		}
+		ArchiveHeader header{.magic = ARCHIVE_MAGIC, .version = ARCHIVE_VERSION};
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		std::uint64_t offset = sizeof(header);
+
+		std::vector<std::pair<std::string, ArchiveEntry>> packed;
+		// (hash, size) -> file that owns the data and its index into packed, several when the hash collides
+		std::multimap<std::pair<std::uint64_t, std::uint64_t>, std::pair<std::filesystem::path, std::size_t>> seen;
+		std::uint64_t totalIn = 0;
+		for (const auto& path : options.files) {
+			std::vector<char> raw = read_file(path.string());
+			std::span<const std::byte> bytes = std::as_bytes(std::span(raw));
+			std::string name = asset_name(path);
+			if (std::ranges::any_of(packed, [&](const auto& p) { return p.first == name; })) {
+				throw std::runtime_error(std::format("Two files pack to {}", name));
+			}
+			ArchiveEntry entry{.size = bytes.size(), .hash = fnv1a64(bytes)};
+			totalIn += bytes.size();
+
+			// a matching hash only nominates a candidate, the bytes decide
+			auto [first, last] = seen.equal_range({entry.hash, entry.size});
+			auto dup = std::find_if(first, last, [&](const auto& candidate) {
+				std::vector<char> other = read_file(candidate.second.first.string());
+				return std::ranges::equal(other, raw);
+			});
+			if (dup != last) {
+				const auto& [ownerName, owner] = packed[dup->second.second];
+				entry.offset = owner.offset;
+				entry.storedSize = owner.storedSize;
+				entry.compression = owner.compression;
+				std::println("{:<32} {:>10} B  same content as {}", name, entry.size, ownerName);
+				packed.emplace_back(std::move(name), entry);
+				continue;
+			}
+
+			std::vector<char> compressed;
+			if (!options.store && !raw.empty()) {
+				compressed.resize(static_cast<std::size_t>(LZ4_compressBound(static_cast<int>(raw.size()))));
+				int written = LZ4_compress_HC(raw.data(), compressed.data(), static_cast<int>(raw.size()), static_cast<int>(compressed.size()), LZ4HC_CLEVEL_MAX);
+				compressed.resize(written > 0 ? static_cast<std::size_t>(written) : 0);
+			}
+			bool useLz4 = !compressed.empty() && compressed.size() + raw.size() / PACK_MIN_SAVING < raw.size();
+			const std::vector<char>& data = useLz4 ? compressed : raw;
+			write_padding(out, offset);
+			entry.offset = offset;
+			entry.storedSize = data.size();
+			entry.compression = useLz4 ? ArchiveCompression::eLz4 : ArchiveCompression::eStored;
+			out.write(data.data(), static_cast<std::streamsize>(data.size()));
+			offset += data.size();
+			std::println("{:<32} {:>10} B -> {:>10} B  {}", name, entry.size, entry.storedSize, useLz4 ? "lz4" : "stored");
+			seen.emplace(std::pair{entry.hash, entry.size}, std::pair{path, packed.size()});
+			packed.emplace_back(std::move(name), entry);
+		}
+
+		// sorted so the reader can binary search, the data stays in input order
+		std::ranges::sort(packed, {}, &std::pair<std::string, ArchiveEntry>::first);
+		std::string nameTable;
+		for (auto& [name, entry] : packed) {
+			entry.nameOffset = static_cast<std::uint32_t>(nameTable.size());
+			entry.nameLength = static_cast<std::uint32_t>(name.size());
+			nameTable += name;
+		}
+		write_padding(out, offset);
+		header.entryCount = static_cast<std::uint32_t>(packed.size());
+		header.tocOffset = offset;
+		for (const auto& [name, entry] : packed) {
+			out.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+		}
+		offset += sizeof(ArchiveEntry) * packed.size();
+		header.namesOffset = offset;
+		header.namesSize = nameTable.size();
+		out.write(nameTable.data(), static_cast<std::streamsize>(nameTable.size()));
+		offset += nameTable.size();
+		out.seekp(0);
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.close();
+		if (!out) {
+			throw std::runtime_error(std::format("Failed to write {}", options.out.string()));
+		}
+		std::println("Packed {} files into {}: {} KiB -> {} KiB", packed.size(), options.out.string(), totalIn / 1024, offset / 1024);
+		return 0;
+	} catch (const std::exception& e) {
+		std::cerr << e.what() << '\n';
+		return 1;
+	}
+}
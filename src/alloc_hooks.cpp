@@ -0,0 +1,52 @@
+// plain translation unit, replacement allocation functions have to live in the global module
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+struct AllocCounters {
+	std::uint64_t count{};
+	std::uint64_t bytes{};
+};
+
+namespace {
+	std::atomic<std::uint64_t> allocCount{0};
+	std::atomic<std::uint64_t> allocBytes{0};
+}
+
+AllocCounters alloc_counters() noexcept {
+	return {.count = allocCount.load(std::memory_order_relaxed), .bytes = allocBytes.load(std::memory_order_relaxed)};
+}
+
+#if defined(ALLOC_TRACKING)
+static void* tracked_alloc(std::size_t size, std::size_t alignment) {
+	allocCount.fetch_add(1, std::memory_order_relaxed);
+	allocBytes.fetch_add(size, std::memory_order_relaxed);
+	if (size == 0) size = 1;
+	void* ptr = alignment > alignof(std::max_align_t)
+		? std::aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment)
+		: std::malloc(size);
+	if (!ptr) throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new(std::size_t size) { return tracked_alloc(size, alignof(std::max_align_t)); }
+void* operator new[](std::size_t size) { return tracked_alloc(size, alignof(std::max_align_t)); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return tracked_alloc(size, static_cast<std::size_t>(alignment)); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return tracked_alloc(size, static_cast<std::size_t>(alignment)); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+	try { return tracked_alloc(size, alignof(std::max_align_t)); } catch (...) { return nullptr; }
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+	try { return tracked_alloc(size, alignof(std::max_align_t)); } catch (...) { return nullptr; }
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { std::free(ptr); }
+#endif
@@ -0,0 +1,144 @@
+module;
+#include <lz4.h>
+#include <tiny_obj_loader.h>
+
+module velo;
+import std;
+
+bool AssetArchive::open(const std::filesystem::path& path) {
+	if (!std::filesystem::exists(path)) return false;
+	file = MappedFile(path);
+	auto bytes = file.bytes();
+	ArchiveHeader header{};
+	if (bytes.size() < sizeof(header)) {
+		throw std::runtime_error(std::format("{} is not an asset archive", path.string()));
+	}
+	std::memcpy(&header, bytes.data(), sizeof(header));
+	if (header.magic != ARCHIVE_MAGIC || header.version != ARCHIVE_VERSION) {
+		throw std::runtime_error(std::format("{} is not a version {} asset archive", path.string(), ARCHIVE_VERSION));
+	}
+	// offset + size can wrap on a corrupt file, so every range is checked as size <= file size - offset
+	auto inFile = [&](std::uint64_t offset, std::uint64_t size) {
+		return offset <= bytes.size() && size <= bytes.size() - offset;
+	};
+	std::uint64_t tocSize = static_cast<std::uint64_t>(header.entryCount) * sizeof(ArchiveEntry);
+	if (!inFile(header.tocOffset, tocSize) || !inFile(header.namesOffset, header.namesSize)) {
+		throw std::runtime_error(std::format("{} is truncated", path.string()));
+	}
+	entries.resize(header.entryCount);
+	std::memcpy(entries.data(), bytes.data() + header.tocOffset, tocSize);
+	names = std::string_view(reinterpret_cast<const char*>(bytes.data() + header.namesOffset), header.namesSize);
+	for (const auto& entry : entries) {
+		if (!inFile(entry.offset, entry.storedSize) || std::uint64_t{entry.nameOffset} + entry.nameLength > names.size()) {
+			throw std::runtime_error(std::format("{} has an entry outside the file", path.string()));
+		}
+		// stored entries are handed out as size bytes straight from the mapping, lz4 only takes int sizes
+		constexpr auto lz4Max = static_cast<std::uint64_t>(std::numeric_limits<int>::max());
+		bool stored = entry.compression == ArchiveCompression::eStored;
+		bool lz4 = entry.compression == ArchiveCompression::eLz4 && entry.size <= lz4Max && entry.storedSize <= lz4Max;
+		if ((stored && entry.size != entry.storedSize) || (!stored && !lz4)) {
+			throw std::runtime_error(std::format("{} has a corrupt entry {}", path.string(), names.substr(entry.nameOffset, entry.nameLength)));
+		}
+	}
+	std::println("Successfully opened asset archive {} ({} entries, {} KiB)", path.string(), entries.size(), bytes.size() / 1024);
+	return true;
+}
+
+const ArchiveEntry* AssetArchive::find(std::string_view name) const {
+	auto entryName = [this](const ArchiveEntry& entry) { return names.substr(entry.nameOffset, entry.nameLength); };
+	auto it = std::ranges::lower_bound(entries, name, {}, entryName);
+	if (it == entries.end() || entryName(*it) != name) return nullptr;
+	return &*it;
+}
+
+std::vector<std::byte> AssetArchive::decompress(const ArchiveEntry& entry) const {
+	std::vector<std::byte> out(entry.size);
+	const std::byte* src = file.bytes().data() + entry.offset;
+	int written = LZ4_decompress_safe(reinterpret_cast<const char*>(src), reinterpret_cast<char*>(out.data()), static_cast<int>(entry.storedSize), static_cast<int>(entry.size));
+	if (written < 0 || static_cast<std::uint64_t>(written) != entry.size) {
+		throw std::runtime_error(std::format("Corrupt archive entry {}", names.substr(entry.nameOffset, entry.nameLength)));
+	}
+	return out;
+}
+
+std::span<const std::byte> AssetArchive::load(const std::string& path) {
+	std::string name = asset_name(path);
+	if (const ArchiveEntry* entry = find(name)) {
+		if (entry->compression == ArchiveCompression::eStored) {
+			return file.bytes().subspan(entry->offset, entry->size);
+		}
+		auto it = cache.find(name);
+		if (it == cache.end()) {
+			it = cache.emplace(name, decompress(*entry)).first;
+		}
+		return it->second;
+	}
+	// not packed, or no archive at all
+	auto it = cache.find(path);
+	if (it == cache.end()) {
+		std::vector<char> bytes = read_file(path);
+		std::vector<std::byte> copy(bytes.size());
+		std::memcpy(copy.data(), bytes.data(), bytes.size());
+		it = cache.emplace(path, std::move(copy)).first;
+	}
+	return it->second;
+}
+
+void AssetArchive::prefetch(std::span<const std::string> paths) {
+	std::vector<std::pair<std::string, std::future<std::vector<std::byte>>>> jobs;
+	for (const auto& path : paths) {
+		std::string name = asset_name(path);
+		const ArchiveEntry* entry = find(name);
+		if (!entry || entry->compression == ArchiveCompression::eStored || cache.contains(name)) continue;
+		// entries are compressed independently, nothing is shared between the jobs
+		jobs.emplace_back(name, std::async(std::launch::async, [this, entry]() { return decompress(*entry); }));
+	}
+	for (auto& [name, job] : jobs) {
+		cache.emplace(name, job.get());
+	}
+}
+
+void AssetArchive::drop_cache() {
+	cache.clear();
+}
+
+/// read only streambuf over bytes that are already in memory, tinyobj only takes an istream
+class SpanStreambuf : public std::streambuf {
+public:
+	explicit SpanStreambuf(std::span<const std::byte> bytes) {
+		char* begin = const_cast<char*>(reinterpret_cast<const char*>(bytes.data()));
+		setg(begin, begin, begin + bytes.size());
+	}
+};
+
+void Velo::load_obj(const std::string& path, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes) {
+	SpanStreambuf buffer(assets.load(path));
+	std::istream stream(&buffer);
+	std::vector<tinyobj::material_t> objMaterials;
+	std::string warn, err;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, &stream, nullptr)) {
+		throw std::runtime_error(warn + err);
+	}
+}
+
+void Velo::open_assets() {
+	ProfileZone zone("open_assets");
+	if (!assets.open(config.archive_path)) {
+		std::println("No asset archive at {}, loading loose files", config.archive_path);
+		return;
+	}
+	std::vector<std::string> startup = {SHADER_PATH};
+	if (config.dynamic_resolution) {
+		startup.push_back(UPSAMPLE_SHADER_PATH);
+	}
+	if (config.stress_scene.empty() && config.model_path.empty()) {
+		// the streaming import maps the loose file, a decompressed copy would blow its budget
+		if (!streams_model()) {
+			startup.push_back(MODEL_PATH);
+		}
+		if (!config.enabled_codam) {
+			startup.push_back(TEXTURE_PATH);
+		}
+	}
+	assets.prefetch(startup);
+}
@@ -0,0 +1,29 @@
+module velo_archive;
+import std;
+
+std::string asset_name(const std::filesystem::path& path) {
+	return (path.parent_path().filename() / path.filename()).generic_string();
+}
+
+std::uint64_t fnv1a64(std::span<const std::byte> bytes) {
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	for (std::byte b : bytes) {
+		hash ^= static_cast<std::uint64_t>(b);
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+std::vector<char> read_file(const std::string& filename) {
+	std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+	if (!file.is_open()) {
+		throw std::runtime_error("failed to open file");
+	}
+
+	std::vector<char> buffer(static_cast<std::size_t>(file.tellg()));
+	file.seekg(0, std::ios::beg);
+	file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+	file.close();
+	return buffer;
+}
@@ -0,0 +1,46 @@
+/*
+	On disk layout of the asset archive and the helpers both sides of it need. Its own module so velo_pack
+	builds from this and pack/ alone, the renderer only reads archives through AssetArchive.
+*/
+export module velo_archive;
+import std;
+
+export enum class ArchiveCompression : std::uint32_t {
+	eStored,
+	eLz4
+};
+
+export struct ArchiveHeader {
+	std::array<char, 8> magic{};
+	std::uint32_t version{};
+	std::uint32_t entryCount{};
+	std::uint64_t tocOffset{};
+	std::uint64_t namesOffset{};
+	std::uint64_t namesSize{};
+};
+static_assert(sizeof(ArchiveHeader) == 40);
+
+/// table of contents record, the toc is sorted by name so lookups are a binary search
+export struct ArchiveEntry {
+	std::uint64_t offset{};
+	std::uint64_t storedSize{};
+	std::uint64_t size{};
+	/// fnv1a64 of the uncompressed bytes, entries with the same content share their data
+	std::uint64_t hash{};
+	std::uint32_t nameOffset{};
+	std::uint32_t nameLength{};
+	ArchiveCompression compression{};
+	std::uint32_t reserved{};
+};
+static_assert(sizeof(ArchiveEntry) == 48);
+
+export constexpr std::array<char, 8> ARCHIVE_MAGIC = {'V', 'E', 'L', 'O', 'P', 'A', 'K', '1'};
+export constexpr std::uint32_t ARCHIVE_VERSION = 1;
+/// entry data starts on this boundary so stored spir-v can be handed out without a copy
+export constexpr std::uint64_t ARCHIVE_ALIGNMENT = 16;
+
+/// what the packer stores a loose file under, "<parent dir>/<file name>"
+export [[nodiscard]] std::string asset_name(const std::filesystem::path& path);
+export [[nodiscard]] std::uint64_t fnv1a64(std::span<const std::byte> bytes);
+/// whole file into memory, throws when it can't be opened
+export std::vector<char> read_file(const std::string& filename);
@@ -0,0 +1,143 @@
+module;
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static std::uint32_t align_up(std::uint32_t value, std::uint32_t alignment) {
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+std::optional<AtlasRect> TextureAtlas::add(std::span<const std::uint8_t> rgba, std::uint32_t width, std::uint32_t height) {
+	if (width == 0 || height == 0 || width > ATLAS_MAX_ENTRY_SIZE || height > ATLAS_MAX_ENTRY_SIZE) return std::nullopt;
+	if (rgba.size() < static_cast<std::size_t>(width) * height * 4) {
+		throw std::invalid_argument(std::format("Atlas entry {}x{} given {} bytes", width, height, rgba.size()));
+	}
+	if (image.image()) {
+		throw std::runtime_error("Texture atlas already uploaded");
+	}
+
+	// cells stay aligned to the padding so every atlas mip starts them on a whole texel
+	std::uint32_t cellW = align_up(width + 2 * ATLAS_PADDING, ATLAS_PADDING);
+	std::uint32_t cellH = align_up(height + 2 * ATLAS_PADDING, ATLAS_PADDING);
+	if (shelfX + cellW > ATLAS_SIZE) {
+		shelfY += shelfHeight;
+		shelfX = 0;
+		shelfHeight = 0;
+	}
+	if (shelfY + cellH > ATLAS_SIZE) return std::nullopt;
+	if (pixels.empty()) {
+		pixels.resize(static_cast<std::size_t>(ATLAS_SIZE) * ATLAS_SIZE * 4);
+	}
+
+	AtlasRect rect {.x = shelfX + ATLAS_PADDING, .y = shelfY + ATLAS_PADDING, .width = width, .height = height};
+	// edges are replicated into the padding so filtering and coarser mips never reach a neighbour
+	const auto pad = static_cast<std::int64_t>(ATLAS_PADDING);
+	for (std::int64_t y = -pad; y < static_cast<std::int64_t>(height) + pad; y++) {
+		auto srcY = static_cast<std::size_t>(std::clamp<std::int64_t>(y, 0, height - 1));
+		auto dstY = static_cast<std::size_t>(static_cast<std::int64_t>(rect.y) + y);
+		for (std::int64_t x = -pad; x < static_cast<std::int64_t>(width) + pad; x++) {
+			auto srcX = static_cast<std::size_t>(std::clamp<std::int64_t>(x, 0, width - 1));
+			auto dstX = static_cast<std::size_t>(static_cast<std::int64_t>(rect.x) + x);
+			std::memcpy(&pixels[(dstY * ATLAS_SIZE + dstX) * 4], &rgba[(srcY * width + srcX) * 4], 4);
+		}
+	}
+	shelfX += cellW;
+	shelfHeight = std::max(shelfHeight, cellH);
+	entries++;
+	return rect;
+}
+
+glm::vec4 TextureAtlas::uv_rect(const AtlasRect& rect) {
+	constexpr auto size = static_cast<float>(ATLAS_SIZE);
+	return {
+		static_cast<float>(rect.x) / size,
+		static_cast<float>(rect.y) / size,
+		static_cast<float>(rect.width) / size,
+		static_cast<float>(rect.height) / size
+	};
+}
+
+void TextureAtlas::upload(GpuContext& gpu) {
+	// every level goes through one staging buffer and one submit
+	std::vector<std::vector<std::uint8_t>> levels;
+	levels.push_back(std::move(pixels));
+	vk::DeviceSize totalBytes = levels.back().size();
+	for (std::uint32_t level = 1; level < ATLAS_MIP_LEVELS; level++) {
+		std::uint32_t size = ATLAS_SIZE >> (level - 1);
+		levels.push_back(downsample_rgba(levels.back(), {.width = size, .height = size}));
+		totalBytes += levels.back().size();
+	}
+
+	VmaBuffer stagingBuff(gpu.allocator, totalBytes, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	void* data = nullptr;
+	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &data);
+	std::vector<vk::BufferImageCopy2> uploads;
+	vk::DeviceSize offset = 0;
+	for (std::uint32_t level = 0; level < ATLAS_MIP_LEVELS; level++) {
+		std::memcpy(static_cast<char*>(data) + offset, levels[level].data(), levels[level].size());
+		std::uint32_t size = ATLAS_SIZE >> level;
+		uploads.push_back({
+			.bufferOffset = offset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = {
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = level,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = {0, 0, 0}, // NOLINT
+			.imageExtent = {size, size, 1} // NOLINT
+		});
+		offset += levels[level].size();
+	}
+	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
+
+	image = VmaImage(gpu.allocator, ATLAS_SIZE, ATLAS_SIZE, ATLAS_MIP_LEVELS, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Srgb, 0, VMA_MEMORY_USAGE_AUTO);
+	auto cmdBuff = gpu.begin_single_time_commands();
+	vk::ImageMemoryBarrier2 barrier {
+		.srcStageMask = vk::PipelineStageFlagBits2::eTopOfPipe,
+		.srcAccessMask = {},
+		.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.oldLayout = vk::ImageLayout::eUndefined,
+		.newLayout = vk::ImageLayout::eTransferDstOptimal,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image.image(),
+		.subresourceRange = {
+			.aspectMask = vk::ImageAspectFlagBits::eColor,
+			.baseMipLevel = 0,
+			.levelCount = ATLAS_MIP_LEVELS,
+			.baseArrayLayer = 0,
+			.layerCount = 1
+		}
+	};
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
+	cmdBuff.copyBufferToImage2({
+		.srcBuffer = stagingBuff.buffer(),
+		.dstImage = image.image(),
+		.dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+		.regionCount = static_cast<std::uint32_t>(uploads.size()),
+		.pRegions = uploads.data()
+	});
+	barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+	barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+	barrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+	barrier.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+	barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+	barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
+	gpu.end_single_time_commands(cmdBuff);
+
+	view = create_image_view(gpu.device, image.image(), vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, ATLAS_MIP_LEVELS);
+	std::println("Successfully uploaded texture atlas ({} entries, {} bytes over {} mips)", entries, totalBytes, ATLAS_MIP_LEVELS);
+}
+
+void TextureAtlas::destroy() {
+	view = nullptr;
+	image = VmaImage{};
+}
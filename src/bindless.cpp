@@ -0,0 +1,143 @@
+module velo;
+import std;
+import vulkan_hpp;
+
+BindlessHandle BindlessSlots::allocate() {
+	std::uint32_t index = 0;
+	if (!freeList.empty()) {
+		index = freeList.back();
+		freeList.pop_back();
+	} else if (generations.size() < _capacity) {
+		index = static_cast<std::uint32_t>(generations.size());
+		generations.push_back(0);
+	} else {
+		throw std::runtime_error(std::format("Bindless table full ({} slots)", _capacity));
+	}
+	_used++;
+	return {.index = index, .generation = generations[index]};
+}
+
+void BindlessSlots::release(BindlessHandle handle, std::uint64_t lastUseValue) {
+	if (!alive(handle)) {
+		throw std::runtime_error(std::format("Releasing stale bindless slot {} (generation {})", handle.index, handle.generation));
+	}
+	// bumped right away so stale handles are caught, the index itself waits for the timeline
+	generations[handle.index]++;
+	retiring.emplace_back(lastUseValue, handle.index);
+	_used--;
+}
+
+void BindlessSlots::recycle(std::uint64_t completedValue) {
+	while (!retiring.empty() && retiring.front().first <= completedValue) {
+		freeList.push_back(retiring.front().second);
+		retiring.pop_front();
+	}
+}
+
+bool BindlessSlots::alive(BindlessHandle handle) const {
+	return handle.index < generations.size() && generations[handle.index] == handle.generation;
+}
+
+void BindlessTable::query_limits(const vk::raii::PhysicalDevice& physicalDevice) {
+	auto props = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceVulkan12Properties>();
+	const auto& limits = props.get<vk::PhysicalDeviceVulkan12Properties>();
+	std::uint32_t samplerCap = std::min({
+		BINDLESS_MAX_SAMPLERS,
+		limits.maxDescriptorSetUpdateAfterBindSamplers,
+		limits.maxPerStageDescriptorUpdateAfterBindSamplers
+	});
+	// leave room for the samplers and the two storage buffers sharing the stage, clamped so a small limit can't wrap
+	std::uint32_t sharedResources = samplerCap + 2;
+	std::uint32_t stageRoom = limits.maxPerStageUpdateAfterBindResources > sharedResources ? limits.maxPerStageUpdateAfterBindResources - sharedResources : 0;
+	std::uint32_t textureCap = std::min({
+		BINDLESS_MAX_TEXTURES,
+		limits.maxDescriptorSetUpdateAfterBindSampledImages,
+		limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+		stageRoom
+	});
+	if (textureCap == 0 || samplerCap == 0) {
+		throw std::runtime_error(std::format("Device has no room for a bindless table ({} update after bind resources per stage)", limits.maxPerStageUpdateAfterBindResources));
+	}
+	reserve(textureCap, samplerCap);
+	std::println("Bindless table: {} texture slots, {} sampler slots", textureCap, samplerCap);
+}
+
+void BindlessTable::reserve(std::uint32_t textureCap, std::uint32_t samplerCap) {
+	textures = BindlessSlots(textureCap);
+	samplers = BindlessSlots(samplerCap);
+	pending.clear();
+}
+
+BindlessHandle BindlessTable::add_texture(vk::ImageView view) {
+	BindlessHandle handle = textures.allocate();
+	pending.push_back({.binding = 4, .index = handle.index, .view = view});
+	return handle;
+}
+
+BindlessHandle BindlessTable::add_sampler(vk::Sampler sampler) {
+	BindlessHandle handle = samplers.allocate();
+	pending.push_back({.binding = 1, .index = handle.index, .sampler = sampler});
+	return handle;
+}
+
+void BindlessTable::release_texture(BindlessHandle handle, std::uint64_t lastUseValue) {
+	textures.release(handle, lastUseValue);
+	drop_pending(4, handle.index);
+}
+
+void BindlessTable::release_sampler(BindlessHandle handle, std::uint64_t lastUseValue) {
+	samplers.release(handle, lastUseValue);
+	drop_pending(1, handle.index);
+}
+
+void BindlessTable::drop_pending(std::uint32_t binding, std::uint32_t index) {
+	// the view may be gone by the time flush() runs, and nothing can have read the slot yet
+	std::erase_if(pending, [&](const PendingWrite& write) { return write.binding == binding && write.index == index; });
+}
+
+void BindlessTable::recycle(std::uint64_t completedValue) {
+	textures.recycle(completedValue);
+	samplers.recycle(completedValue);
+}
+
+void BindlessTable::flush(GpuContext& gpu, DescriptorContext& descriptors, std::uint64_t completedValue) {
+	ProfileZone zone("bindless_flush");
+	recycle(completedValue);
+	if (pending.empty()) return;
+
+	if (descriptors.backend == DescriptorBackend::eBuffer) {
+		for (const auto& write : pending) {
+			descriptors.write_image(gpu, write.binding, write.index, write.view, write.sampler);
+		}
+		pending.clear();
+		return;
+	}
+
+	auto setWrites = prepare_set_writes(*descriptors.set);
+	gpu.device.updateDescriptorSets({static_cast<std::uint32_t>(setWrites.size()), setWrites.data()}, nullptr);
+}
+
+std::span<const vk::WriteDescriptorSet> BindlessTable::prepare_set_writes(vk::DescriptorSet set) {
+	// infos first, writes point into them
+	imageInfos.clear();
+	writes.clear();
+	for (const auto& write : pending) {
+		imageInfos.push_back({
+			.sampler = write.sampler,
+			.imageView = write.view,
+			.imageLayout = write.view ? vk::ImageLayout::eShaderReadOnlyOptimal : vk::ImageLayout::eUndefined
+		});
+	}
+	for (std::size_t i = 0; i < pending.size(); i++) {
+		writes.push_back({
+			.dstSet = set,
+			.dstBinding = pending[i].binding,
+			.dstArrayElement = pending[i].index,
+			.descriptorCount = 1,
+			.descriptorType = pending[i].binding == 4 ? vk::DescriptorType::eSampledImage : vk::DescriptorType::eSampler,
+			.pImageInfo = &imageInfos[i]
+		});
+	}
+	pending.clear();
+	return writes;
+}
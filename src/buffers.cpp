@@ -7,160 +7,400 @@ module velo;
 import std;
 import vulkan_hpp;
 
-void Velo::create_index_buffer() {
-	vk::DeviceSize buffSize = sizeof(indices[0]) * indices.size();
-	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-
-	void *dataStaging = nullptr;
-	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &dataStaging);
-	std::memcpy(dataStaging, indices.data(), buffSize);
-	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
-
-	indexBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-	gpu.copy_buffer(stagingBuff, indexBuff, buffSize);
-}
-
-void Velo::create_vertex_buffer() {
-	vk::DeviceSize buffSize = sizeof(vertices[0]) * vertices.size();
-	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-
-	void *dataStaging = nullptr;;
-	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &dataStaging);
-	std::memcpy(dataStaging, vertices.data(), buffSize);
-	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
-
-	vertexBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-	gpu.copy_buffer(stagingBuff, vertexBuff, buffSize);
-}
-
-void Velo::create_material_index_buffer() {
-	vk::DeviceSize buffSize = sizeof(std::uint32_t) * materialIndices.size();
-	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-
-	void *dataStaging = nullptr;
-	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &dataStaging);
-	std::memcpy(dataStaging, materialIndices.data(), buffSize);
-	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
-
-	materialIdxBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-	gpu.copy_buffer(stagingBuff, materialIdxBuff, buffSize);
-
-	vk::DescriptorBufferInfo matBuffInfo {
-		.buffer = materialIdxBuff.buffer(),
-		.offset = 0,
-		.range = buffSize
-	};
-	vk::WriteDescriptorSet writeSet {
-		.dstSet = *descriptors.set,
-		.dstBinding = 2,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = vk::DescriptorType::eStorageBuffer,
-		.pBufferInfo = &matBuffInfo
-	};
-	gpu.device.updateDescriptorSets(writeSet, nullptr);
+void Velo::create_geometry() {
+	ProfileZone zone("create_geometry");
+	for (const auto& vertex : vertices) {
+		sceneRadius = std::max(sceneRadius, glm::length(vertex.pos));
+	}
+	std::size_t meshIdx = meshes.size();
+	meshes.emplace_back();
+	// CPU copy stays around so an evicted mesh can come back without touching disk
+	meshAssets.push_back(residency.register_asset(std::format("{}#{}", MODEL_PATH, meshIdx), AssetKind::eMesh,
+		[this, meshIdx]() {
+			meshes[meshIdx] = geometry.upload(gpu, vertices, indices);
+			return static_cast<vk::DeviceSize>(meshes[meshIdx].vertexCount) * sizeof(GpuVertex) + static_cast<vk::DeviceSize>(meshes[meshIdx].indexCount) * sizeof(std::uint32_t);
+		},
+		[this, meshIdx]() {
+			geometry.release(meshes[meshIdx]);
+			meshes[meshIdx] = {};
+		}
+	));
+	residency.touch(meshAssets.back(), frameCount);
+	std::cout << "Successfully uploaded mesh to geometry arena, " << geometry.vertexAlloc.used() << '/' << geometry.vertexAlloc.capacity() << " vertices in use\n";
 }
 
 void Velo::update_uniform_buffers() {
-	static auto startTime = std::chrono::high_resolution_clock::now();
-	static auto lastTime = startTime;
-	auto currentTime = std::chrono::high_resolution_clock::now();
-	totalTime = std::chrono::duration<float>(currentTime - startTime).count();
-	dt = std::chrono::duration<float>(currentTime - lastTime).count();
-	lastTime = currentTime;
+	ProfileZone zone("update_uniform_buffers");
+	// dt was set by process_input(), live or from the input log
+	currAngle += dt * glm::radians(rotationSpeed) * static_cast<float>(rotation);
+	auto& frame = frames[frameIdx];
+	UniformBufferObject ubo = make_view_uniforms(position, currAngle, swapchain.extent, cameraEye, cameraFar);
+	glm::mat4 mvp = ubo.proj * ubo.view * ubo.model;
+	ubo.prevMvp = prevMvpValid ? prevMvp : mvp;
+	// render pixels to NDC, the viewport only covers renderExtent
+	ubo.jitter = glm::vec4(frameJitter * 2.0f / glm::vec2(renderExtent.width, renderExtent.height), 0.0f, 0.0f);
+	prevMvp = mvp;
+	prevMvpValid = true;
+	frame.viewAddress = frame.frameAlloc.push(ubo).address;
+	if (config.dynamic_resolution) {
+		// written every frame, a resubmitted command buffer reads this frame's jitter and history weight from here
+		UpsampleConstants constants {
+			.renderSize = {static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height)},
+			.outputSize = {static_cast<float>(swapchain.extent.width), static_cast<float>(swapchain.extent.height)},
+			.jitter = frameJitter,
+			.historyWeight = historyReady ? UPSAMPLE_HISTORY_WEIGHT : 0.0f
+		};
+		frame.upsampleAddress = frame.frameAlloc.push(constants).address;
+	}
+}
 
+UniformBufferObject make_view_uniforms(glm::vec3 position, float angle, vk::Extent2D extent, glm::vec3 eye, float farPlane) {
 	UniformBufferObject ubo{};
 	ubo.model = glm::translate(glm::mat4(1.0f), position);
-	currAngle += dt * glm::radians(rotationSpeed) * static_cast<float>(rotation);
 	ubo.model = glm::rotate(
 		ubo.model, // input matrix
-		currAngle,
+		angle,
 		glm::vec3(0.0f, 1.0f, 0.0f) // axis to rotate around
 	);
 	ubo.view = lookAt(
-		glm::vec3(0.0f, 3.0f, 7.0f), // view pos
+		eye, // view pos
 		glm::vec3(0.0f, 1.0f, 0.0f), // target
 		glm::vec3(0.0f, 1.0f, 0.0f)  // X/Y/Z up
 	);
 	// TODO: figure this one out
 	ubo.proj = glm::perspective(
-		glm::radians(45.0f),
-		static_cast<float>(swapchain.extent.width) / static_cast<float>(swapchain.extent.height),
-		0.1f, 10.0f
+		glm::radians(CAMERA_FOV),
+		static_cast<float>(extent.width) / static_cast<float>(extent.height),
+		0.1f, farPlane
 	);
 	ubo.proj[1][1] *= -1;
-
-	std::memcpy(frames[frameIdx].uniformBufferMapped, &ubo, sizeof(ubo));
+	ubo.prevMvp = ubo.proj * ubo.view * ubo.model;
+	ubo.jitter = glm::vec4(0.0f);
+	return ubo;
 }
 
 void Velo::record_command_buffer(std::uint32_t imgIdx) {
-	auto& cmdBuffer = frames[frameIdx].cmdBuffer;
+	ProfileZone zone("record_command_buffer");
+	auto start = std::chrono::steady_clock::now();
+	auto& frame = frames[frameIdx];
+	if (frame.cmdBuffers.size() != swapchain.images.size()) {
+		// this frame's previous submissions are done, wait_for_frame() saw to that
+		frame.resize_cmd_buffers(gpu, static_cast<std::uint32_t>(swapchain.images.size()));
+	}
+	build_draw_list();
+	std::uint64_t key = draw_structure_hash(imgIdx);
+	if (config.reuse_cmd_buffers && frame.recordedKeys[imgIdx] == key) {
+		cmdReuse.reused++;
+		cmdReuse.reuseTime += std::chrono::steady_clock::now() - start;
+		return;
+	}
+
+	auto& cmdBuffer = frame.cmdBuffers[imgIdx];
+	build_frame_graph(imgIdx);
+	cmdBuffer.reset();
 	cmdBuffer.begin({});
-	transition_image_layout(
+	profiler.begin_frame(cmdBuffer, frameIdx);
+	graph.execute(cmdBuffer, &profiler);
+	cmdBuffer.end();
+	// compiling may have reallocated the transients, key the buffer by the resources it actually references
+	frame.recordedKeys[imgIdx] = draw_structure_hash(imgIdx);
+	cmdReuse.recorded++;
+	cmdReuse.recordTime += std::chrono::steady_clock::now() - start;
+}
+
+static std::uint64_t hash_combine(std::uint64_t hash, std::uint64_t value) {
+	// FNV-1a over the value's bytes
+	for (std::uint32_t i = 0; i < 8; i++) {
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+
+std::uint64_t Velo::draw_structure_hash(std::uint32_t imgIdx) const {
+	std::uint64_t hash = 0xcbf29ce484222325ull;
+	hash = hash_combine(hash, swapchain.generation);
+	hash = hash_combine(hash, imgIdx);
+	hash = hash_combine(hash, frameIdx);
+	// stable from frame to frame as long as the allocation order is
+	hash = hash_combine(hash, frames[frameIdx].viewAddress);
+	hash = hash_combine(hash, frames[frameIdx].upsampleAddress);
+	hash = hash_combine(hash, (static_cast<std::uint64_t>(swapchain.extent.width) << 32) | swapchain.extent.height);
+	hash = hash_combine(hash, (static_cast<std::uint64_t>(renderExtent.width) << 32) | renderExtent.height);
+	// the history images the upsample barriers and blit name, at two frames in flight historyIdx follows frameIdx
+	// and adds no variants, historyReady only flips after a resize; jitter and weight are read from upsampleAddress
+	hash = hash_combine(hash, (historyIdx << 1) | static_cast<std::uint32_t>(historyReady));
+	hash = hash_combine(hash, reinterpret_cast<std::uint64_t>(static_cast<VkPipeline>(*graphicsPipeline)));
+	hash = hash_combine(hash, samplerSlot.index);
+	hash = hash_combine(hash, instanceAddress);
+	hash = hash_combine(hash, hotReload.generation);
+	// the copy targets a different ring slot each frame, capturing means recording every frame
+	hash = hash_combine(hash, reinterpret_cast<std::uint64_t>(static_cast<VkBuffer>(captureTarget)));
+	hash = hash_combine(hash, tuning.backfaceCull);
+	hash = hash_combine(hash, tuning.depthPrepass);
+	// recorded barriers and attachments point at the graph's transient images, any change in graph shape
+	// (pre-pass toggle, new pass, resize) that reallocates them invalidates every recorded buffer
+	hash = hash_combine(hash, graph.transient_generation());
+	// ImGui's draw data is rebuilt every frame, a visible overlay means recording every frame
+	if (overlay.visible()) {
+		hash = hash_combine(hash, frameCount);
+	}
+	// same fields draw_main_pass() bakes into the commands
+	for (const auto& item : drawList) {
+		const auto& sub = submeshes[item.submesh];
+		const auto& mesh = meshes[sub.mesh];
+		hash = hash_combine(hash, item.key);
+		hash = hash_combine(hash, (static_cast<std::uint64_t>(mesh.firstIndex + sub.firstIndex) << 32) | sub.indexCount);
+		hash = hash_combine(hash, (static_cast<std::uint64_t>(mesh.vertexOffset) << 32) | material_texture_slot(materials[sub.material]));
+		hash = hash_combine(hash, (static_cast<std::uint64_t>(sub.firstInstance) << 32) | sub.instanceCount);
+	}
+	return hash;
+}
+
+void CmdReuseStats::print() const {
+	auto average_us = [](std::chrono::nanoseconds total, std::uint64_t count) {
+		return count == 0 ? 0.0 : static_cast<double>(total.count()) / static_cast<double>(count) / 1000.0;
+	};
+	std::println("Command buffers: {} recorded ({:.1f} us avg), {} resubmitted ({:.1f} us avg)",
+		recorded, average_us(recordTime, recorded), reused, average_us(reuseTime, reused));
+}
+
+void Velo::build_frame_graph(std::uint32_t imgIdx) {
+	graph.reset();
+	RgHandle color = graph.import_image(
+		"swapchain",
 		swapchain.images[imgIdx],
+		*swapchain.imageViews[imgIdx],
+		{.format = swapchain.format, .extent = swapchain.extent, .usage = swapchain.usage, .aspect = vk::ImageAspectFlagBits::eColor},
 		vk::ImageLayout::eUndefined,
-		vk::ImageLayout::eColorAttachmentOptimal,
-		{},
-		vk::AccessFlagBits2::eColorAttachmentWrite,
-		vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-		vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-		vk::ImageAspectFlagBits::eColor
+		vk::ImageLayout::ePresentSrcKHR,
+		vk::PipelineStageFlagBits2::eColorAttachmentOutput // acquire semaphore waits here
 	);
-	transition_image_layout(
-		swapchain.depthImage.image(),
-		vk::ImageLayout::eUndefined,
-		vk::ImageLayout::eDepthAttachmentOptimal,
-		vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
-		vk::AccessFlagBits2::eDepthStencilAttachmentWrite,
-		vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
-		vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
-		vk::ImageAspectFlagBits::eDepth
+	RgHandle depth = graph.create_image(
+		"depth",
+		{.format = swapchain.depthFormat, .extent = swapchain.extent, .usage = vk::ImageUsageFlagBits::eDepthStencilAttachment, .aspect = vk::ImageAspectFlagBits::eDepth}
 	);
-	vk::ClearValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
-	vk::RenderingAttachmentInfo attachmentInfo = {
-		.imageView = *swapchain.imageViews[imgIdx],
-		.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+	if (config.dynamic_resolution) {
+		add_upsample_passes(color, depth);
+	} else {
+		add_scene_passes(color, RG_INVALID_HANDLE, depth);
+	}
+	if (overlay.visible()) {
+		graph.add_pass("overlay", RgPassType::eGraphics, [this, color](vk::raii::CommandBuffer& cmd, const RenderGraph& rg) {
+				overlay.draw(cmd, rg.view(color), swapchain.extent);
+			})
+			.read_write(color, RgUsage::eColorAttachment);
+	}
+	if (captureTarget) {
+		// after the overlay, the file matches what was presented
+		vk::Extent2D extent = swapchain.extent;
+		RgHandle readback = graph.import_buffer("capture", captureTarget, vk::DeviceSize{extent.width} * extent.height * 4);
+		graph.add_pass("capture", RgPassType::eTransfer, [color, readback, extent](vk::raii::CommandBuffer& cmd, const RenderGraph& rg) {
+				vk::BufferImageCopy2 region {
+					.bufferOffset = 0,
+					.bufferRowLength = 0,
+					.bufferImageHeight = 0,
+					.imageSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+					.imageOffset = {0, 0, 0},
+					.imageExtent = {extent.width, extent.height, 1}
+				};
+				cmd.copyImageToBuffer2({
+					.srcImage = rg.image(color),
+					.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+					.dstBuffer = rg.buffer(readback),
+					.regionCount = 1,
+					.pRegions = &region
+				});
+				// the graph only orders GPU work, the host reading the buffer needs its own barrier
+				vk::MemoryBarrier2 toHost {
+					.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+					.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+					.dstStageMask = vk::PipelineStageFlagBits2::eHost,
+					.dstAccessMask = vk::AccessFlagBits2::eHostRead
+				};
+				cmd.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &toHost});
+			})
+			.read(color, RgUsage::eTransferSrc)
+			.write(readback, RgUsage::eTransferDst);
+	}
+	graph.compile(gpu);
+}
+
+void Velo::add_upsample_passes(RgHandle output, RgHandle depth) {
+	vk::Extent2D extent = swapchain.extent;
+	auto import_target = [this, extent](const char* name, const VmaImage& img, vk::ImageView view, vk::Format format, vk::ImageUsageFlags usage, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout) {
+		// the targets outlive the frame, the previous frame's upsample and resolve may still be touching them on the queue
+		vk::PipelineStageFlags2 previousUse = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eTransfer;
+		return graph.import_image(name, img.image(), view, {.format = format, .extent = extent, .usage = usage, .aspect = vk::ImageAspectFlagBits::eColor}, initialLayout, finalLayout, previousUse);
+	};
+	// scene color and motion are rewritten every frame, the history images rest in eGeneral between frames
+	constexpr vk::ImageUsageFlags targetUsage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
+	RgHandle color = import_target("scene_color", upsampler.color, *upsampler.colorView, SCENE_COLOR_FORMAT, targetUsage, vk::ImageLayout::eUndefined, vk::ImageLayout::eUndefined);
+	RgHandle motion = import_target("motion", upsampler.motion, *upsampler.motionView, MOTION_FORMAT, targetUsage, vk::ImageLayout::eUndefined, vk::ImageLayout::eUndefined);
+	constexpr vk::ImageUsageFlags historyUsage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc;
+	std::uint32_t prevIdx = historyIdx ^ 1;
+	RgHandle prevHistory = import_target("history_prev", upsampler.history[prevIdx], *upsampler.historyViews[prevIdx], SCENE_COLOR_FORMAT,
+		historyUsage, historyReady ? vk::ImageLayout::eGeneral : vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+	RgHandle history = import_target("history", upsampler.history[historyIdx], *upsampler.historyViews[historyIdx], SCENE_COLOR_FORMAT,
+		historyUsage, vk::ImageLayout::eUndefined, vk::ImageLayout::eGeneral);
+
+	add_scene_passes(color, motion, depth);
+	graph.add_pass("upsample", RgPassType::eCompute, [this, extent](vk::raii::CommandBuffer& cmd, const RenderGraph&) {
+			upsampler.dispatch(cmd, historyIdx, frames[frameIdx].upsampleAddress, extent);
+		})
+		.read(color, RgUsage::eSampled)
+		.read(motion, RgUsage::eSampled)
+		.read(prevHistory, RgUsage::eSampled)
+		.write(history, RgUsage::eStorage);
+	graph.add_pass("resolve", RgPassType::eTransfer, [history, output, extent](vk::raii::CommandBuffer& cmd, const RenderGraph& rg) {
+			std::array<vk::Offset3D, 2> bounds = {vk::Offset3D{0, 0, 0}, vk::Offset3D{static_cast<std::int32_t>(extent.width), static_cast<std::int32_t>(extent.height), 1}};
+			vk::ImageBlit2 region {
+				.srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+				.srcOffsets = bounds,
+				.dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = 0, .baseArrayLayer = 0, .layerCount = 1},
+				.dstOffsets = bounds
+			};
+			// same size, the blit is only there for the float to swapchain format conversion
+			cmd.blitImage2({
+				.srcImage = rg.image(history),
+				.srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+				.dstImage = rg.image(output),
+				.dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+				.regionCount = 1,
+				.pRegions = &region,
+				.filter = vk::Filter::eNearest
+			});
+		})
+		.read(history, RgUsage::eTransferSrc)
+		.write(output, RgUsage::eTransferDst);
+}
+
+void Velo::add_scene_passes(RgHandle color, RgHandle motion, RgHandle depth) {
+	if (tuning.depthPrepass) {
+		graph.add_pass("depth_prepass", RgPassType::eGraphics, [this, depth](vk::raii::CommandBuffer& cmd, const RenderGraph& rg) {
+				draw_depth_prepass(cmd, rg.view(depth));
+			})
+			.write(depth, RgUsage::eDepthAttachment);
+	}
+	// separate scope names, so the profiler summary keeps shading with and without the pre-pass apart
+	RgPassBuilder pass = graph.add_pass(tuning.depthPrepass ? "main_equal" : "main", RgPassType::eGraphics, [this, color, motion, depth](vk::raii::CommandBuffer& cmd, const RenderGraph& rg) {
+		draw_main_pass(cmd, rg.view(color), motion == RG_INVALID_HANDLE ? nullptr : rg.view(motion), rg.view(depth));
+	});
+	pass.write(color, RgUsage::eColorAttachment);
+	if (motion != RG_INVALID_HANDLE) {
+		pass.write(motion, RgUsage::eColorAttachment);
+	}
+	if (tuning.depthPrepass) {
+		pass.read(depth, RgUsage::eDepthAttachment);
+	} else {
+		pass.write(depth, RgUsage::eDepthAttachment);
+	}
+}
+
+void Velo::draw_depth_prepass(vk::raii::CommandBuffer& cmdBuffer, vk::ImageView depthView) {
+	vk::RenderingAttachmentInfo depthAttachmentInfo {
+		.imageView = depthView,
+		.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
 		.loadOp = vk::AttachmentLoadOp::eClear,
 		.storeOp = vk::AttachmentStoreOp::eStore,
-		.clearValue = clearColor
+		.clearValue = vk::ClearDepthStencilValue(1.0f, 0)
+	};
+	vk::RenderingInfo renderingInfo = {
+		.renderArea = {.offset = {0, 0}, .extent = renderExtent}, // NOLINT
+		.layerCount = 1,
+		.colorAttachmentCount = 0,
+		.pDepthAttachment = &depthAttachmentInfo
+	};
+
+	cmdBuffer.beginRendering(renderingInfo);
+	cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *depthPrepassPipeline);
+	cmdBuffer.bindIndexBuffer(geometry.indexBuff.buffer(), 0, vk::IndexType::eUint32);
+	// 12 bytes a vertex instead of the 32 vertMain pulls
+	cmdBuffer.bindVertexBuffers(0, geometry.positionBuff.buffer(), vk::DeviceSize{0});
+	cmdBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height), 0.0f, 1.0f));
+	cmdBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), renderExtent));
+	cmdBuffer.setCullMode(tuning.backfaceCull ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone);
+	// depthMain only reads the view and the instances, materials don't matter here
+	PushConstants pc {
+		.view = frames[frameIdx].viewAddress,
+		.instances = instanceAddress,
+		.materialIdx = 0,
+		.textureidx = UINT32_MAX,
+		.samplerIdx = samplerSlot.index
 	};
+	cmdBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pc);
+	for (const auto& item : drawList) {
+		const auto& sub = submeshes[item.submesh];
+		const auto& mesh = meshes[sub.mesh];
+		cmdBuffer.drawIndexed(sub.indexCount, sub.instanceCount, mesh.firstIndex + sub.firstIndex, static_cast<std::int32_t>(mesh.vertexOffset), sub.firstInstance);
+	}
+	cmdBuffer.endRendering();
+}
+
+void Velo::draw_main_pass(vk::raii::CommandBuffer& cmdBuffer, vk::ImageView colorView, vk::ImageView motionView, vk::ImageView depthView) {
+	vk::ClearValue clearColor = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f);
+	std::array<vk::RenderingAttachmentInfo, 2> attachmentInfos = {{
+		{
+			.imageView = colorView,
+			.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+			.loadOp = vk::AttachmentLoadOp::eClear,
+			.storeOp = vk::AttachmentStoreOp::eStore,
+			.clearValue = clearColor
+		},
+		{
+			.imageView = motionView,
+			.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+			.loadOp = vk::AttachmentLoadOp::eClear,
+			.storeOp = vk::AttachmentStoreOp::eStore,
+			.clearValue = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 0.0f)
+		}
+	}};
 	vk::ClearValue clearDepth = vk::ClearDepthStencilValue(1.0f, 0);
+	// after the pre-pass depth is final, only tested against
+	bool prepassed = tuning.depthPrepass;
 	vk::RenderingAttachmentInfo depthAttachmentInfo {
-		.imageView = swapchain.depthView,
-		.imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
-		.loadOp = vk::AttachmentLoadOp::eClear,
-		.storeOp = vk::AttachmentStoreOp::eDontCare,
+		.imageView = depthView,
+		.imageLayout = prepassed ? vk::ImageLayout::eDepthReadOnlyOptimal : vk::ImageLayout::eDepthAttachmentOptimal,
+		.loadOp = prepassed ? vk::AttachmentLoadOp::eLoad : vk::AttachmentLoadOp::eClear,
+		.storeOp = prepassed ? vk::AttachmentStoreOp::eNone : vk::AttachmentStoreOp::eDontCare,
 		.clearValue = clearDepth
 	};
 	vk::RenderingInfo renderingInfo = {
-		.renderArea = {.offset = {0, 0}, .extent = swapchain.extent}, // NOLINT
+		.renderArea = {.offset = {0, 0}, .extent = renderExtent}, // NOLINT
 		.layerCount = 1,
-		.colorAttachmentCount = 1,
-		.pColorAttachments = &attachmentInfo,
+		.colorAttachmentCount = motionView ? 2u : 1u,
+		.pColorAttachments = attachmentInfos.data(),
 		.pDepthAttachment = &depthAttachmentInfo
 	};
 
 	cmdBuffer.beginRendering(renderingInfo);
 	cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, *graphicsPipeline);
-	cmdBuffer.bindVertexBuffers(0, vertexBuff.buffer(), {0});
-	cmdBuffer.bindIndexBuffer(indexBuff.buffer(), 0, vk::IndexType::eUint32);
-	cmdBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(swapchain.extent.width), static_cast<float>(swapchain.extent.height), 0.0f, 1.0f));
-	cmdBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), swapchain.extent));
-	cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, *descriptors.set, nullptr);
-	PushConstants pc {.objIdx = frameIdx, .textureidx = 0};
-	cmdBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pc);
-	cmdBuffer.drawIndexed(static_cast<std::uint32_t>(indices.size()), 1, 0, 0, 0);
+	// vertices are pulled from the arena storage buffer, one index bind covers every mesh
+	cmdBuffer.bindIndexBuffer(geometry.indexBuff.buffer(), 0, vk::IndexType::eUint32);
+	cmdBuffer.setViewport(0, vk::Viewport(0.0f, 0.0f, static_cast<float>(renderExtent.width), static_cast<float>(renderExtent.height), 0.0f, 1.0f));
+	cmdBuffer.setScissor(0, vk::Rect2D(vk::Offset2D(0, 0), renderExtent));
+	cmdBuffer.setCullMode(tuning.backfaceCull ? vk::CullModeFlagBits::eBack : vk::CullModeFlagBits::eNone);
+	// occluded fragments fail the equal test before fragMain runs
+	cmdBuffer.setDepthCompareOp(prepassed ? vk::CompareOp::eEqual : vk::CompareOp::eLess);
+	cmdBuffer.setDepthWriteEnable(prepassed ? vk::False : vk::True);
+	descriptors.bind(cmdBuffer, *pipelineLayout);
+	// draw list is sorted by material, so push constants only change at material boundaries
+	std::uint32_t boundMaterial = UINT32_MAX;
+	for (const auto& item : drawList) {
+		const auto& sub = submeshes[item.submesh];
+		const auto& mesh = meshes[sub.mesh];
+		if (sub.material != boundMaterial) {
+			PushConstants pc {
+				.view = frames[frameIdx].viewAddress,
+				.instances = instanceAddress,
+				.materialIdx = sub.material,
+				.textureidx = material_texture_slot(materials[sub.material]),
+				.samplerIdx = samplerSlot.index
+			};
+			cmdBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, pc);
+			boundMaterial = sub.material;
+		}
+		cmdBuffer.drawIndexed(sub.indexCount, sub.instanceCount, mesh.firstIndex + sub.firstIndex, static_cast<std::int32_t>(mesh.vertexOffset), sub.firstInstance);
+	}
 	cmdBuffer.endRendering();
-
-	transition_image_layout(
-		swapchain.images[imgIdx],
-		vk::ImageLayout::eColorAttachmentOptimal,
-		vk::ImageLayout::ePresentSrcKHR,
-		vk::AccessFlagBits2::eColorAttachmentWrite,
-		{},
-		vk::PipelineStageFlagBits2::eColorAttachmentOutput,
-		vk::PipelineStageFlagBits2::eBottomOfPipe,
-		vk::ImageAspectFlagBits::eColor
-	);
-	cmdBuffer.end();
 }
@@ -0,0 +1,153 @@
+module;
+#include <vk_mem_alloc.h>
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static bool capture_format_supported(vk::Format format) {
+	switch (format) {
+		case vk::Format::eB8G8R8A8Srgb:
+		case vk::Format::eB8G8R8A8Unorm:
+		case vk::Format::eR8G8B8A8Srgb:
+		case vk::Format::eR8G8B8A8Unorm:
+			return true;
+		default:
+			return false;
+	}
+}
+
+/// runs on a worker, pixels stay valid until the returned future is ready
+static double write_capture(const std::byte* pixels, vk::Extent2D extent, bool bgra, CaptureFormat format, const std::filesystem::path& path) {
+	auto start = std::chrono::steady_clock::now();
+	std::size_t texels = static_cast<std::size_t>(extent.width) * extent.height;
+	std::vector<std::uint8_t> rgba(texels * 4);
+	const auto* src = reinterpret_cast<const std::uint8_t*>(pixels);
+	// the swapchain's alpha is whatever blending left there, the window itself is opaque
+	for (std::size_t i = 0; i < texels; i++) {
+		rgba[i * 4 + 0] = src[i * 4 + (bgra ? 2 : 0)];
+		rgba[i * 4 + 1] = src[i * 4 + 1];
+		rgba[i * 4 + 2] = src[i * 4 + (bgra ? 0 : 2)];
+		rgba[i * 4 + 3] = 0xFF;
+	}
+	if (format == CaptureFormat::ePng) {
+		int width = static_cast<int>(extent.width);
+		if (stbi_write_png(path.c_str(), width, static_cast<int>(extent.height), 4, rgba.data(), width * 4) == 0) {
+			throw std::runtime_error(std::format("Failed to write {}", path.string()));
+		}
+	} else {
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(reinterpret_cast<const char*>(rgba.data()), static_cast<std::streamsize>(rgba.size()));
+		if (!out) {
+			throw std::runtime_error(std::format("Failed to write {}", path.string()));
+		}
+	}
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+bool FrameCapture::start(const std::filesystem::path& dir, CaptureFormat fmt, std::uint64_t frameLimit, vk::Format swapchainFormat) {
+	if (!capture_format_supported(swapchainFormat)) {
+		std::println("Frame capture disabled, can't read back swapchain format {}", vk::to_string(swapchainFormat));
+		return false;
+	}
+	std::filesystem::create_directories(dir);
+	outDir = dir;
+	format = fmt;
+	limit = frameLimit;
+	capturing = true;
+	std::println("Successfully started frame capture to {}", outDir.string());
+	return true;
+}
+
+vk::Buffer FrameCapture::begin_frame(GpuContext& gpu, std::uint64_t frame, vk::Extent2D extent, vk::Format swapchainFormat) {
+	if (!capturing) return nullptr;
+	auto start = std::chrono::steady_clock::now();
+	// dropped frames don't count, the limit is the number of frames written
+	if (limit > 0 && claimed >= limit) {
+		capturing = false;
+		return nullptr;
+	}
+	auto slot = std::ranges::find_if(slots, [](const CaptureSlot& s) { return s.frame == 0 && !s.encode; });
+	if (slot == slots.end()) {
+		// workers or the GPU are behind, skipping a frame beats stalling this one
+		stats.dropped++;
+		stats.renderThreadTime += std::chrono::steady_clock::now() - start;
+		return nullptr;
+	}
+	vk::DeviceSize size = vk::DeviceSize{extent.width} * extent.height * 4;
+	if (slot->buffer.size() < size) {
+		// random access: the worker reads every byte once, cached memory when the heap has it
+		slot->buffer = VmaBuffer(gpu.allocator, size, vk::BufferUsageFlagBits::eTransferDst,
+			VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+		allocator = gpu.allocator;
+	}
+	slot->extent = extent;
+	slot->bgra = swapchainFormat == vk::Format::eB8G8R8A8Srgb || swapchainFormat == vk::Format::eB8G8R8A8Unorm;
+	slot->frame = frame;
+	claimed++;
+	stats.renderThreadTime += std::chrono::steady_clock::now() - start;
+	return slot->buffer.buffer();
+}
+
+void FrameCapture::reap(CaptureSlot& slot) {
+	try {
+		double ms = slot.encode->get();
+		stats.captured++;
+		stats.bytes += vk::DeviceSize{slot.extent.width} * slot.extent.height * 4;
+		stats.encodeMs += ms;
+		stats.worstEncodeMs = std::max(stats.worstEncodeMs, ms);
+	} catch (const std::exception& e) {
+		stats.failed++;
+		std::println("Frame capture: {}", e.what());
+	}
+	slot.encode.reset();
+}
+
+void FrameCapture::collect(std::uint64_t completedValue, std::uint64_t frame) {
+	auto start = std::chrono::steady_clock::now();
+	for (auto& slot : slots) {
+		if (slot.encode && slot.encode->wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			reap(slot);
+		}
+		if (slot.frame == 0 || slot.frame > completedValue) continue;
+		// the copy ends with a host read barrier, invalidate covers non coherent heaps
+		vmaInvalidateAllocation(allocator, slot.buffer.allocation(), 0, VK_WHOLE_SIZE);
+		auto name = format == CaptureFormat::ePng
+			? std::format("frame_{:06}.png", slot.frame)
+			: std::format("frame_{:06}_{}x{}.rgba", slot.frame, slot.extent.width, slot.extent.height);
+		slot.encode = std::async(std::launch::async, write_capture, static_cast<const std::byte*>(slot.buffer.mapped_data()),
+			slot.extent, slot.bgra, format, outDir / name);
+		stats.latencyFrames += frame - slot.frame;
+		slot.frame = 0;
+	}
+	stats.renderThreadTime += std::chrono::steady_clock::now() - start;
+}
+
+void FrameCapture::finish(std::uint64_t frame) {
+	collect(UINT64_MAX, frame);
+	for (auto& slot : slots) {
+		if (slot.encode) {
+			reap(slot);
+		}
+	}
+	capturing = false;
+}
+
+void FrameCapture::print() const {
+	std::uint64_t handed = stats.captured + stats.failed;
+	if (handed == 0 && stats.dropped == 0) return;
+	double perFrameUs = static_cast<double>(stats.renderThreadTime.count()) / 1000.0 / static_cast<double>(std::max<std::uint64_t>(handed + stats.dropped, 1));
+	std::println("Capture: {} frames ({} MiB) to {}, {} dropped, {} failed, read {:.1f} frames after submit, {:.1f} us/frame render thread, encode {:.2f} ms avg {:.2f} ms worst (workers)",
+		stats.captured, stats.bytes >> 20, outDir.string(), stats.dropped, stats.failed,
+		handed == 0 ? 0.0 : static_cast<double>(stats.latencyFrames) / static_cast<double>(handed),
+		perFrameUs,
+		stats.captured == 0 ? 0.0 : stats.encodeMs / static_cast<double>(stats.captured), stats.worstEncodeMs);
+}
+
+void FrameCapture::destroy() {
+	for (auto& slot : slots) {
+		slot.buffer = VmaBuffer{};
+	}
+}
@@ -0,0 +1,351 @@
+module;
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+void DeletionQueue::retire(std::uint64_t lastUseValue, std::move_only_function<void()> fn) {
+	pending.emplace_back(lastUseValue, std::move(fn));
+}
+
+void DeletionQueue::flush(std::uint64_t completedValue) {
+	// retire values only ever grow, front is always the oldest
+	while (!pending.empty() && pending.front().first <= completedValue) {
+		pending.front().second();
+		pending.pop_front();
+	}
+}
+
+void DeletionQueue::flush_all() {
+	for (auto& [value, fn] : pending) {
+		fn();
+	}
+	pending.clear();
+}
+
+void DefragService::create(GpuContext& gpu) {
+	vk::CommandBufferAllocateInfo allocInfo {
+		.commandPool = *gpu.cmdPool,
+		.level = vk::CommandBufferLevel::ePrimary,
+		.commandBufferCount = 1
+	};
+	auto cmdBuffExpected = gpu.device.allocateCommandBuffers(allocInfo);
+	if (!cmdBuffExpected.has_value()) {
+		handle_error("Failed to allocate defrag command buffer", cmdBuffExpected.result);
+	}
+	cmdBuffer = std::move(cmdBuffExpected->front());
+
+	auto fenceExpected = gpu.device.createFence({});
+	if (!fenceExpected.has_value()) {
+		handle_error("Failed to create defrag fence", fenceExpected.result);
+	}
+	fence = std::move(*fenceExpected);
+}
+
+void DefragService::track(VmaAllocation allocation, DefragTarget target) {
+	targets.insert_or_assign(allocation, std::move(target));
+}
+
+void DefragService::forget(VmaBuffer& buffer) {
+	VmaAllocation allocation = buffer.allocation();
+	if (!allocation) return;
+	targets.erase(allocation);
+	for (auto& move : pending) {
+		if (passInfo.pMoves[move.moveIdx].srcAllocation != allocation) continue;
+		// mid pass, VMA frees the allocation at the end of the pass and the handle the caller gives up
+		// goes into whichever slot is still empty (old before the switch, new after it)
+		passInfo.pMoves[move.moveIdx].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+		(state == State::eCopying ? move.oldBuffer : move.newBuffer) = buffer.buffer();
+		buffer.release();
+		return;
+	}
+}
+
+void DefragService::forget(VmaImage& image) {
+	VmaAllocation allocation = image.allocation();
+	if (!allocation) return;
+	targets.erase(allocation);
+	for (auto& move : pending) {
+		if (passInfo.pMoves[move.moveIdx].srcAllocation != allocation) continue;
+		passInfo.pMoves[move.moveIdx].operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY;
+		(state == State::eCopying ? move.oldImage : move.newImage) = image.image();
+		image.release();
+		return;
+	}
+}
+
+void DefragService::start(GpuContext& gpu) {
+	if (active()) return;
+	VmaDefragmentationInfo info = {};
+	info.flags = VMA_DEFRAGMENTATION_FLAG_ALGORITHM_BALANCED_BIT;
+	info.maxBytesPerPass = maxBytesPerPass;
+	info.maxAllocationsPerPass = maxAllocationsPerPass;
+	VkResult res = vmaBeginDefragmentation(gpu.allocator, &info, &ctx);
+	if (res != VK_SUCCESS) {
+		handle_error("Failed to begin defragmentation", vk::Result(res));
+	}
+	passCount = 0;
+}
+
+void DefragService::step(GpuContext& gpu, std::uint64_t timelineValue, std::uint64_t completedValue) {
+	ProfileZone zone("defrag_step");
+	if (!active()) {
+		if (intervalFrames == 0 || timelineValue - lastRunFrame < intervalFrames) return;
+		lastRunFrame = timelineValue;
+		start(gpu);
+	}
+
+	switch (state) {
+		case State::eIdle:
+			begin_pass(gpu);
+			break;
+		case State::eCopying:
+			if (fence.getStatus() == vk::Result::eSuccess) {
+				switch_handles(timelineValue);
+			}
+			break;
+		case State::eRetiring:
+			if (completedValue >= retireValue) {
+				end_pass(gpu);
+			}
+			break;
+	}
+}
+
+void DefragService::begin_pass(GpuContext& gpu) {
+	VkResult res = vmaBeginDefragmentationPass(gpu.allocator, ctx, &passInfo);
+	if (res == VK_SUCCESS) {
+		// nothing left to move
+		finish(gpu);
+		return;
+	}
+	if (res != VK_INCOMPLETE) {
+		handle_error("Failed to begin defragmentation pass", vk::Result(res));
+	}
+
+	pending.clear();
+	cmdBuffer.reset();
+	cmdBuffer.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+	std::pmr::vector<vk::ImageMemoryBarrier2> preBarriers(scratch);
+	std::pmr::vector<vk::ImageMemoryBarrier2> postBarriers(scratch);
+	bool movesBuffers = false;
+	for (std::uint32_t i = 0; i < passInfo.moveCount; i++) {
+		auto& move = passInfo.pMoves[i];
+		auto it = targets.find(move.srcAllocation);
+		if (it == targets.end()) {
+			// untracked (staging, persistently mapped uniforms...), leave it where it is
+			move.operation = VMA_DEFRAGMENTATION_MOVE_OPERATION_IGNORE;
+			continue;
+		}
+		PendingMove pendingMove{.moveIdx = i};
+		if (it->second.buffer) {
+			pendingMove.newBuffer = it->second.buffer->create_alias(move.dstTmpAllocation);
+			movesBuffers = true;
+		} else {
+			const VmaImage& img = *it->second.image;
+			pendingMove.newImage = img.create_alias(move.dstTmpAllocation);
+			vk::ImageSubresourceRange range {
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.baseMipLevel = 0,
+				.levelCount = img.mip_levels(),
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			};
+			// textures live in shader read only, and have to be back there for the frames recorded in between
+			preBarriers.push_back({
+				.srcStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+				.srcAccessMask = {},
+				.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+				.dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+				.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+				.newLayout = vk::ImageLayout::eTransferSrcOptimal,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = img.image(),
+				.subresourceRange = range
+			});
+			preBarriers.push_back({
+				.srcStageMask = vk::PipelineStageFlagBits2::eNone,
+				.srcAccessMask = {},
+				.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+				.dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+				.oldLayout = vk::ImageLayout::eUndefined,
+				.newLayout = vk::ImageLayout::eTransferDstOptimal,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = pendingMove.newImage,
+				.subresourceRange = range
+			});
+			postBarriers.push_back({
+				.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+				.srcAccessMask = {},
+				.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+				.dstAccessMask = {},
+				.oldLayout = vk::ImageLayout::eTransferSrcOptimal,
+				.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = img.image(),
+				.subresourceRange = range
+			});
+			postBarriers.push_back({
+				.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+				.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+				.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+				.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead,
+				.oldLayout = vk::ImageLayout::eTransferDstOptimal,
+				.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+				.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+				.image = pendingMove.newImage,
+				.subresourceRange = range
+			});
+		}
+		pending.push_back(pendingMove);
+	}
+
+	if (pending.empty()) {
+		cmdBuffer.end();
+		end_pass(gpu);
+		return;
+	}
+
+	// buffers have no layout, they only need the upload that filled them finished before the copy reads them
+	vk::MemoryBarrier2 preBufferBarrier {
+		.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask = vk::AccessFlagBits2::eTransferRead
+	};
+	cmdBuffer.pipelineBarrier2({
+		.memoryBarrierCount = movesBuffers ? 1u : 0u,
+		.pMemoryBarriers = &preBufferBarrier,
+		.imageMemoryBarrierCount = static_cast<std::uint32_t>(preBarriers.size()),
+		.pImageMemoryBarriers = preBarriers.data()
+	});
+	for (const auto& move : pending) {
+		const auto& target = targets.at(passInfo.pMoves[move.moveIdx].srcAllocation);
+		if (move.newBuffer) {
+			cmdBuffer.copyBuffer(target.buffer->buffer(), vk::Buffer(move.newBuffer), vk::BufferCopy(0, 0, target.buffer->size()));
+			continue;
+		}
+		const VmaImage& img = *target.image;
+		std::pmr::vector<vk::ImageCopy> regions(scratch);
+		for (std::uint32_t mip = 0; mip < img.mip_levels(); mip++) {
+			vk::ImageSubresourceLayers layers {
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = mip,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			};
+			regions.push_back({
+				.srcSubresource = layers,
+				.srcOffset = {0, 0, 0}, // NOLINT
+				.dstSubresource = layers,
+				.dstOffset = {0, 0, 0}, // NOLINT
+				.extent = {std::max(1u, img.extent().width >> mip), std::max(1u, img.extent().height >> mip), 1} // NOLINT
+			});
+		}
+		cmdBuffer.copyImage(img.image(), vk::ImageLayout::eTransferSrcOptimal, vk::Image(move.newImage), vk::ImageLayout::eTransferDstOptimal, {static_cast<std::uint32_t>(regions.size()), regions.data()});
+	}
+	vk::MemoryBarrier2 bufferBarrier {
+		.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask = vk::PipelineStageFlagBits2::eAllCommands,
+		.dstAccessMask = vk::AccessFlagBits2::eMemoryRead
+	};
+	cmdBuffer.pipelineBarrier2({
+		.memoryBarrierCount = 1,
+		.pMemoryBarriers = &bufferBarrier,
+		.imageMemoryBarrierCount = static_cast<std::uint32_t>(postBarriers.size()),
+		.pImageMemoryBarriers = postBarriers.data()
+	});
+	cmdBuffer.end();
+
+	gpu.device.resetFences(*fence);
+	vk::CommandBufferSubmitInfo cmdInfo {
+		.commandBuffer = *cmdBuffer
+	};
+	vk::SubmitInfo2 submitInfo {
+		.commandBufferInfoCount = 1,
+		.pCommandBufferInfos = &cmdInfo
+	};
+	gpu.graphicsQueue.submit2(submitInfo, *fence);
+	state = State::eCopying;
+}
+
+void DefragService::switch_handles(std::uint64_t timelineValue) {
+	for (auto& move : pending) {
+		auto& vmaMove = passInfo.pMoves[move.moveIdx];
+		if (vmaMove.operation == VMA_DEFRAGMENTATION_MOVE_OPERATION_DESTROY) continue;
+		auto& target = targets.at(vmaMove.srcAllocation);
+		if (move.newBuffer) {
+			move.oldBuffer = target.buffer->swap_handle(move.newBuffer);
+			move.newBuffer = VK_NULL_HANDLE;
+		} else {
+			move.oldImage = target.image->swap_handle(move.newImage);
+			move.newImage = VK_NULL_HANDLE;
+		}
+		if (target.onMoved) {
+			target.onMoved();
+		}
+	}
+	// every frame submitted so far may still read the old copies
+	retireValue = timelineValue - 1;
+	state = State::eRetiring;
+}
+
+void DefragService::end_pass(GpuContext& gpu) {
+	VmaAllocatorInfo allocatorInfo;
+	vmaGetAllocatorInfo(gpu.allocator, &allocatorInfo);
+	for (const auto& move : pending) {
+		if (move.oldBuffer) vkDestroyBuffer(allocatorInfo.device, move.oldBuffer, nullptr);
+		if (move.newBuffer) vkDestroyBuffer(allocatorInfo.device, move.newBuffer, nullptr);
+		if (move.oldImage) vkDestroyImage(allocatorInfo.device, move.oldImage, nullptr);
+		if (move.newImage) vkDestroyImage(allocatorInfo.device, move.newImage, nullptr);
+	}
+	pending.clear();
+	passCount++;
+
+	// VMA swaps the moved allocations over to the new memory and frees the old blocks here
+	VkResult res = vmaEndDefragmentationPass(gpu.allocator, ctx, &passInfo);
+	state = State::eIdle;
+	if (res == VK_SUCCESS) {
+		finish(gpu);
+	} else if (res != VK_INCOMPLETE) {
+		handle_error("Failed to end defragmentation pass", vk::Result(res));
+	}
+}
+
+void DefragService::finish(GpuContext& gpu) {
+	VmaDefragmentationStats stats{};
+	vmaEndDefragmentation(gpu.allocator, ctx, &stats);
+	ctx = VK_NULL_HANDLE;
+	state = State::eIdle;
+	lifetimeStats.bytesMoved += stats.bytesMoved;
+	lifetimeStats.bytesFreed += stats.bytesFreed;
+	lifetimeStats.allocationsMoved += stats.allocationsMoved;
+	lifetimeStats.deviceMemoryBlocksFreed += stats.deviceMemoryBlocksFreed;
+	std::println("Defragmentation done in {} passes: moved {} bytes ({} allocations), freed {} bytes ({} blocks)",
+		passCount, stats.bytesMoved, stats.allocationsMoved, stats.bytesFreed, stats.deviceMemoryBlocksFreed);
+}
+
+void DefragService::destroy(GpuContext& gpu) {
+	if (state == State::eCopying) {
+		auto waitRes = gpu.device.waitForFences(*fence, vk::True, UINT64_MAX);
+		if (waitRes != vk::Result::eSuccess) {
+			handle_error("Failed to wait for defrag fence", waitRes);
+		}
+		switch_handles(0);
+	}
+	if (state == State::eRetiring) {
+		end_pass(gpu);
+	}
+	if (active()) {
+		finish(gpu);
+	}
+	targets.clear();
+	cmdBuffer = nullptr;
+	fence = nullptr;
+}
@@ -0,0 +1,105 @@
+module;
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static std::size_t descriptor_size(const vk::PhysicalDeviceDescriptorBufferPropertiesEXT& props, vk::DescriptorType type) {
+	switch (type) {
+		case vk::DescriptorType::eSampler: return props.samplerDescriptorSize;
+		case vk::DescriptorType::eSampledImage: return props.sampledImageDescriptorSize;
+		case vk::DescriptorType::eUniformBuffer: return props.uniformBufferDescriptorSize;
+		case vk::DescriptorType::eStorageBuffer: return props.storageBufferDescriptorSize;
+		default: throw std::invalid_argument("Unsupported descriptor type for descriptor buffer");
+	}
+}
+
+void DescriptorContext::create_buffer(GpuContext& gpu) {
+	const auto& props = gpu.descriptorBufferProps;
+	vk::DeviceSize alignment = props.descriptorBufferOffsetAlignment;
+	vk::DeviceSize size = (layout.getSizeEXT() + alignment - 1) / alignment * alignment;
+	// binding 0 is unused, per-frame data goes through device addresses
+	for (std::uint32_t binding = 1; binding < bindingOffsets.size(); binding++) {
+		bindingOffsets[binding] = layout.getBindingOffsetEXT(binding);
+	}
+	// samplers and resources share the set, so the one buffer carries both usages
+	descriptorBuff = VmaBuffer(gpu.allocator, size,
+		vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+		VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
+	descriptorBuffAddress = gpu.device.getBufferAddress({.buffer = descriptorBuff.buffer()});
+	std::println("Successfully created descriptor buffer ({} bytes)", size);
+}
+
+void DescriptorContext::write_buffer(GpuContext& gpu, std::uint32_t binding, std::uint32_t element, vk::DescriptorType type, const VmaBuffer& buff, vk::DeviceSize range) {
+	if (backend == DescriptorBackend::eSets) {
+		vk::DescriptorBufferInfo buffInfo {
+			.buffer = buff.buffer(),
+			.offset = 0,
+			.range = range
+		};
+		vk::WriteDescriptorSet writes {
+			.dstSet = *set,
+			.dstBinding = binding,
+			.dstArrayElement = element,
+			.descriptorCount = 1,
+			.descriptorType = type,
+			.pBufferInfo = &buffInfo
+		};
+		gpu.device.updateDescriptorSets(writes, nullptr);
+		return;
+	}
+
+	vk::DescriptorAddressInfoEXT addressInfo {
+		.address = gpu.device.getBufferAddress({.buffer = buff.buffer()}),
+		.range = range,
+		.format = vk::Format::eUndefined
+	};
+	vk::DescriptorGetInfoEXT getInfo {.type = type};
+	if (type == vk::DescriptorType::eUniformBuffer) {
+		getInfo.data.pUniformBuffer = &addressInfo;
+	} else {
+		getInfo.data.pStorageBuffer = &addressInfo;
+	}
+	std::size_t size = descriptor_size(gpu.descriptorBufferProps, type);
+	auto* dst = static_cast<char*>(descriptorBuff.mapped_data()) + bindingOffsets[binding] + element * size;
+	gpu.device.getDescriptorEXT(getInfo, size, dst);
+}
+
+void DescriptorContext::write_image(GpuContext& gpu, std::uint32_t binding, std::uint32_t element, vk::ImageView view, vk::Sampler sampler) {
+	vk::DescriptorImageInfo imageInfo {
+		.imageView = view,
+		.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+	};
+	vk::DescriptorGetInfoEXT getInfo {.type = view ? vk::DescriptorType::eSampledImage : vk::DescriptorType::eSampler};
+	if (view) {
+		getInfo.data.pSampledImage = &imageInfo;
+	} else {
+		getInfo.data.pSampler = &sampler;
+	}
+	std::size_t size = descriptor_size(gpu.descriptorBufferProps, getInfo.type);
+	auto* dst = static_cast<char*>(descriptorBuff.mapped_data()) + bindingOffsets[binding] + element * size;
+	gpu.device.getDescriptorEXT(getInfo, size, dst);
+}
+
+void DescriptorContext::bind(vk::raii::CommandBuffer& cmd, vk::PipelineLayout pipelineLayout) const {
+	if (backend == DescriptorBackend::eSets) {
+		cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, *set, nullptr);
+		return;
+	}
+	vk::DescriptorBufferBindingInfoEXT bindingInfo {
+		.address = descriptorBuffAddress,
+		.usage = vk::BufferUsageFlagBits::eResourceDescriptorBufferEXT | vk::BufferUsageFlagBits::eSamplerDescriptorBufferEXT
+	};
+	cmd.bindDescriptorBuffersEXT(bindingInfo);
+	std::uint32_t bufferIdx = 0;
+	vk::DeviceSize offset = 0;
+	cmd.setDescriptorBufferOffsetsEXT(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, bufferIdx, offset);
+}
+
+vk::PipelineCreateFlags DescriptorContext::pipeline_flags() const {
+	if (backend == DescriptorBackend::eBuffer) {
+		return vk::PipelineCreateFlagBits::eDescriptorBufferEXT;
+	}
+	return {};
+}
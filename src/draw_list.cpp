@@ -0,0 +1,44 @@
+module velo;
+import std;
+
+void radix_sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch) {
+	if (items.size() < 2) return;
+	scratch.resize(items.size());
+
+	// one histogram sweep for all eight bytes up front
+	std::array<std::array<std::uint32_t, 256>, 8> counts{};
+	for (const auto& item : items) {
+		for (std::uint32_t byte = 0; byte < 8; byte++) {
+			counts[byte][(item.key >> (byte * 8)) & 0xFF]++;
+		}
+	}
+
+	for (std::uint32_t byte = 0; byte < 8; byte++) {
+		auto& count = counts[byte];
+		// every key shares this byte, the pass wouldn't move anything
+		if (count[(items.front().key >> (byte * 8)) & 0xFF] == items.size()) continue;
+
+		std::uint32_t offset = 0;
+		for (auto& c : count) {
+			std::uint32_t n = c;
+			c = offset;
+			offset += n;
+		}
+		for (const auto& item : items) {
+			scratch[count[(item.key >> (byte * 8)) & 0xFF]++] = item;
+		}
+		items.swap(scratch);
+	}
+}
+
+void Velo::build_draw_list() {
+	ProfileZone zone("build_draw_list");
+	drawList.clear();
+	for (std::uint32_t i = 0; i < submeshes.size(); i++) {
+		const auto& sub = submeshes[i];
+		// evicted meshes have nothing in the arena to draw
+		if (meshes[sub.mesh].indexCount == 0) continue;
+		drawList.push_back({.key = draw_key(0, sub.material, sub.mesh), .submesh = i});
+	}
+	radix_sort_draws(drawList, drawScratch);
+}
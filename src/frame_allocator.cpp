@@ -0,0 +1,107 @@
+module;
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+void FrameAllocator::create(GpuContext& _gpu, vk::DeviceSize blockSize) {
+	gpu = &_gpu;
+	add_block(blockSize);
+}
+
+void FrameAllocator::add_block(vk::DeviceSize size) {
+	// uniform and storage reads both go through the address, the usage bits keep either binding style open
+	Block block {
+		.buffer = VmaBuffer(gpu->allocator, size,
+			vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eShaderDeviceAddress,
+			VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT)
+	};
+	block.address = gpu->device.getBufferAddress({.buffer = block.buffer.buffer()});
+	blocks.push_back(std::move(block));
+}
+
+FrameAllocation FrameAllocator::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+	vk::DeviceSize aligned = (offset + alignment - 1) / alignment * alignment;
+	while (aligned + size > blocks[current].buffer.size()) {
+		committed += offset;
+		offset = 0;
+		aligned = 0;
+		if (++current == blocks.size()) {
+			add_block(std::max(size, blocks.back().buffer.size() * 2));
+			std::println("Frame allocator grew to {} blocks ({} bytes)", blocks.size(), capacity());
+		}
+	}
+	offset = aligned + size;
+	const auto& block = blocks[current];
+	return {
+		.data = static_cast<char*>(block.buffer.mapped_data()) + aligned,
+		.address = block.address + aligned,
+		.size = size
+	};
+}
+
+void FrameAllocator::reset() {
+	current = 0;
+	offset = 0;
+	committed = 0;
+}
+
+void FrameAllocator::destroy() {
+	blocks.clear();
+	reset();
+}
+
+vk::DeviceSize FrameAllocator::capacity() const {
+	vk::DeviceSize total = 0;
+	for (const auto& block : blocks) {
+		total += block.buffer.size();
+	}
+	return total;
+}
+
+void AllocStats::add(const char* zone, AllocCounters delta) {
+	for (std::uint32_t i = 0; i < zoneCount; i++) {
+		if (zones[i].name == zone) {
+			zones[i].frame.count += delta.count;
+			zones[i].frame.bytes += delta.bytes;
+			return;
+		}
+	}
+	if (zoneCount == zones.size()) return;
+	zones[zoneCount++] = {.name = zone, .frame = delta};
+}
+
+void AllocStats::end_frame(std::uint64_t frame, AllocCounters delta) {
+	bool steady = frame > ALLOC_WARMUP_FRAMES;
+	if (steady) {
+		steadyFrames++;
+		steadyTotal.count += delta.count;
+		steadyTotal.bytes += delta.bytes;
+	}
+	if (steady && delta.count > 0) {
+		allocatingFrames++;
+		std::print("Frame {}: {} heap allocations ({} bytes) in draw_frame:", frame, delta.count, delta.bytes);
+		for (std::uint32_t i = 0; i < zoneCount; i++) {
+			if (zones[i].frame.count > 0) {
+				std::print(" {} {}", zones[i].name, zones[i].frame.count);
+			}
+		}
+		std::println("");
+	}
+	for (std::uint32_t i = 0; i < zoneCount; i++) {
+		if (steady) {
+			zones[i].total.count += zones[i].frame.count;
+			zones[i].total.bytes += zones[i].frame.bytes;
+		}
+		zones[i].frame = {};
+	}
+}
+
+void AllocStats::print() const {
+	std::println("Heap allocations after {} warmup frames: {} of {} frames allocated, {} allocations ({} bytes) total",
+		ALLOC_WARMUP_FRAMES, allocatingFrames, steadyFrames, steadyTotal.count, steadyTotal.bytes);
+	for (std::uint32_t i = 0; i < zoneCount; i++) {
+		std::println("\t{}: {} allocations, {} bytes", zones[i].name, zones[i].total.count, zones[i].total.bytes);
+	}
+}
@@ -0,0 +1,159 @@
+module;
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+OffsetAllocator::OffsetAllocator(std::uint64_t size) : _capacity(size) {
+	if (size > 0) {
+		freeRanges.emplace(0, size);
+	}
+}
+
+std::optional<std::uint64_t> OffsetAllocator::allocate(std::uint64_t size, std::uint64_t alignment) {
+	if (size == 0) {
+		return std::nullopt;
+	}
+	for (auto it = freeRanges.begin(); it != freeRanges.end(); ++it) {
+		auto [rangeOffset, rangeSize] = *it;
+		std::uint64_t aligned = (rangeOffset + alignment - 1) / alignment * alignment;
+		std::uint64_t padding = aligned - rangeOffset;
+		if (rangeSize < padding + size) continue;
+
+		freeRanges.erase(it);
+		// alignment padding stays free in front, the tail goes back behind
+		if (padding > 0) {
+			freeRanges.emplace(rangeOffset, padding);
+		}
+		if (rangeSize > padding + size) {
+			freeRanges.emplace(aligned + size, rangeSize - padding - size);
+		}
+		_used += size;
+		return aligned;
+	}
+	return std::nullopt;
+}
+
+void OffsetAllocator::free(std::uint64_t offset, std::uint64_t size) {
+	if (size == 0) return;
+	_used -= size;
+	auto next = freeRanges.lower_bound(offset);
+	if (next != freeRanges.begin()) {
+		auto prev = std::prev(next);
+		if (prev->first + prev->second == offset) {
+			offset = prev->first;
+			size += prev->second;
+			freeRanges.erase(prev);
+		}
+	}
+	if (next != freeRanges.end() && offset + size == next->first) {
+		size += next->second;
+		freeRanges.erase(next);
+	}
+	freeRanges.emplace(offset, size);
+}
+
+std::uint64_t OffsetAllocator::largest_free() const {
+	std::uint64_t largest = 0;
+	for (const auto& [offset, size] : freeRanges) {
+		largest = std::max(largest, size);
+	}
+	return largest;
+}
+
+void GeometryArena::create(GpuContext& gpu, DescriptorContext& descriptors) {
+	vk::DeviceSize vertexSize = sizeof(GpuVertex) * static_cast<vk::DeviceSize>(GEOMETRY_ARENA_VERTICES);
+	vk::DeviceSize indexSize = sizeof(std::uint32_t) * static_cast<vk::DeviceSize>(GEOMETRY_ARENA_INDICES);
+	vk::DeviceSize positionSize = sizeof(glm::vec3) * static_cast<vk::DeviceSize>(GEOMETRY_ARENA_VERTICES);
+	// a few big buffers, dedicated is the right call here
+	vertexBuff = VmaBuffer(gpu.allocator, vertexSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+	indexBuff = VmaBuffer(gpu.allocator, indexSize, vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+	positionBuff = VmaBuffer(gpu.allocator, positionSize, vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+	vertexAlloc = OffsetAllocator(GEOMETRY_ARENA_VERTICES);
+	indexAlloc = OffsetAllocator(GEOMETRY_ARENA_INDICES);
+
+	descriptors.write_buffer(gpu, 3, 0, vk::DescriptorType::eStorageBuffer, vertexBuff, vertexSize);
+	std::cout << "Successfully created geometry arena\n";
+}
+
+void write_gpu_vertices(std::span<const Vertex> vertices, GpuVertex* dst) {
+	for (std::size_t i = 0; i < vertices.size(); i++) {
+		dst[i] = {
+			.posU = glm::vec4(vertices[i].pos, vertices[i].texCoord.x),
+			.colorV = glm::vec4(vertices[i].color, vertices[i].texCoord.y)
+		};
+	}
+}
+
+Mesh GeometryArena::upload(GpuContext& gpu, std::span<const Vertex> vertices, std::span<const std::uint32_t> indices) {
+	return upload(gpu, vertices.size(), indices.size(), [&](GpuVertex* dstVertices, std::uint32_t* dstIndices) {
+		write_gpu_vertices(vertices, dstVertices);
+		std::memcpy(dstIndices, indices.data(), indices.size_bytes());
+	});
+}
+
+Mesh GeometryArena::upload(GpuContext& gpu, std::size_t vertexCount, std::size_t indexCount, const std::function<void(GpuVertex*, std::uint32_t*)>& fill) {
+	auto vertexOffset = vertexAlloc.allocate(vertexCount);
+	auto firstIndex = indexAlloc.allocate(indexCount);
+	if (!vertexOffset || !firstIndex) {
+		if (vertexOffset) vertexAlloc.free(*vertexOffset, vertexCount);
+		if (firstIndex) indexAlloc.free(*firstIndex, indexCount);
+		throw std::runtime_error("Geometry arena out of space");
+	}
+
+	vk::DeviceSize vertexBytes = sizeof(GpuVertex) * vertexCount;
+	vk::DeviceSize indexBytes = sizeof(std::uint32_t) * indexCount;
+	vk::DeviceSize positionBytes = sizeof(glm::vec3) * vertexCount;
+	// the position stream is read back out of the filled vertices, random access keeps that off uncached memory
+	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, vertexBytes + indexBytes + positionBytes, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT);
+
+	void* dataStaging = nullptr;
+	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &dataStaging);
+	auto* stagedVertices = static_cast<GpuVertex*>(dataStaging);
+	fill(stagedVertices, reinterpret_cast<std::uint32_t*>(static_cast<char*>(dataStaging) + vertexBytes));
+	auto* stagedPositions = reinterpret_cast<glm::vec3*>(static_cast<char*>(dataStaging) + vertexBytes + indexBytes);
+	for (std::size_t i = 0; i < vertexCount; i++) {
+		stagedPositions[i] = glm::vec3(stagedVertices[i].posU);
+	}
+	vmaFlushAllocation(gpu.allocator, stagingBuff.allocation(), 0, VK_WHOLE_SIZE);
+	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
+
+	// all copies in one submit
+	auto cmdBuff = gpu.begin_single_time_commands();
+	cmdBuff.copyBuffer(stagingBuff.buffer(), vertexBuff.buffer(), vk::BufferCopy(0, *vertexOffset * sizeof(GpuVertex), vertexBytes));
+	cmdBuff.copyBuffer(stagingBuff.buffer(), indexBuff.buffer(), vk::BufferCopy(vertexBytes, *firstIndex * sizeof(std::uint32_t), indexBytes));
+	cmdBuff.copyBuffer(stagingBuff.buffer(), positionBuff.buffer(), vk::BufferCopy(vertexBytes + indexBytes, *vertexOffset * sizeof(glm::vec3), positionBytes));
+	// the next frame's submit reads these without a host wait in between
+	vk::MemoryBarrier2 barrier {
+		.srcStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.dstStageMask = vk::PipelineStageFlagBits2::eVertexInput | vk::PipelineStageFlagBits2::eVertexShader,
+		.dstAccessMask = vk::AccessFlagBits2::eIndexRead | vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eShaderStorageRead
+	};
+	cmdBuff.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &barrier});
+	if (submit) {
+		submit(std::move(cmdBuff), std::move(stagingBuff));
+	} else {
+		gpu.end_single_time_commands(cmdBuff);
+	}
+
+	return {
+		.vertexOffset = static_cast<std::uint32_t>(*vertexOffset),
+		.firstIndex = static_cast<std::uint32_t>(*firstIndex),
+		.indexCount = static_cast<std::uint32_t>(indexCount),
+		.vertexCount = static_cast<std::uint32_t>(vertexCount)
+	};
+}
+
+void GeometryArena::release(const Mesh& mesh) {
+	vertexAlloc.free(mesh.vertexOffset, mesh.vertexCount);
+	indexAlloc.free(mesh.firstIndex, mesh.indexCount);
+}
+
+void GeometryArena::destroy() {
+	vertexBuff = VmaBuffer{};
+	indexBuff = VmaBuffer{};
+	positionBuff = VmaBuffer{};
+}
@@ -0,0 +1,386 @@
+module;
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <cgltf.h>
+#include <stb_image.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+MappedFile::MappedFile(const std::filesystem::path& path) {
+	int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		throw std::runtime_error(std::format("Failed to open {}", path.string()));
+	}
+	struct stat info{};
+	if (::fstat(fd, &info) != 0) {
+		::close(fd);
+		throw std::runtime_error(std::format("Failed to stat {}", path.string()));
+	}
+	_size = static_cast<std::size_t>(info.st_size);
+	if (_size > 0) {
+		_data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	// the mapping keeps its own reference to the file
+	::close(fd);
+	if (_data == MAP_FAILED) {
+		_data = nullptr;
+		_size = 0;
+		throw std::runtime_error(std::format("Failed to map {}", path.string()));
+	}
+	if (_data) {
+		// loaders walk the file front to back once, let the kernel read ahead aggressively
+		// advice values aren't flags, or'ing them asks for something else entirely
+		::madvise(_data, _size, MADV_SEQUENTIAL);
+		::madvise(_data, _size, MADV_WILLNEED);
+	}
+}
+
+void MappedFile::release(std::size_t offset, std::size_t length) const {
+	auto page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+	std::size_t begin = (offset + page - 1) / page * page;
+	std::size_t end = std::min(offset + length, _size) / page * page;
+	if (_data && end > begin) {
+		::madvise(static_cast<char*>(_data) + begin, end - begin, MADV_DONTNEED);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (_data) {
+		::munmap(_data, _size);
+	}
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept : _data(std::exchange(other._data, nullptr)), _size(std::exchange(other._size, 0)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+	if (this != &other) {
+		if (_data) {
+			::munmap(_data, _size);
+		}
+		_data = std::exchange(other._data, nullptr);
+		_size = std::exchange(other._size, 0);
+	}
+	return *this;
+}
+
+static const char* gltf_result_name(cgltf_result result) {
+	switch (result) {
+		case cgltf_result_success: return "success";
+		case cgltf_result_data_too_short: return "data too short";
+		case cgltf_result_unknown_format: return "unknown format";
+		case cgltf_result_invalid_json: return "invalid json";
+		case cgltf_result_invalid_gltf: return "invalid gltf";
+		case cgltf_result_invalid_options: return "invalid options";
+		case cgltf_result_file_not_found: return "file not found";
+		case cgltf_result_io_error: return "io error";
+		case cgltf_result_out_of_memory: return "out of memory";
+		case cgltf_result_legacy_gltf: return "legacy gltf";
+		default: return "unknown error";
+	}
+}
+
+/// raw view of one accessor inside a mapped buffer
+struct AccessorStream {
+	const std::uint8_t* base{};
+	std::size_t stride{};
+	const cgltf_accessor* accessor{};
+	bool plainFloat{};
+
+	explicit AccessorStream(const cgltf_accessor* acc) : accessor(acc) {
+		if (!acc) return;
+		base = static_cast<const std::uint8_t*>(acc->buffer_view->buffer->data) + acc->buffer_view->offset + acc->offset;
+		stride = acc->stride;
+		plainFloat = acc->component_type == cgltf_component_type_r_32f && !acc->normalized;
+	}
+
+	void read(std::size_t i, float* out, std::size_t count) const {
+		if (plainFloat) {
+			std::memcpy(out, base + i * stride, count * sizeof(float));
+		} else {
+			// normalized integers, rare enough for the per element path
+			cgltf_accessor_read_float(accessor, i, out, count);
+		}
+	}
+};
+
+static const cgltf_accessor* find_attribute(const cgltf_primitive& primitive, cgltf_attribute_type type) {
+	for (cgltf_size i = 0; i < primitive.attributes_count; i++) {
+		if (primitive.attributes[i].type == type && primitive.attributes[i].index == 0) {
+			return primitive.attributes[i].data;
+		}
+	}
+	return nullptr;
+}
+
+static void check_accessor(const cgltf_accessor* accessor, const std::filesystem::path& path) {
+	if (!accessor) return;
+	if (accessor->is_sparse || !accessor->buffer_view || !accessor->buffer_view->buffer->data) {
+		throw std::runtime_error(std::format("{}: sparse or bufferless accessors are not supported", path.string()));
+	}
+}
+
+GltfScene::~GltfScene() {
+	if (_data) {
+		cgltf_free(_data);
+	}
+}
+
+void GltfScene::open(const std::filesystem::path& path) {
+	ProfileZone zone("gltf_open");
+	_path = path;
+	file = MappedFile(path);
+	cgltf_options options{};
+	auto bytes = file.bytes();
+	cgltf_result result = cgltf_parse(&options, bytes.data(), bytes.size(), &_data);
+	if (result != cgltf_result_success) {
+		throw std::runtime_error(std::format("Failed to parse {}: {}", path.string(), gltf_result_name(result)));
+	}
+
+	// point the buffers into the mappings instead of cgltf_load_buffers() reading them into the heap
+	for (cgltf_size i = 0; i < _data->buffers_count; i++) {
+		cgltf_buffer& buffer = _data->buffers[i];
+		if (!buffer.uri) {
+			if (!_data->bin || _data->bin_size < buffer.size) {
+				throw std::runtime_error(std::format("{}: buffer {} has no binary chunk", path.string(), i));
+			}
+			buffer.data = const_cast<void*>(_data->bin);
+			continue;
+		}
+		if (std::string_view(buffer.uri).starts_with("data:")) {
+			throw std::runtime_error(std::format("{}: embedded base64 buffers are not supported, convert to .glb", path.string()));
+		}
+		std::string uri = buffer.uri;
+		cgltf_decode_uri(uri.data());
+		uri.resize(std::strlen(uri.c_str()));
+		MappedFile& external = externalBuffers.emplace_back(path.parent_path() / uri);
+		if (external.size() < buffer.size) {
+			throw std::runtime_error(std::format("{}: {} is shorter than its declared size", path.string(), uri));
+		}
+		buffer.data = const_cast<std::byte*>(external.bytes().data());
+	}
+	// bounds checks every accessor against its buffer, nothing below reads past a mapping
+	result = cgltf_validate(_data);
+	if (result != cgltf_result_success) {
+		throw std::runtime_error(std::format("{} failed validation: {}", path.string(), gltf_result_name(result)));
+	}
+
+	meshPrimitives.reserve(_data->meshes_count + 1);
+	for (cgltf_size m = 0; m < _data->meshes_count; m++) {
+		meshPrimitives.push_back(static_cast<std::uint32_t>(primitives.size()));
+		const cgltf_mesh& mesh = _data->meshes[m];
+		for (cgltf_size p = 0; p < mesh.primitives_count; p++) {
+			const cgltf_primitive& primitive = mesh.primitives[p];
+			const cgltf_accessor* position = find_attribute(primitive, cgltf_attribute_type_position);
+			if (primitive.type != cgltf_primitive_type_triangles || !position) {
+				std::println("{}: skipping primitive {} of mesh {} (not a triangle list with positions)", path.string(), p, m);
+				continue;
+			}
+			check_accessor(position, path);
+			check_accessor(find_attribute(primitive, cgltf_attribute_type_texcoord), path);
+			check_accessor(find_attribute(primitive, cgltf_attribute_type_color), path);
+			check_accessor(primitive.indices, path);
+			auto count = static_cast<std::uint32_t>(primitive.indices ? primitive.indices->count : position->count);
+			primitives.push_back({
+				.source = &primitive,
+				.vertexBase = vertexCount,
+				.vertexCount = static_cast<std::uint32_t>(position->count),
+				.firstIndex = indexCount,
+				.indexCount = count
+			});
+			vertexCount += static_cast<std::uint32_t>(position->count);
+			indexCount += count;
+		}
+	}
+	meshPrimitives.push_back(static_cast<std::uint32_t>(primitives.size()));
+	std::println("Successfully parsed {}: {} meshes, {} primitives, {} nodes, {} vertices, {} indices",
+		path.filename().string(), _data->meshes_count, primitives.size(), _data->nodes_count, vertexCount, indexCount);
+}
+
+Mesh GltfScene::upload(GpuContext& gpu, GeometryArena& geometry) const {
+	ProfileZone zone("gltf_upload");
+	return geometry.upload(gpu, vertexCount, indexCount, [this](GpuVertex* dstVertices, std::uint32_t* dstIndices) {
+		for (const auto& range : primitives) {
+			const cgltf_primitive& primitive = *range.source;
+			AccessorStream position(find_attribute(primitive, cgltf_attribute_type_position));
+			AccessorStream texcoord(find_attribute(primitive, cgltf_attribute_type_texcoord));
+			AccessorStream color(find_attribute(primitive, cgltf_attribute_type_color));
+			std::size_t colorComponents = color.accessor ? cgltf_num_components(color.accessor->type) : 0;
+
+			// one full GpuVertex store per vertex, staging memory is usually write combined
+			GpuVertex* dst = dstVertices + range.vertexBase;
+			for (std::size_t v = 0; v < range.vertexCount; v++) {
+				glm::vec3 pos{};
+				glm::vec2 uv{};
+				glm::vec4 rgba{1.0f};
+				position.read(v, glm::value_ptr(pos), 3);
+				if (texcoord.accessor) texcoord.read(v, glm::value_ptr(uv), 2);
+				if (color.accessor) color.read(v, glm::value_ptr(rgba), colorComponents);
+				dst[v] = {.posU = glm::vec4(pos, uv.x), .colorV = glm::vec4(glm::vec3(rgba), uv.y)};
+			}
+
+			std::uint32_t* out = dstIndices + range.firstIndex;
+			const cgltf_accessor* indices = primitive.indices;
+			if (!indices) {
+				std::iota(out, out + range.indexCount, range.vertexBase);
+				continue;
+			}
+			AccessorStream stream(indices);
+			switch (indices->component_type) {
+				case cgltf_component_type_r_8u:
+					for (std::size_t i = 0; i < range.indexCount; i++) {
+						out[i] = range.vertexBase + stream.base[i * stream.stride];
+					}
+					break;
+				case cgltf_component_type_r_16u:
+					for (std::size_t i = 0; i < range.indexCount; i++) {
+						std::uint16_t idx{};
+						std::memcpy(&idx, stream.base + i * stream.stride, sizeof(idx));
+						out[i] = range.vertexBase + idx;
+					}
+					break;
+				default:
+					for (std::size_t i = 0; i < range.indexCount; i++) {
+						std::uint32_t idx{};
+						std::memcpy(&idx, stream.base + i * stream.stride, sizeof(idx));
+						out[i] = range.vertexBase + idx;
+					}
+					break;
+			}
+		}
+	});
+}
+
+void GltfScene::build_draws(std::uint32_t mesh, std::uint32_t firstMaterial, std::vector<Submesh>& submeshes, std::vector<GpuInstance>& instances) const {
+	// bucket the nodes by mesh so every mesh's instances are one contiguous range
+	std::vector<std::vector<GpuInstance>> perMesh(_data->meshes_count);
+	for (cgltf_size n = 0; n < _data->nodes_count; n++) {
+		const cgltf_node& node = _data->nodes[n];
+		if (!node.mesh) continue;
+		GpuInstance instance;
+		cgltf_node_transform_world(&node, glm::value_ptr(instance.model));
+		perMesh[static_cast<std::size_t>(node.mesh - _data->meshes)].push_back(instance);
+	}
+	for (std::size_t m = 0; m < perMesh.size(); m++) {
+		if (perMesh[m].empty()) continue;
+		auto firstInstance = static_cast<std::uint32_t>(instances.size());
+		instances.insert(instances.end(), perMesh[m].begin(), perMesh[m].end());
+		for (std::uint32_t p = meshPrimitives[m]; p < meshPrimitives[m + 1]; p++) {
+			const auto& range = primitives[p];
+			const cgltf_material* material = range.source->material;
+			submeshes.push_back({
+				.mesh = mesh,
+				.firstIndex = range.firstIndex,
+				.indexCount = range.indexCount,
+				// the first material is the default for primitives without one
+				.material = firstMaterial + (material ? static_cast<std::uint32_t>(material - _data->materials) + 1 : 0),
+				.firstInstance = firstInstance,
+				.instanceCount = static_cast<std::uint32_t>(perMesh[m].size())
+			});
+		}
+	}
+}
+
+float GltfScene::radius() const {
+	float radius = 0.0f;
+	for (cgltf_size n = 0; n < _data->nodes_count; n++) {
+		const cgltf_node& node = _data->nodes[n];
+		if (!node.mesh) continue;
+		glm::mat4 world{1.0f};
+		cgltf_node_transform_world(&node, glm::value_ptr(world));
+		for (cgltf_size p = 0; p < node.mesh->primitives_count; p++) {
+			const cgltf_accessor* position = find_attribute(node.mesh->primitives[p], cgltf_attribute_type_position);
+			// required by the spec, but not everything writes them
+			if (!position || !position->has_min || !position->has_max) continue;
+			for (std::uint32_t corner = 0; corner < 8; corner++) {
+				glm::vec3 local(
+					(corner & 1u) ? position->max[0] : position->min[0],
+					(corner & 2u) ? position->max[1] : position->min[1],
+					(corner & 4u) ? position->max[2] : position->min[2]
+				);
+				radius = std::max(radius, glm::length(glm::vec3(world * glm::vec4(local, 1.0f))));
+			}
+		}
+	}
+	return radius;
+}
+
+void Velo::load_gltf() {
+	ProfileZone zone("load_gltf");
+	gltf.open(config.model_path);
+	const cgltf_data* data = gltf.data();
+
+	auto firstMaterial = static_cast<std::uint32_t>(materials.size());
+	materials.push_back({});
+	for (cgltf_size i = 0; i < data->materials_count; i++) {
+		const cgltf_material& material = data->materials[i];
+		glm::vec4 factor{1.0f};
+		if (material.has_pbr_metallic_roughness) {
+			factor = glm::make_vec4(material.pbr_metallic_roughness.base_color_factor);
+		}
+		const cgltf_texture* texture = material.has_pbr_metallic_roughness ? material.pbr_metallic_roughness.base_color_texture.texture : nullptr;
+		const cgltf_image* image = texture ? texture->image : nullptr;
+		// embedded images small enough for the atlas, anything else falls back to the base color
+		int width = 0, height = 0, channels = 0;
+		stbi_uc* pixels = nullptr;
+		if (image && image->buffer_view) {
+			const auto* encoded = static_cast<const stbi_uc*>(image->buffer_view->buffer->data) + image->buffer_view->offset;
+			if (stbi_info_from_memory(encoded, static_cast<int>(image->buffer_view->size), &width, &height, &channels) &&
+				static_cast<std::uint32_t>(std::max(width, height)) <= ATLAS_MAX_ENTRY_SIZE) {
+				pixels = stbi_load_from_memory(encoded, static_cast<int>(image->buffer_view->size), &width, &height, &channels, STBI_rgb_alpha);
+			}
+		}
+		if (pixels) {
+			std::span<const std::uint8_t> rgba(pixels, static_cast<std::size_t>(width) * static_cast<std::size_t>(height) * 4);
+			add_atlas_material(rgba, static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height));
+			stbi_image_free(pixels);
+		} else {
+			if (image) {
+				std::println("{}: material {} texture is external or larger than {}px, using its base color", gltf.path().filename().string(), i, ATLAS_MAX_ENTRY_SIZE);
+			}
+			if (materials.size() >= MAX_MATERIALS) {
+				throw std::runtime_error(std::format("Material table full ({} materials)", MAX_MATERIALS));
+			}
+			materials.push_back({});
+		}
+		// glTF factors are already linear
+		materials.back().params.baseColor = factor;
+	}
+
+	auto meshIdx = static_cast<std::uint32_t>(meshes.size());
+	meshes.push_back({});
+	meshAssets.push_back(residency.register_asset(std::format("{}#{}", config.model_path, meshIdx), AssetKind::eMesh,
+		[this, meshIdx]() {
+			// straight from the mapping again, nothing was kept on the heap
+			meshes[meshIdx] = gltf.upload(gpu, geometry);
+			return static_cast<vk::DeviceSize>(meshes[meshIdx].vertexCount) * sizeof(GpuVertex) + static_cast<vk::DeviceSize>(meshes[meshIdx].indexCount) * sizeof(std::uint32_t);
+		},
+		[this, meshIdx]() {
+			geometry.release(meshes[meshIdx]);
+			meshes[meshIdx] = {};
+		}
+	));
+	residency.touch(meshAssets.back(), frameCount);
+
+	std::vector<GpuInstance> instances;
+	gltf.build_draws(meshIdx, firstMaterial, submeshes, instances);
+	if (instances.empty()) {
+		throw std::runtime_error(std::format("{} has no node referencing a mesh", config.model_path));
+	}
+	create_instance_buffer(instances);
+	for (const auto& sub : submeshes) {
+		sceneTriangles += static_cast<std::uint64_t>(sub.indexCount / 3) * sub.instanceCount;
+	}
+
+	sceneRadius = std::max(gltf.radius(), 1e-3f);
+	// the default camera frames a model of about 2 units
+	cameraEye = CAMERA_EYE * std::max(1.0f, sceneRadius / 2.0f);
+	cameraFar = std::max(10.0f, glm::length(cameraEye) + sceneRadius * 2.0f);
+	std::println("Successfully loaded {}: {} submeshes, {} instances, {} materials", gltf.path().filename().string(), submeshes.size(), instances.size(), data->materials_count);
+}
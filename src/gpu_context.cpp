@@ -38,6 +38,11 @@ vk::raii::CommandBuffer GpuContext::begin_single_time_commands() {
 }
 
 void GpuContext::end_single_time_commands(vk::raii::CommandBuffer& cmdBuff)  const {
+	submit_single_time_commands(cmdBuff);
+	graphicsQueue.waitIdle();
+}
+
+void GpuContext::submit_single_time_commands(vk::raii::CommandBuffer& cmdBuff) const {
 	cmdBuff.end();
 
 	vk::SubmitInfo submitInfo {
@@ -45,12 +50,11 @@ void GpuContext::end_single_time_commands(vk::raii::CommandBuffer& cmdBuff)  con
 		.pCommandBuffers = &*cmdBuff
 	};
 	graphicsQueue.submit(submitInfo);
-	graphicsQueue.waitIdle();
 }
 
-void GpuContext::copy_buffer(VmaBuffer& srcBuff, VmaBuffer& dstBuff, vk::DeviceSize size) {
+void GpuContext::copy_buffer(VmaBuffer& srcBuff, VmaBuffer& dstBuff, vk::DeviceSize size, vk::DeviceSize dstOffset) {
 	auto cmdBuff = begin_single_time_commands();
-	cmdBuff.copyBuffer(srcBuff.buffer(), dstBuff.buffer(), vk::BufferCopy(0, 0, size));
+	cmdBuff.copyBuffer(srcBuff.buffer(), dstBuff.buffer(), vk::BufferCopy(0, dstOffset, size));
 	end_single_time_commands(cmdBuff);
 }
 
@@ -66,7 +70,8 @@ void GpuContext::create_logical_device(vk::raii::SurfaceKHR& _surface) {
 		vk::PhysicalDeviceVulkan11Features,
 		vk::PhysicalDeviceVulkan12Features,
 		vk::PhysicalDeviceVulkan13Features,
-		vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT
+		vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+		vk::PhysicalDeviceDescriptorBufferFeaturesEXT
 	> featureChain = {
 		{.features = { // 1.0
 			.geometryShader = true,
@@ -86,7 +91,8 @@ void GpuContext::create_logical_device(vk::raii::SurfaceKHR& _surface) {
 			.descriptorBindingPartiallyBound = true,
 			.descriptorBindingVariableDescriptorCount = true,
 			.runtimeDescriptorArray = true,
-			.timelineSemaphore = true
+			.timelineSemaphore = true,
+			.bufferDeviceAddress = true
 		},
 		{ // 1.3
 			.synchronization2 = true,
@@ -94,8 +100,35 @@ void GpuContext::create_logical_device(vk::raii::SurfaceKHR& _surface) {
 		},
 		// extensions
 		{.extendedDynamicState = true},
+		{.descriptorBuffer = true},
 	};
 
+	// optional, only turned on when the device has it
+	std::vector<const char*> deviceExtensions = requiredDeviceExtensions;
+	auto extsExpected = physicalDevice.enumerateDeviceExtensionProperties();
+	if (!extsExpected.has_value()) {
+		handle_error("Failed to query device for extensions", extsExpected.result);
+	}
+	descriptorBufferSupported = std::ranges::any_of(*extsExpected, [](const vk::ExtensionProperties& ext) {
+		return std::strcmp(ext.extensionName, vk::EXTDescriptorBufferExtensionName) == 0;
+	});
+	if (descriptorBufferSupported) {
+		auto supported = physicalDevice.getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorBufferFeaturesEXT>();
+		descriptorBufferSupported = supported.get<vk::PhysicalDeviceDescriptorBufferFeaturesEXT>().descriptorBuffer;
+	}
+	if (descriptorBufferSupported) {
+		deviceExtensions.push_back(vk::EXTDescriptorBufferExtensionName);
+		auto props = physicalDevice.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+		descriptorBufferProps = props.get<vk::PhysicalDeviceDescriptorBufferPropertiesEXT>();
+	} else {
+		featureChain.unlink<vk::PhysicalDeviceDescriptorBufferFeaturesEXT>();
+	}
+
+	pipelineStatsSupported = physicalDevice.getFeatures().pipelineStatisticsQuery;
+	featureChain.get<vk::PhysicalDeviceFeatures2>().features.pipelineStatisticsQuery = pipelineStatsSupported;
+	// zero valid bits means the queue can't write timestamps at all
+	timestampPeriod = qfps[graphicsIdx].timestampValidBits > 0 ? physicalDevice.getProperties().limits.timestampPeriod : 0.0f;
+
 	std::vector<vk::DeviceQueueCreateInfo> queueInfos{};
 	vk::DeviceQueueCreateInfo graphicsQueueInfo{
 		.queueFamilyIndex = graphicsIdx,
@@ -118,8 +151,8 @@ void GpuContext::create_logical_device(vk::raii::SurfaceKHR& _surface) {
 	deviceInfo.pNext = &featureChain.get<vk::PhysicalDeviceFeatures2>();
 	deviceInfo.queueCreateInfoCount = static_cast<std::uint32_t>(queueInfos.size());
 	deviceInfo.pQueueCreateInfos = queueInfos.data();
-	deviceInfo.enabledExtensionCount = static_cast<std::uint32_t>(requiredDeviceExtensions.size());
-	deviceInfo.ppEnabledExtensionNames = requiredDeviceExtensions.data();
+	deviceInfo.enabledExtensionCount = static_cast<std::uint32_t>(deviceExtensions.size());
+	deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
 
 	auto deviceExpected = physicalDevice.createDevice(deviceInfo);
 	if (!deviceExpected.has_value()) {
@@ -355,7 +388,7 @@ void GpuContext::init_vma() {
 	vkFns.vkGetDeviceProcAddr = instance.getDispatcher()->vkGetDeviceProcAddr;
 
 	VmaAllocatorCreateInfo allocatorInfo = {};
-	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT;
+	allocatorInfo.flags = VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT | VMA_ALLOCATOR_CREATE_BUFFER_DEVICE_ADDRESS_BIT;
 	allocatorInfo.physicalDevice = *physicalDevice;
 	allocatorInfo.device = *device;
 	allocatorInfo.pVulkanFunctions = &vkFns;
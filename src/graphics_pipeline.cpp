@@ -1,34 +1,37 @@
+module;
+#include <glm/glm.hpp>
+
 module velo;
 import std;
 import vulkan_hpp;
 
 void Velo::create_graphics_pipeline() {
-	auto shaderCode = read_file(SHADER_PATH);
+	auto shaderCode = assets.load(SHADER_PATH);
 	vk::raii::ShaderModule shaderModule = create_shader_module(shaderCode);
 
+	// the motion variants interpolate the unjittered positions and write the second attachment, only dynamic resolution has one
 	vk::PipelineShaderStageCreateInfo vertShaderInfo{
 		.stage = vk::ShaderStageFlagBits::eVertex,
 		.module = *shaderModule,
-		.pName = "vertMain"
+		.pName = config.dynamic_resolution ? "vertMainMotion" : "vertMain"
 	};
 	vk::PipelineShaderStageCreateInfo fragShaderInfo {
 		.stage = vk::ShaderStageFlagBits::eFragment,
 		.module = *shaderModule,
-		.pName = "fragMain"
+		.pName = config.dynamic_resolution ? "fragMainMotion" : "fragMain"
 	};
 	std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages = {vertShaderInfo, fragShaderInfo};
-	auto bindingDescription = Vertex::get_bindings_description();
-	auto attributeDescription = Vertex::get_attribute_description();
-	vk::PipelineVertexInputStateCreateInfo vertexInputInfo = {
-		.vertexBindingDescriptionCount = 1,
-		.pVertexBindingDescriptions = &bindingDescription,
-		.vertexAttributeDescriptionCount = attributeDescription.size(),
-		.pVertexAttributeDescriptions = attributeDescription.data()
-	};
+	// no vertex input, vertMain pulls from the geometry arena
+	vk::PipelineVertexInputStateCreateInfo vertexInputInfo = {};
 
 	std::vector<vk::DynamicState> dynStates = {
 		vk::DynamicState::eViewport,
-		vk::DynamicState::eScissor
+		vk::DynamicState::eScissor,
+		// core in 1.3, lets the overlay toggle culling without a second pipeline
+		vk::DynamicState::eCullMode,
+		// same for the depth pre-pass, shading after it tests eEqual without writing
+		vk::DynamicState::eDepthCompareOp,
+		vk::DynamicState::eDepthWriteEnable
 	};
 	vk::PipelineDynamicStateCreateInfo dynStateInfo {
 		.dynamicStateCount = static_cast<std::uint32_t>(dynStates.size()),
@@ -66,15 +69,23 @@ void Velo::create_graphics_pipeline() {
 		.sampleShadingEnable = vk::False
 	};
 
+	// dynamic resolution renders into its own targets, scene color plus motion vectors
+	std::array<vk::Format, 2> colorFormats = {swapchain.format, vk::Format::eUndefined};
+	std::uint32_t colorCount = 1;
+	if (config.dynamic_resolution) {
+		colorFormats = {SCENE_COLOR_FORMAT, MOTION_FORMAT};
+		colorCount = 2;
+	}
 	vk::PipelineColorBlendAttachmentState colorBlendAttachment {
 		.blendEnable = vk::False,
 		.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA
 	};
+	std::array<vk::PipelineColorBlendAttachmentState, 2> blendAttachments = {colorBlendAttachment, colorBlendAttachment};
 	vk::PipelineColorBlendStateCreateInfo colorBlending {
 		.logicOpEnable = vk::False,
 		.logicOp = vk::LogicOp::eCopy,
-		.attachmentCount = 1,
-		.pAttachments = &colorBlendAttachment
+		.attachmentCount = colorCount,
+		.pAttachments = blendAttachments.data()
 	};
 
 	vk::PushConstantRange pcRange {
@@ -94,15 +105,15 @@ void Velo::create_graphics_pipeline() {
 	}
 	pipelineLayout = std::move(*layoutExpected);
 
-	auto depthFmt = SwapchainContext::find_depth_format(gpu.physicalDevice);
 	vk::PipelineRenderingCreateInfo renderingInfo {
-		.colorAttachmentCount = 1,
-		.pColorAttachmentFormats = &swapchain.format,
-		.depthAttachmentFormat = depthFmt
+		.colorAttachmentCount = colorCount,
+		.pColorAttachmentFormats = colorFormats.data(),
+		.depthAttachmentFormat = swapchain.depthFormat
 	};
 
 	vk::GraphicsPipelineCreateInfo pipelineInfo {
 		.pNext = &renderingInfo,
+		.flags = descriptors.pipeline_flags(),
 		.stageCount = 2,
 		.pStages = shaderStages.data(),
 		.pVertexInputState = &vertexInputInfo,
@@ -123,11 +134,60 @@ void Velo::create_graphics_pipeline() {
 	}
 	graphicsPipeline = std::move(*pipelineExpected);
 	std::cout << "Successfully created graphics pipeline\n";
+
+	// depth pre-pass: same layout and raster state, positions only and no fragment stage
+	vk::PipelineShaderStageCreateInfo depthShaderInfo {
+		.stage = vk::ShaderStageFlagBits::eVertex,
+		.module = *shaderModule,
+		.pName = "depthMain"
+	};
+	vk::VertexInputBindingDescription positionBinding {
+		.binding = 0,
+		.stride = sizeof(glm::vec3),
+		.inputRate = vk::VertexInputRate::eVertex
+	};
+	vk::VertexInputAttributeDescription positionAttribute {
+		.location = 0,
+		.binding = 0,
+		.format = vk::Format::eR32G32B32Sfloat,
+		.offset = 0
+	};
+	vk::PipelineVertexInputStateCreateInfo positionInputInfo {
+		.vertexBindingDescriptionCount = 1,
+		.pVertexBindingDescriptions = &positionBinding,
+		.vertexAttributeDescriptionCount = 1,
+		.pVertexAttributeDescriptions = &positionAttribute
+	};
+	std::array<vk::DynamicState, 3> depthDynStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor, vk::DynamicState::eCullMode};
+	vk::PipelineDynamicStateCreateInfo depthDynStateInfo {
+		.dynamicStateCount = static_cast<std::uint32_t>(depthDynStates.size()),
+		.pDynamicStates = depthDynStates.data(),
+	};
+	vk::PipelineColorBlendStateCreateInfo noColorBlending {
+		.logicOpEnable = vk::False,
+		.logicOp = vk::LogicOp::eCopy,
+		.attachmentCount = 0
+	};
+	vk::PipelineRenderingCreateInfo depthRenderingInfo {
+		.colorAttachmentCount = 0,
+		.depthAttachmentFormat = swapchain.depthFormat
+	};
+	pipelineInfo.pNext = &depthRenderingInfo;
+	pipelineInfo.stageCount = 1;
+	pipelineInfo.pStages = &depthShaderInfo;
+	pipelineInfo.pVertexInputState = &positionInputInfo;
+	pipelineInfo.pColorBlendState = &noColorBlending;
+	pipelineInfo.pDynamicState = &depthDynStateInfo;
+	auto depthPipelineExpected = gpu.device.createGraphicsPipeline(nullptr, pipelineInfo);
+	if (!depthPipelineExpected.has_value()) {
+		handle_error("Failed to create depth pre-pass pipeline", depthPipelineExpected.result);
+	}
+	depthPrepassPipeline = std::move(*depthPipelineExpected);
 }
 
-vk::raii::ShaderModule Velo::create_shader_module(const std::vector<char>& code) const {
+vk::raii::ShaderModule Velo::create_shader_module(std::span<const std::byte> code) const {
 	vk::ShaderModuleCreateInfo shaderInfo {
-		.codeSize = code.size() * sizeof(char),
+		.codeSize = code.size(),
 		.pCode = reinterpret_cast<const std::uint32_t*>(code.data()),
 	};
 	auto moduleExpected = gpu.device.createShaderModule(shaderInfo);
@@ -137,39 +197,56 @@ vk::raii::ShaderModule Velo::create_shader_module(const std::vector<char>& code)
 	return std::move(*moduleExpected);
 }
 
-void DescriptorContext::create_layout(vk::raii::Device& device) {
-	vk::DescriptorSetLayoutBinding uniformBinding {
-		.binding = 0,
-		.descriptorType = vk::DescriptorType::eUniformBuffer,
-		.descriptorCount = MAX_OBJECTS,
-		.stageFlags = vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment
-	};
-	vk::DescriptorSetLayoutBinding textureBinding {
+void DescriptorContext::create_layout(vk::raii::Device& device, const BindlessTable& bindless) {
+	vk::DescriptorSetLayoutBinding samplerBinding {
 		.binding = 1,
-		.descriptorType = vk::DescriptorType::eCombinedImageSampler,
-		.descriptorCount = MAX_OBJECTS,
+		.descriptorType = vk::DescriptorType::eSampler,
+		.descriptorCount = bindless.sampler_capacity(),
 		.stageFlags = vk::ShaderStageFlagBits::eFragment
 	};
-	vk::DescriptorSetLayoutBinding materialIdxBinding {
+	vk::DescriptorSetLayoutBinding materialBinding {
 		.binding = 2,
 		.descriptorType = vk::DescriptorType::eStorageBuffer,
 		.descriptorCount = 1,
 		.stageFlags = vk::ShaderStageFlagBits::eFragment
 	};
-	std::array<vk::DescriptorSetLayoutBinding, 3> bindings = {uniformBinding, textureBinding, materialIdxBinding};
-	std::array<vk::DescriptorBindingFlags, 3> bindingsFlags
+	vk::DescriptorSetLayoutBinding vertexBinding {
+		.binding = 3,
+		.descriptorType = vk::DescriptorType::eStorageBuffer,
+		.descriptorCount = 1,
+		.stageFlags = vk::ShaderStageFlagBits::eVertex
+	};
+	// variable count is only allowed on the highest binding
+	vk::DescriptorSetLayoutBinding textureBinding {
+		.binding = 4,
+		.descriptorType = vk::DescriptorType::eSampledImage,
+		.descriptorCount = bindless.texture_capacity(),
+		.stageFlags = vk::ShaderStageFlagBits::eFragment
+	};
+	// binding 0 is gone, per-frame data is reached through the frame allocator's device addresses
+	std::array<vk::DescriptorSetLayoutBinding, 4> bindings = {samplerBinding, materialBinding, vertexBinding, textureBinding};
+	std::array<vk::DescriptorBindingFlags, 4> bindingsFlags
 	{
+		vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending,
 		vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
 		vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind,
-		vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind
+		vk::DescriptorBindingFlagBits::ePartiallyBound | vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending | vk::DescriptorBindingFlagBits::eVariableDescriptorCount
 	};
+	vk::DescriptorSetLayoutCreateFlags layoutFlags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool;
+	if (backend == DescriptorBackend::eBuffer) {
+		// descriptor buffers are always "update after bind", the set flags are not allowed there
+		for (auto& flags : bindingsFlags) {
+			flags &= vk::DescriptorBindingFlagBits::eVariableDescriptorCount;
+		}
+		layoutFlags = vk::DescriptorSetLayoutCreateFlagBits::eDescriptorBufferEXT;
+	}
 	vk::DescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsInfo {
 		.bindingCount = static_cast<std::uint32_t>(bindingsFlags.size()),
 		.pBindingFlags = bindingsFlags.data()
 	};
 	vk::DescriptorSetLayoutCreateInfo layoutInfo {
 		.pNext = bindingFlagsInfo,
-		.flags = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+		.flags = layoutFlags,
 		.bindingCount = static_cast<std::uint32_t>(bindings.size()),
 		.pBindings = bindings.data()
 	};
@@ -181,11 +258,11 @@ void DescriptorContext::create_layout(vk::raii::Device& device) {
 	layout = std::move(*layoutExpected);
 }
 
-void DescriptorContext::create_pool(vk::raii::Device& device) {
+void DescriptorContext::create_pool(vk::raii::Device& device, const BindlessTable& bindless) {
 	std::array<vk::DescriptorPoolSize, 3> poolSizes = {{
-		{.type = vk::DescriptorType::eUniformBuffer, .descriptorCount = MAX_OBJECTS},
-		{.type = vk::DescriptorType::eCombinedImageSampler, .descriptorCount = MAX_TEXTURES},
-		{.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 1}
+		{.type = vk::DescriptorType::eSampler, .descriptorCount = bindless.sampler_capacity()},
+		{.type = vk::DescriptorType::eSampledImage, .descriptorCount = bindless.texture_capacity()},
+		{.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = 2}
 	}};
 	vk::DescriptorPoolCreateInfo poolInfo {
 		.flags = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
@@ -200,9 +277,15 @@ void DescriptorContext::create_pool(vk::raii::Device& device) {
 	pool = std::move(*poolExpected);
 }
 
-void DescriptorContext::create_set(vk::raii::Device& device) {
+void DescriptorContext::create_set(vk::raii::Device& device, const BindlessTable& bindless) {
 	set.clear();
+	std::uint32_t textureCount = bindless.texture_capacity();
+	vk::DescriptorSetVariableDescriptorCountAllocateInfo variableInfo {
+		.descriptorSetCount = 1,
+		.pDescriptorCounts = &textureCount
+	};
 	vk::DescriptorSetAllocateInfo allocInfo {
+		.pNext = &variableInfo,
 		.descriptorPool = pool,
 		.descriptorSetCount = 1,
 		.pSetLayouts = &*layout
@@ -0,0 +1,186 @@
+module;
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <glm/glm.hpp>
+#include <tiny_obj_loader.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+AssetWatcher::~AssetWatcher() {
+	if (fd >= 0) {
+		::close(fd);
+	}
+}
+
+void AssetWatcher::watch(std::span<const std::filesystem::path> paths) {
+	if (fd < 0) {
+		fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) {
+			std::println("Hot reload unavailable, inotify_init1 failed");
+			return;
+		}
+	}
+	for (const auto& path : paths) {
+		auto absolute = std::filesystem::absolute(path).lexically_normal();
+		auto dir = absolute.parent_path();
+		// editors and exporters usually write a temp file and rename it over the old one, so watch the directory
+		int wd = ::inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (wd < 0) {
+			std::println("Hot reload: can't watch {}", dir.string());
+			continue;
+		}
+		dirs.emplace(wd, dir);
+		files.insert(absolute.string());
+	}
+}
+
+std::vector<std::filesystem::path> AssetWatcher::poll() {
+	std::vector<std::filesystem::path> changed;
+	if (fd < 0) return changed;
+	alignas(inotify_event) std::array<char, 4096> buffer{};
+	while (true) {
+		ssize_t length = ::read(fd, buffer.data(), buffer.size());
+		if (length <= 0) break;
+		for (ssize_t offset = 0; offset < length;) {
+			const auto* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+			offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+			auto dir = dirs.find(event->wd);
+			if (dir == dirs.end() || event->len == 0) continue;
+			auto path = dir->second / event->name;
+			if (files.contains(path.string()) && std::ranges::find(changed, path) == changed.end()) {
+				changed.push_back(std::move(path));
+			}
+		}
+	}
+	return changed;
+}
+
+static ReloadedMesh reload_obj(const std::string& path) {
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> objMaterials;
+	std::string warn, err;
+	if (!tinyobj::LoadObj(&attrib, &shapes, &objMaterials, &warn, &err, path.c_str())) {
+		throw std::runtime_error(warn + err);
+	}
+	ReloadedMesh mesh;
+	weld_obj_vertices(attrib, shapes, mesh.vertices, mesh.indices);
+	if (mesh.indices.empty()) {
+		throw std::runtime_error("no triangles");
+	}
+	return mesh;
+}
+
+static StreamedTexture reload_texture(const std::string& path) {
+	std::vector<char> bytes = read_file(path);
+	StreamedTexture texture;
+	// the whole mip chain is built here, off the render thread
+	texture.load(std::as_bytes(std::span(bytes)), path);
+	return texture;
+}
+
+void Velo::start_hot_reload() {
+	// only the default scene maps one file to one mesh and one texture
+	if (config.enabled_codam || !config.stress_scene.empty() || !config.model_path.empty()) return;
+	std::vector<std::filesystem::path> watched = {TEXTURE_PATH};
+	// the streaming import keeps no CPU copy to swap against
+	if (meshes.size() == 1 && !vertices.empty()) {
+		watched.emplace_back(MODEL_PATH);
+	}
+	hotReload.watcher.watch(watched);
+	if (hotReload.watcher.active()) {
+		std::println("Successfully started hot reload, watching {} files", watched.size());
+	}
+}
+
+/// the job's result, or nullopt while it's running or when it failed
+template <typename T>
+static std::optional<T> take_finished(std::optional<std::future<T>>& job, const char* what) {
+	if (!job || job->wait_for(std::chrono::seconds(0)) != std::future_status::ready) return std::nullopt;
+	auto future = std::move(*job);
+	job.reset();
+	try {
+		return future.get();
+	} catch (const std::exception& e) {
+		// half written files land here too, the next write triggers another attempt
+		std::println("Hot reload of {} failed: {}", what, e.what());
+		return std::nullopt;
+	}
+}
+
+void Velo::update_hot_reload() {
+	if (!hotReload.watcher.active()) return;
+	ProfileZone zone("hot_reload");
+	for (const auto& path : hotReload.watcher.poll()) {
+		bool isTexture = path == std::filesystem::absolute(TEXTURE_PATH).lexically_normal();
+		(isTexture ? hotReload.textureDirty : hotReload.meshDirty) = true;
+	}
+	if (hotReload.textureDirty && !hotReload.texture) {
+		hotReload.textureDirty = false;
+		hotReload.texture = std::async(std::launch::async, reload_texture, TEXTURE_PATH);
+	}
+	if (hotReload.meshDirty && !hotReload.mesh) {
+		hotReload.meshDirty = false;
+		hotReload.mesh = std::async(std::launch::async, reload_obj, MODEL_PATH);
+	}
+
+	if (auto texture = take_finished(hotReload.texture, TEXTURE_PATH.c_str())) {
+		swap_texture(std::move(*texture));
+	}
+	if (auto mesh = take_finished(hotReload.mesh, MODEL_PATH.c_str())) {
+		swap_model(std::move(*mesh));
+	}
+}
+
+void Velo::swap_texture(StreamedTexture&& texture) {
+	auto start = std::chrono::steady_clock::now();
+	texture.budgetMip = std::min(textureStream.budgetMip, texture.mip_count() - 1);
+	bool resident = textureImage.image();
+	if (resident) {
+		// frames in flight keep sampling the old image through the old slot until the timeline passes them
+		defrag.forget(textureImage);
+		retired.retire(frameCount, [img = std::move(textureImage), view = std::move(textureImageView)]() mutable {
+			view.clear();
+			img = VmaImage{};
+		});
+		textureImage = VmaImage{};
+		textureImageView = nullptr;
+	}
+	textureStream = std::move(texture);
+	// an evicted texture picks the new mips up when residency brings it back
+	if (resident) {
+		// starts low res, update_texture_streaming() refines it over the next frames; only the texture's slot changes
+		create_texture_image();
+	}
+	hotReload.generation++;
+	std::println("Hot reloaded {} ({}x{}) in {:.2f} ms", TEXTURE_PATH, textureStream.extent.width, textureStream.extent.height,
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
+
+void Velo::swap_model(ReloadedMesh&& mesh) {
+	auto start = std::chrono::steady_clock::now();
+	const std::uint32_t meshIdx = 0;
+	// an evicted mesh has nothing on the GPU, residency uploads the new vertices when it comes back
+	if (meshes[meshIdx].indexCount > 0) {
+		Mesh replacement = geometry.upload(gpu, mesh.vertices, mesh.indices);
+		retired.retire(frameCount, [this, old = meshes[meshIdx]]() { geometry.release(old); });
+		meshes[meshIdx] = replacement;
+	}
+	vertices = std::move(mesh.vertices);
+	indices = std::move(mesh.indices);
+	for (auto& sub : submeshes) {
+		if (sub.mesh == meshIdx) {
+			sub.indexCount = static_cast<std::uint32_t>(indices.size());
+		}
+	}
+	sceneRadius = 1.0f;
+	for (const auto& vertex : vertices) {
+		sceneRadius = std::max(sceneRadius, glm::length(vertex.pos));
+	}
+	sceneTriangles = indices.size() / 3;
+	hotReload.generation++;
+	std::println("Hot reloaded {} ({} vertices) in {:.2f} ms", MODEL_PATH, vertices.size(),
+		std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+}
@@ -2,19 +2,20 @@ module;
 #include <vk_mem_alloc.h>
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <glm/glm.hpp>
 
 module velo;
 import std;
 import vulkan_hpp;
 
-vk::raii::ImageView create_image_view(vk::raii::Device& device, const vk::Image& img, vk::Format fmt, vk::ImageAspectFlags aspectFlags, std::uint32_t mips) {
+vk::raii::ImageView create_image_view(vk::raii::Device& device, const vk::Image& img, vk::Format fmt, vk::ImageAspectFlags aspectFlags, std::uint32_t mips, std::uint32_t baseMip) {
 	vk::ImageViewCreateInfo viewInfo {
 		.image = img,
 		.viewType = vk::ImageViewType::e2D,
 		.format = fmt,
 		.subresourceRange = {
 			.aspectMask = aspectFlags,
-			.baseMipLevel = 0,
+			.baseMipLevel = baseMip,
 			.levelCount = mips,
 			.baseArrayLayer = 0,
 			.layerCount = 1
@@ -27,29 +28,342 @@ vk::raii::ImageView create_image_view(vk::raii::Device& device, const vk::Image&
 	return (std::move(*imgViewExpected));
 }
 
-void Velo::create_texture_image() {
+std::vector<std::uint8_t> downsample_rgba(std::span<const std::uint8_t> src, vk::Extent2D srcExtent) {
+	vk::Extent2D dst = {.width = std::max(1u, srcExtent.width >> 1), .height = std::max(1u, srcExtent.height >> 1)};
+	std::vector<std::uint8_t> level(static_cast<std::size_t>(dst.width) * dst.height * 4);
+	for (std::uint32_t y = 0; y < dst.height; y++) {
+		std::uint32_t y0 = std::min(y * 2, srcExtent.height - 1);
+		std::uint32_t y1 = std::min(y * 2 + 1, srcExtent.height - 1);
+		for (std::uint32_t x = 0; x < dst.width; x++) {
+			std::uint32_t x0 = std::min(x * 2, srcExtent.width - 1);
+			std::uint32_t x1 = std::min(x * 2 + 1, srcExtent.width - 1);
+			for (std::uint32_t c = 0; c < 4; c++) {
+				std::uint32_t sum = src[(y0 * srcExtent.width + x0) * 4 + c] + src[(y0 * srcExtent.width + x1) * 4 + c]
+					+ src[(y1 * srcExtent.width + x0) * 4 + c] + src[(y1 * srcExtent.width + x1) * 4 + c];
+				level[(y * dst.width + x) * 4 + c] = static_cast<std::uint8_t>((sum + 2) / 4);
+			}
+		}
+	}
+	return level;
+}
+
+/// png/jpg can't decode a single level, so this decodes level 0 and box filters down, keeping [first, last)
+static std::vector<std::vector<std::uint8_t>> decode_levels(std::span<const std::byte> encoded, std::uint32_t first, std::uint32_t last) {
 	int texWidth = 0, texHeight = 0, texChannels = 0;
-	stbi_uc* pixels{};
-	pixels = stbi_load(TEXTURE_PATH.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
+	stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(encoded.data()), static_cast<int>(encoded.size()), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
 	if (!pixels) {
 		throw std::runtime_error("Failed to load pixels from texture");
 	}
-	vk::DeviceSize imgSize = static_cast<vk::DeviceSize>(texWidth * texHeight) * 4; // 4 bytes per pixel
-	mipLvls = static_cast<std::uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+	vk::Extent2D ext{static_cast<std::uint32_t>(texWidth), static_cast<std::uint32_t>(texHeight)};
+	std::vector<std::uint8_t> level(pixels, pixels + static_cast<std::size_t>(texWidth) * static_cast<std::size_t>(texHeight) * 4); // 4 bytes per pixel
+	stbi_image_free(pixels);
+
+	std::vector<std::vector<std::uint8_t>> levels;
+	levels.reserve(last - first);
+	for (std::uint32_t mip = 0; mip < last; mip++) {
+		// good enough for streaming
+		std::vector<std::uint8_t> next = mip + 1 < last ? downsample_rgba(level, ext) : std::vector<std::uint8_t>{};
+		if (mip >= first) {
+			levels.push_back(std::move(level));
+		}
+		level = std::move(next);
+		ext = {.width = std::max(1u, ext.width >> 1), .height = std::max(1u, ext.height >> 1)};
+	}
+	return levels;
+}
+
+void StreamedTexture::load(std::span<const std::byte> file, const std::string& name) {
+	int texWidth = 0, texHeight = 0, texChannels = 0;
+	if (!stbi_info_from_memory(reinterpret_cast<const stbi_uc*>(file.data()), static_cast<int>(file.size()), &texWidth, &texHeight, &texChannels)) {
+		throw std::runtime_error("Failed to load pixels from texture");
+	}
+	extent = vk::Extent2D{static_cast<std::uint32_t>(texWidth), static_cast<std::uint32_t>(texHeight)};
+	auto count = static_cast<std::uint32_t>(std::floor(std::log2(std::max(texWidth, texHeight)))) + 1;
+	encoded = std::make_shared<const std::vector<std::byte>>(file.begin(), file.end());
+	tailMip = 0;
+	while (tailMip + 1 < count && std::max(mip_extent(tailMip).width, mip_extent(tailMip).height) > TEXTURE_STREAM_START_SIZE) {
+		tailMip++;
+	}
+	// the tail is what shows up right away, it's a few KiB
+	mips.assign(count, {});
+	auto tail = decode_levels(*encoded, tailMip, count);
+	std::ranges::move(tail, mips.begin() + tailMip);
+	decode.reset();
+	allocatedMip = count;
+	uploadedMip = count;
+	residentMip = count;
+	wantedMip = count - 1;
+	std::println("Decoded {} ({}x{}, {} mips, from {} on kept in memory)", name, extent.width, extent.height, count, tailMip);
+}
+
+void StreamedTexture::request(std::uint32_t mip) {
+	if (decode || mip >= tailMip || on_cpu(mip)) return;
+	decodeMip = mip;
+	decode = std::async(std::launch::async, [data = encoded, mip, last = tailMip]() {
+		return decode_levels(*data, mip, last);
+	});
+}
+
+void StreamedTexture::poll() {
+	if (!decode || decode->wait_for(std::chrono::seconds(0)) != std::future_status::ready) return;
+	auto future = std::move(*decode);
+	decode.reset();
+	try {
+		auto levels = future.get();
+		for (std::uint32_t i = 0; i < levels.size(); i++) {
+			if (!on_cpu(decodeMip + i)) {
+				mips[decodeMip + i] = std::move(levels[i]);
+			}
+		}
+	} catch (const std::exception& e) {
+		// the next request tries again
+		std::println("Texture decode failed: {}", e.what());
+	}
+}
+
+void Velo::create_texture_image() {
+	if (!textureStream.loaded()) {
+		textureStream.load(assets.load(TEXTURE_PATH), TEXTURE_PATH);
+	}
+	// the CPU tail makes the texture usable right away, update_texture_streaming() refines it
+	std::uint32_t first = std::max(textureStream.tailMip, textureStream.budgetMip);
+	allocate_texture(first);
+	upload_texture_levels(first, textureStream.mip_count());
+	std::cout << "Successfully created image\n";
+}
+
+void Velo::submit_upload(vk::raii::CommandBuffer&& cmdBuff, VmaBuffer&& staging) {
+	if (frameCount == 0) {
+		// startup, nothing to overlap with
+		gpu.end_single_time_commands(cmdBuff);
+		return;
+	}
+	// inside draw_frame, ahead of this frame's submit on the same queue: the frame's timeline value is only reached
+	// once the upload is done (the out of date path idles the device before signalling it from the host)
+	gpu.submit_single_time_commands(cmdBuff);
+	retired.retire(frameCount, [cmd = std::move(cmdBuff), buff = std::move(staging)]() mutable {
+		cmd.clear();
+		buff = VmaBuffer{};
+	});
+}
+
+void Velo::allocate_texture(std::uint32_t mip) {
+	ProfileZone zone("allocate_texture");
+	auto& tex = textureStream;
+	const std::uint32_t count = tex.mip_count();
+	const bool hasOld = textureImage.image() && tex.uploadedMip < count;
+	// uploaded levels the new image still covers are copied over, everything finer than them stays empty
+	const std::uint32_t keepFrom = hasOld ? std::max(mip, tex.uploadedMip) : count;
+	const std::uint32_t oldBase = tex.allocatedMip;
+
+	vk::Extent2D ext = tex.mip_extent(mip);
+	VmaImage newImage(gpu.allocator, ext.width, ext.height, count - mip, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Srgb, 0, VMA_MEMORY_USAGE_AUTO);
+
+	std::pmr::vector<vk::ImageCopy> copies(frameArena.get());
+	for (std::uint32_t level = keepFrom; level < count; level++) {
+		vk::Extent2D levelExt = tex.mip_extent(level);
+		copies.push_back({
+			.srcSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level - oldBase, .baseArrayLayer = 0, .layerCount = 1},
+			.srcOffset = {0, 0, 0}, // NOLINT
+			.dstSubresource = {.aspectMask = vk::ImageAspectFlagBits::eColor, .mipLevel = level - mip, .baseArrayLayer = 0, .layerCount = 1},
+			.dstOffset = {0, 0, 0}, // NOLINT
+			.extent = {levelExt.width, levelExt.height, 1} // NOLINT
+		});
+	}
+	auto cmdBuff = gpu.begin_single_time_commands();
+	std::uint32_t uploadQuery = profiler.begin_upload(cmdBuff, "texture realloc");
+	// every level is kept shader readable even before it holds anything, defrag and later uploads rely on one layout
+	std::pmr::vector<vk::ImageMemoryBarrier2> barriers(frameArena.get());
+	barriers.push_back({
+		.srcStageMask = vk::PipelineStageFlagBits2::eTopOfPipe,
+		.srcAccessMask = {},
+		.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.oldLayout = vk::ImageLayout::eUndefined,
+		.newLayout = vk::ImageLayout::eTransferDstOptimal,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = newImage.image(),
+		.subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = 0, .levelCount = count - mip, .baseArrayLayer = 0, .layerCount = 1}
+	});
+	if (!copies.empty()) {
+		barriers.push_back({
+			.srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+			.srcAccessMask = {},
+			.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+			.dstAccessMask = vk::AccessFlagBits2::eTransferRead,
+			.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
+			.newLayout = vk::ImageLayout::eTransferSrcOptimal,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = textureImage.image(),
+			.subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = keepFrom - oldBase, .levelCount = count - keepFrom, .baseArrayLayer = 0, .layerCount = 1}
+		});
+	}
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = static_cast<std::uint32_t>(barriers.size()), .pImageMemoryBarriers = barriers.data()});
+	if (!copies.empty()) {
+		cmdBuff.copyImage(textureImage.image(), vk::ImageLayout::eTransferSrcOptimal, newImage.image(), vk::ImageLayout::eTransferDstOptimal, {static_cast<std::uint32_t>(copies.size()), copies.data()});
+	}
+	// both images end up shader readable, the old one may still be sampled by frames in flight
+	for (auto& barrier : barriers) {
+		barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+		barrier.srcAccessMask = barrier.dstAccessMask & vk::AccessFlagBits2::eTransferWrite;
+		barrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+		barrier.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+		barrier.oldLayout = barrier.newLayout;
+		barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	}
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = static_cast<std::uint32_t>(barriers.size()), .pImageMemoryBarriers = barriers.data()});
+	profiler.end_upload(cmdBuff, uploadQuery);
+	submit_upload(std::move(cmdBuff), VmaBuffer{});
+
+	if (textureImage.image()) {
+		defrag.forget(textureImage);
+		retired.retire(frameCount, [img = std::move(textureImage), view = std::move(textureImageView)]() mutable {
+			view.clear();
+			img = VmaImage{};
+		});
+	}
+	textureImage = std::move(newImage);
+	tex.allocatedMip = mip;
+	tex.uploadedMip = keepFrom;
+	tex.residentMip = std::max(tex.residentMip, keepFrom);
+	if (tex.residentMip < count) {
+		create_texture_image_view();
+	}
+	defrag.track(textureImage.allocation(), {
+		.image = &textureImage,
+		.onMoved = [this]() {
+			// frames already submitted still sample through the old view
+			retired.retire(frameCount - 1, [view = std::move(textureImageView)]() mutable { view.clear(); });
+			create_texture_image_view();
+		}
+	});
+}
 
-	VmaBuffer stagingBuffer = VmaBuffer(gpu.allocator, imgSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+void Velo::upload_texture_levels(std::uint32_t first, std::uint32_t last) {
+	ProfileZone zone("upload_texture_levels");
+	auto& tex = textureStream;
+	vk::DeviceSize uploadBytes = 0;
+	for (std::uint32_t level = first; level < last; level++) {
+		uploadBytes += tex.mips[level].size();
+	}
+	VmaBuffer stagingBuffer(gpu.allocator, uploadBytes, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	std::pmr::vector<vk::BufferImageCopy2> uploads(frameArena.get());
 	void* data = nullptr;
 	vmaMapMemory(gpu.allocator, stagingBuffer.allocation(), &data);
-	std::memcpy(data, pixels, imgSize);
+	vk::DeviceSize offset = 0;
+	for (std::uint32_t level = first; level < last; level++) {
+		std::memcpy(static_cast<char*>(data) + offset, tex.mips[level].data(), tex.mips[level].size());
+		vk::Extent2D levelExt = tex.mip_extent(level);
+		uploads.push_back({
+			.bufferOffset = offset,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource = {
+				.aspectMask = vk::ImageAspectFlagBits::eColor,
+				.mipLevel = level - tex.allocatedMip,
+				.baseArrayLayer = 0,
+				.layerCount = 1
+			},
+			.imageOffset = {0, 0, 0}, // NOLINT
+			.imageExtent = {levelExt.width, levelExt.height, 1} // NOLINT
+		});
+		offset += tex.mips[level].size();
+	}
 	vmaUnmapMemory(gpu.allocator, stagingBuffer.allocation());
 
-	stbi_image_free(pixels);
-	textureImage = VmaImage(gpu.allocator, static_cast<std::uint32_t>(texWidth), static_cast<std::uint32_t>(texHeight), mipLvls, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Srgb,  VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, VMA_MEMORY_USAGE_AUTO);
-	std::cout << "Successfully created image\n";
+	auto cmdBuff = gpu.begin_single_time_commands();
+	std::uint32_t uploadQuery = profiler.begin_upload(cmdBuff, "texture stream");
+	// only the new levels change layout, the ones already sampled are left alone. allocate_texture() moved them to
+	// eShaderReadOnlyOptimal in an earlier submit that nothing waits on, chaining off its fragment shader scope
+	// orders the two transitions, the contents are discarded either way
+	vk::ImageMemoryBarrier2 barrier {
+		.srcStageMask = vk::PipelineStageFlagBits2::eFragmentShader,
+		.srcAccessMask = {},
+		.dstStageMask = vk::PipelineStageFlagBits2::eTransfer,
+		.dstAccessMask = vk::AccessFlagBits2::eTransferWrite,
+		.oldLayout = vk::ImageLayout::eUndefined,
+		.newLayout = vk::ImageLayout::eTransferDstOptimal,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = textureImage.image(),
+		.subresourceRange = {.aspectMask = vk::ImageAspectFlagBits::eColor, .baseMipLevel = first - tex.allocatedMip, .levelCount = last - first, .baseArrayLayer = 0, .layerCount = 1}
+	};
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
+	cmdBuff.copyBufferToImage2({
+		.srcBuffer = stagingBuffer.buffer(),
+		.dstImage = textureImage.image(),
+		.dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+		.regionCount = static_cast<std::uint32_t>(uploads.size()),
+		.pRegions = uploads.data()
+	});
+	barrier.srcStageMask = vk::PipelineStageFlagBits2::eTransfer;
+	barrier.srcAccessMask = vk::AccessFlagBits2::eTransferWrite;
+	barrier.dstStageMask = vk::PipelineStageFlagBits2::eFragmentShader;
+	barrier.dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead;
+	barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+	barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+	cmdBuff.pipelineBarrier2({.imageMemoryBarrierCount = 1, .pImageMemoryBarriers = &barrier});
+	profiler.end_upload(cmdBuff, uploadQuery);
+	submit_upload(std::move(cmdBuff), std::move(stagingBuffer));
+
+	// finer than the tail only lives on the CPU until it's on the GPU
+	for (std::uint32_t level = first; level < std::min(last, tex.tailMip); level++) {
+		tex.mips[level] = {};
+	}
+	tex.uploadedMip = std::min(tex.uploadedMip, first);
+	tex.residentMip = first;
+	create_texture_image_view();
+}
+
+std::uint32_t Velo::texture_demand_mip() const {
+	// no sampler feedback pass yet, estimate from how many pixels the model covers on screen
+	float distance = std::max(glm::length(cameraEye - position) - sceneRadius, 0.1f);
+	float screenSize = sceneRadius / (distance * std::tan(glm::radians(CAMERA_FOV) * 0.5f)) * static_cast<float>(swapchain.extent.height);
+	float texels = static_cast<float>(std::max(textureStream.extent.width, textureStream.extent.height));
+	float lod = std::floor(std::log2(texels / std::max(screenSize, 1.0f)));
+	return std::min(static_cast<std::uint32_t>(std::max(lod, 0.0f)), textureStream.mip_count() - 1);
+}
+
+void Velo::update_texture_streaming() {
+	ProfileZone zone("update_texture_streaming");
+	auto& tex = textureStream;
+	if (!textureImage.image()) return;
+	tex.poll();
 
-	transition_image_texture_layout(textureImage, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, mipLvls);
-	copy_buffer_to_image(stagingBuffer, textureImage, static_cast<std::uint32_t>(texWidth), static_cast<std::uint32_t>(texHeight));
-	transition_image_texture_layout(textureImage, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, mipLvls);
+	if (tex.budgetMip > 0 && residency.has_headroom() && frameCount - tex.lastBudgetChange >= TEXTURE_BUDGET_RELAX_FRAMES) {
+		tex.budgetMip--;
+		tex.lastBudgetChange = frameCount;
+	}
+	tex.wantedMip = texture_demand_mip();
+	std::uint32_t target = std::max(tex.wantedMip, tex.budgetMip);
+	// decoded levels the screen no longer wants, or that a decode brought back after they were uploaded, aren't worth keeping around
+	for (std::uint32_t level = 0; level < tex.tailMip; level++) {
+		if (level < target || level >= tex.uploadedMip) tex.mips[level] = {};
+	}
+	if (target < tex.allocatedMip) {
+		// one reallocation for the whole way down, the levels then fill in one per frame
+		allocate_texture(target);
+		residency.update_bytes(textureAsset, allocation_size(gpu.allocator, textureImage.allocation()));
+	}
+	// one level per frame so a big jump never stalls a single frame, and a level of slack before dropping
+	if (target < tex.residentMip) {
+		std::uint32_t next = tex.residentMip - 1;
+		if (next >= tex.uploadedMip) {
+			// still in the image from earlier, only the view moves
+			tex.residentMip = next;
+			create_texture_image_view();
+		} else if (tex.on_cpu(next)) {
+			upload_texture_levels(next, next + 1);
+		} else {
+			tex.request(target);
+		}
+	} else if (target > tex.residentMip + 1) {
+		// the memory stays until the budget asks for it, coming back is then just a new view
+		tex.residentMip++;
+		create_texture_image_view();
+	}
 }
 
 void Velo::transition_image_texture_layout(VmaImage& img, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, std::uint32_t mips) {
@@ -94,23 +408,18 @@ void Velo::transition_image_texture_layout(VmaImage& img, vk::ImageLayout oldLay
 }
 
 void Velo::create_texture_image_view() {
-	textureImageView = create_image_view(gpu.device, textureImage.image(), vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, mipLvls);
-	vk::DescriptorImageInfo imageInfo {
-		.sampler = *textureSampler,
-		.imageView = textureImageView,
-		.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
-	};
-	// could just do like for ubos
-	// make views and arrayElem = i
-	vk::WriteDescriptorSet writes {
-		.dstSet = *descriptors.set,
-		.dstBinding = 1,
-		.dstArrayElement = 0,
-		.descriptorCount = 1,
-		.descriptorType = vk::DescriptorType::eCombinedImageSampler,
-		.pImageInfo = &imageInfo
-	};
-	gpu.device.updateDescriptorSets(writes, nullptr);
+	const auto& tex = textureStream;
+	if (*textureImageView) {
+		// only the base level moved, frames in flight still sample through the old view
+		retired.retire(frameCount, [view = std::move(textureImageView)]() mutable { view.clear(); });
+	}
+	textureImageView = create_image_view(gpu.device, textureImage.image(), vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor,
+		tex.mip_count() - tex.residentMip, tex.residentMip - tex.allocatedMip);
+	// frames in flight may still read the old slot, so a new view always gets a fresh one
+	if (textureSlot.valid()) {
+		bindless.release_texture(textureSlot, frameCount);
+	}
+	textureSlot = bindless.add_texture(*textureImageView);
 }
 
 void Velo::copy_buffer_to_image(const VmaBuffer& buff, VmaImage& img, std::uint32_t width, std::uint32_t height) {
@@ -87,3 +87,117 @@ void VeloContext::enable_x11() {
 void VeloContext::enable_codam() {
 	enabled_codam = true;
 }
+void VeloContext::enable_descriptor_buffer() {
+	use_descriptor_buffer = true;
+}
+void VeloContext::enable_cmd_reuse() {
+	reuse_cmd_buffers = true;
+}
+
+void VeloContext::enable_alloc_tracking() {
+	track_allocs = true;
+}
+
+void VeloContext::enable_trace() {
+	write_trace = true;
+	trace_enable();
+}
+
+void VeloContext::enable_hot_reload() {
+	hot_reload = true;
+}
+
+void VeloContext::enable_dynamic_resolution() {
+	dynamic_resolution = true;
+}
+
+void VeloContext::enable_depth_prepass() {
+	depth_prepass = true;
+}
+
+/// the whole value as a number, anything else is a configuration error
+template <typename T>
+static T parse_env(const char* name, std::string_view value) {
+	T result{};
+	auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), result);
+	if (ec != std::errc{} || end != value.data() + value.size()) {
+		throw std::runtime_error(std::format("{} must be a number, got \"{}\"", name, value));
+	}
+	return result;
+}
+
+void VeloContext::read_env() {
+	if (const char* path = std::getenv("VELO_RECORD_INPUT")) {
+		record_input = path;
+		std::println("\tRecording input to {}", record_input);
+	}
+	if (const char* path = std::getenv("VELO_REPLAY_INPUT")) {
+		replay_input = path;
+		std::println("\tReplaying input from {}", replay_input);
+	}
+	if (const char* fixedDt = std::getenv("VELO_REPLAY_DT")) {
+		replay_dt = parse_env<float>("VELO_REPLAY_DT", fixedDt);
+		if (!(replay_dt >= 0.0f)) {
+			throw std::runtime_error(std::format("VELO_REPLAY_DT must not be negative, got {}", fixedDt));
+		}
+	}
+	if (const char* frames = std::getenv("VELO_FRAMES")) {
+		frame_limit = parse_env<std::uint64_t>("VELO_FRAMES", frames);
+		std::println("\tQuitting after {} frames", frame_limit);
+	}
+	if (std::getenv("VELO_PREPASS_AB")) {
+		prepass_ab = true;
+		std::println("\tFlipping the depth pre-pass every {} frames", DEPTH_PREPASS_BENCH_FRAMES);
+	}
+	if (std::getenv("VELO_ALLOC_CHECK")) {
+		if (!track_allocs) {
+			throw std::runtime_error("VELO_ALLOC_CHECK needs a build with -DALLOC_TRACKING=ON");
+		}
+		alloc_check = true;
+	}
+	if (const char* archive = std::getenv("VELO_ARCHIVE")) {
+		archive_path = archive;
+	}
+	if (const char* budget = std::getenv("VELO_STREAM_IMPORT")) {
+		stream_import = true;
+		auto mib = parse_env<std::uint64_t>("VELO_STREAM_IMPORT", budget);
+		// shifted into bytes below, anything past this wraps
+		if (mib > std::numeric_limits<std::uint64_t>::max() >> 20) {
+			throw std::runtime_error(std::format("VELO_STREAM_IMPORT must be at most {} MiB, got {}", std::numeric_limits<std::uint64_t>::max() >> 20, mib));
+		}
+		import_budget = std::max<std::uint64_t>(16, mib) << 20;
+		std::println("\tStreaming import, {} MiB budget", import_budget >> 20);
+	}
+	if (const char* model = std::getenv("VELO_MODEL")) {
+		model_path = model;
+		std::println("\tModel: {}", model_path);
+	}
+	if (const char* spec = std::getenv("VELO_STRESS")) {
+		stress_scene = spec;
+		std::println("\tStress scene: {}", stress_scene);
+	}
+	if (const char* ms = std::getenv("VELO_TARGET_MS")) {
+		target_frame_ms = std::max(1.0f, std::stof(ms));
+	}
+	if (const char* mode = std::getenv("VELO_UPSAMPLE")) {
+		std::string_view name = mode;
+		if (name != "temporal" && name != "spatial") {
+			throw std::runtime_error(std::format("VELO_UPSAMPLE must be temporal or spatial, got {}", name));
+		}
+		upsample_mode = name == "spatial" ? UpsampleMode::eSpatial : UpsampleMode::eTemporal;
+	}
+	if (const char* dir = std::getenv("VELO_CAPTURE")) {
+		capture_dir = dir;
+		if (const char* fmt = std::getenv("VELO_CAPTURE_FORMAT")) {
+			std::string_view name = fmt;
+			if (name != "png" && name != "raw") {
+				throw std::runtime_error(std::format("VELO_CAPTURE_FORMAT must be png or raw, got {}", name));
+			}
+			capture_format = name == "raw" ? CaptureFormat::eRaw : CaptureFormat::ePng;
+		}
+		if (const char* count = std::getenv("VELO_CAPTURE_FRAMES")) {
+			capture_frames = parse_env<std::uint64_t>("VELO_CAPTURE_FRAMES", count);
+		}
+		std::println("\tCapturing frames to {} ({})", capture_dir, capture_format == CaptureFormat::eRaw ? "raw" : "png");
+	}
+}
@@ -0,0 +1,56 @@
+module velo;
+import std;
+
+static constexpr std::array<char, 8> INPUT_LOG_MAGIC = {'V', 'E', 'L', 'O', 'I', 'N', 'P', '1'};
+static constexpr std::size_t INPUT_RECORD_SIZE = sizeof(float) + sizeof(std::uint16_t);
+
+void InputLog::start_recording(const std::filesystem::path& path) {
+	out.open(path, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error(std::format("Failed to open {} for input recording", path.string()));
+	}
+	out.write(INPUT_LOG_MAGIC.data(), INPUT_LOG_MAGIC.size());
+	std::println("Recording input to {}", path.string());
+}
+
+void InputLog::start_replay(const std::filesystem::path& path) {
+	std::vector<char> bytes = read_file(path.string());
+	if (bytes.size() < INPUT_LOG_MAGIC.size() || !std::equal(INPUT_LOG_MAGIC.begin(), INPUT_LOG_MAGIC.end(), bytes.begin())) {
+		throw std::runtime_error(std::format("{} is not an input log", path.string()));
+	}
+	std::size_t count = (bytes.size() - INPUT_LOG_MAGIC.size()) / INPUT_RECORD_SIZE;
+	frames.resize(count);
+	const char* src = bytes.data() + INPUT_LOG_MAGIC.size();
+	// field by field, the struct has padding the file doesn't
+	for (auto& frame : frames) {
+		std::memcpy(&frame.dt, src, sizeof(float));
+		std::memcpy(&frame.keys, src + sizeof(float), sizeof(std::uint16_t));
+		src += INPUT_RECORD_SIZE;
+	}
+	cursor = 0;
+	replay = true;
+	std::println("Replaying {} frames of input from {}", count, path.string());
+}
+
+void InputLog::record(const InputFrame& frame) {
+	std::array<char, INPUT_RECORD_SIZE> bytes{};
+	std::memcpy(bytes.data(), &frame.dt, sizeof(float));
+	std::memcpy(bytes.data() + sizeof(float), &frame.keys, sizeof(std::uint16_t));
+	out.write(bytes.data(), bytes.size());
+	recorded++;
+}
+
+std::optional<InputFrame> InputLog::next() {
+	if (cursor >= frames.size()) return std::nullopt;
+	return frames[cursor++];
+}
+
+void InputLog::finish() {
+	if (out.is_open()) {
+		out.close();
+		std::println("Recorded {} frames of input", recorded);
+	}
+	if (replay) {
+		std::println("Replayed {}/{} frames of input", cursor, frames.size());
+	}
+}
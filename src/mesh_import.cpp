@@ -0,0 +1,74 @@
+module;
+#include <tiny_obj_loader.h>
+
+module velo;
+import std;
+
+void weld_obj_vertices(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) {
+	std::unordered_map<Vertex, std::uint32_t> uniqueVertices;
+	for (const auto& shape: shapes) {
+		for (const auto& idx: shape.mesh.indices) {
+			Vertex vertex{};
+			vertex.pos = {
+				attrib.vertices[3 * static_cast<std::size_t>(idx.vertex_index) + 0],
+				attrib.vertices[3 * static_cast<std::size_t>(idx.vertex_index) + 1],
+				attrib.vertices[3 * static_cast<std::size_t>(idx.vertex_index) + 2]
+			};
+			if (idx.texcoord_index >= 0) {
+				vertex.texCoord = {
+					attrib.texcoords[2 * static_cast<std::size_t>(idx.texcoord_index) + 0],
+					1.0f - attrib.texcoords[2 * static_cast<std::size_t>(idx.texcoord_index) + 1]
+				};
+			} else {
+				vertex.texCoord = {0.0f, 0.0f};
+			}
+			vertex.color = {1.0f, 1.0f, 1.0f};
+
+			if (!uniqueVertices.contains(vertex)) {
+				uniqueVertices[vertex] = static_cast<std::uint32_t>(vertices.size());
+				vertices.push_back(vertex);
+			}
+			// if already seen index to it with vertex
+			indices.push_back(uniqueVertices[vertex]);
+		}
+	}
+}
+
+std::vector<Submesh> group_faces_by_material(std::vector<std::uint32_t>& indices, std::span<const std::uint32_t> faceMaterials, std::uint32_t mesh) {
+	if (indices.size() != faceMaterials.size() * 3) {
+		throw std::runtime_error(std::format("Expected triangulated faces, got {} indices for {} faces", indices.size(), faceMaterials.size()));
+	}
+	std::uint32_t materialCount = 0;
+	for (auto material : faceMaterials) {
+		materialCount = std::max(materialCount, material + 1);
+	}
+
+	// counting sort keeps faces of one material in their original order, the post transform cache likes that
+	std::vector<std::uint32_t> starts(materialCount + 1, 0);
+	for (auto material : faceMaterials) {
+		starts[material + 1]++;
+	}
+	for (std::uint32_t i = 0; i < materialCount; i++) {
+		starts[i + 1] += starts[i];
+	}
+	std::vector<std::uint32_t> sorted(indices.size());
+	std::vector<std::uint32_t> cursor(starts.begin(), starts.end() - 1);
+	for (std::size_t face = 0; face < faceMaterials.size(); face++) {
+		std::uint32_t dst = cursor[faceMaterials[face]]++ * 3;
+		std::copy_n(indices.begin() + static_cast<std::ptrdiff_t>(face * 3), 3, sorted.begin() + dst);
+	}
+	indices = std::move(sorted);
+
+	std::vector<Submesh> submeshes;
+	for (std::uint32_t material = 0; material < materialCount; material++) {
+		std::uint32_t faces = starts[material + 1] - starts[material];
+		if (faces == 0) continue;
+		submeshes.push_back({
+			.mesh = mesh,
+			.firstIndex = starts[material] * 3,
+			.indexCount = faces * 3,
+			.material = material
+		});
+	}
+	return submeshes;
+}
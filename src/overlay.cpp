@@ -0,0 +1,203 @@
+module;
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+#include <imgui_impl_glfw.h>
+#include <imgui_impl_vulkan.h>
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static void check_imgui_result(VkResult err) {
+	if (err != VK_SUCCESS) {
+		handle_error("ImGui Vulkan backend failed", static_cast<vk::Result>(err));
+	}
+}
+
+static double to_mib(vk::DeviceSize bytes) {
+	return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+void Overlay::create(GLFWwindow* window, GpuContext& gpu, const SwapchainContext& swapchain) {
+	IMGUI_CHECKVERSION();
+	ImGui::CreateContext();
+	ImGui::GetIO().IniFilename = nullptr;
+	ImGui::StyleColorsDark();
+	// callbacks only go in while shown, hidden nothing drains ImGui's input queue
+	ImGui_ImplGlfw_InitForVulkan(window, false);
+	glfwWindow = window;
+
+	colorFormat = swapchain.format;
+	vk::PipelineRenderingCreateInfo renderingInfo {
+		.colorAttachmentCount = 1,
+		.pColorAttachmentFormats = &colorFormat
+	};
+	ImGui_ImplVulkan_InitInfo initInfo {};
+	initInfo.ApiVersion = VK_API_VERSION_1_4;
+	initInfo.Instance = static_cast<VkInstance>(*gpu.instance);
+	initInfo.PhysicalDevice = static_cast<VkPhysicalDevice>(*gpu.physicalDevice);
+	initInfo.Device = static_cast<VkDevice>(*gpu.device);
+	initInfo.QueueFamily = gpu.graphicsIdx;
+	initInfo.Queue = static_cast<VkQueue>(*gpu.graphicsQueue);
+	// the backend owns its pool, none of its sets go near the bindless set
+	initInfo.DescriptorPoolSize = IMGUI_IMPL_VULKAN_MINIMUM_IMAGE_SAMPLER_POOL_SIZE;
+	initInfo.MinImageCount = 2;
+	initInfo.ImageCount = static_cast<std::uint32_t>(swapchain.images.size());
+	initInfo.UseDynamicRendering = true;
+	initInfo.PipelineInfoMain.PipelineRenderingCreateInfo = renderingInfo;
+	initInfo.CheckVkResultFn = check_imgui_result;
+	if (!ImGui_ImplVulkan_Init(&initInfo)) {
+		throw std::runtime_error("Failed to initialize the ImGui Vulkan backend");
+	}
+	initialized = true;
+	std::println("Successfully created overlay (F1 to toggle)");
+}
+
+void Overlay::toggle() {
+	shown = !shown;
+	if (!initialized) return;
+	// chains to the callbacks already installed on the window
+	if (shown) {
+		ImGui_ImplGlfw_InstallCallbacks(glfwWindow);
+	} else {
+		ImGui_ImplGlfw_RestoreCallbacks(glfwWindow);
+	}
+}
+
+void Overlay::record_frame_time(float ms) {
+	frameTimes[historyHead] = ms;
+	historyHead = (historyHead + 1) % OVERLAY_HISTORY;
+	historyCount = std::min(historyCount + 1, OVERLAY_HISTORY);
+}
+
+void Overlay::build(const OverlayStats& stats, OverlayControls& controls) {
+	if (!shown || !initialized) return;
+	auto start = std::chrono::steady_clock::now();
+	ImGui_ImplVulkan_NewFrame();
+	ImGui_ImplGlfw_NewFrame();
+	ImGui::NewFrame();
+	ImGui::SetNextWindowPos({10.0f, 10.0f}, ImGuiCond_FirstUseEver);
+	ImGui::Begin("Velo", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
+
+	if (historyCount > 0) {
+		std::array<float, OVERLAY_HISTORY> sorted{};
+		std::copy_n(frameTimes.begin(), historyCount, sorted.begin());
+		std::sort(sorted.begin(), sorted.begin() + historyCount);
+		auto percentile = [&](float p) {
+			return sorted[static_cast<std::size_t>(p * static_cast<float>(historyCount - 1))];
+		};
+		float worst = sorted[historyCount - 1];
+		ImGui::Text("frame  p50 %.2f ms  p95 %.2f ms  p99 %.2f ms  max %.2f ms", percentile(0.50f), percentile(0.95f), percentile(0.99f), worst);
+		// oldest sample first once the ring has wrapped
+		int offset = historyCount == OVERLAY_HISTORY ? static_cast<int>(historyHead) : 0;
+		ImGui::PlotLines("##frametimes", frameTimes.data(), static_cast<int>(historyCount), offset, nullptr, 0.0f, std::max(worst, 16.7f), {360.0f, 60.0f});
+	}
+
+	if (ImGui::CollapsingHeader("GPU passes", ImGuiTreeNodeFlags_DefaultOpen)) {
+		double gpuTotal = 0.0;
+		double overlayGpu = 0.0;
+		for (const auto& scope : stats.gpuScopes) {
+			if (std::string_view(scope.name) == "overlay") {
+				overlayGpu = scope.gpuMs;
+				continue;
+			}
+			gpuTotal += scope.gpuMs;
+			ImGui::Text("%-12s %7.3f ms  %10llu fragments", scope.name, scope.gpuMs, static_cast<unsigned long long>(scope.fragmentInvocations));
+		}
+		ImGui::Text("%-12s %7.3f ms", "total", gpuTotal);
+		ImGui::TextDisabled("overlay: %.3f ms cpu, %.3f ms gpu", static_cast<double>(cpuMs), overlayGpu);
+	}
+
+	if (ImGui::CollapsingHeader("Memory", ImGuiTreeNodeFlags_DefaultOpen)) {
+		for (std::size_t heap = 0; heap < stats.heaps.size(); heap++) {
+			const VmaBudget& budget = stats.heaps[heap];
+			if (budget.budget == 0) continue;
+			float fraction = static_cast<float>(static_cast<double>(budget.usage) / static_cast<double>(budget.budget));
+			auto label = std::format("heap {}: {:.0f} / {:.0f} MiB", heap, to_mib(budget.usage), to_mib(budget.budget));
+			ImGui::ProgressBar(fraction, {360.0f, 0.0f}, label.c_str());
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Scene", ImGuiTreeNodeFlags_DefaultOpen)) {
+		ImGui::Text("draws %u  triangles %llu  culled passes %u", stats.draws, static_cast<unsigned long long>(stats.triangles), stats.culledPasses);
+		ImGui::Text("uploads pending %u mips  retiring %zu", stats.pendingMips, stats.retiring);
+	}
+
+	if (ImGui::CollapsingHeader("Controls", ImGuiTreeNodeFlags_DefaultOpen)) {
+		int inFlight = static_cast<int>(controls.framesInFlight);
+		if (ImGui::SliderInt("frames in flight", &inFlight, 1, MAX_FRAMES_IN_FLIGHT)) {
+			controls.framesInFlight = static_cast<std::uint32_t>(inFlight);
+		}
+		auto current = vk::to_string(controls.presentMode);
+		if (ImGui::BeginCombo("present mode", current.c_str())) {
+			for (auto mode : stats.presentModes) {
+				auto name = vk::to_string(mode);
+				if (ImGui::Selectable(name.c_str(), mode == controls.presentMode)) {
+					controls.presentMode = mode;
+				}
+			}
+			ImGui::EndCombo();
+		}
+		ImGui::Checkbox("backface culling", &controls.backfaceCull);
+		ImGui::Checkbox("depth pre-pass", &controls.depthPrepass);
+	}
+
+	ImGui::End();
+	ImGui::Render();
+	cpuMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void Overlay::draw(vk::raii::CommandBuffer& cmd, vk::ImageView target, vk::Extent2D extent) const {
+	vk::RenderingAttachmentInfo attachmentInfo {
+		.imageView = target,
+		.imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+		.loadOp = vk::AttachmentLoadOp::eLoad,
+		.storeOp = vk::AttachmentStoreOp::eStore
+	};
+	vk::RenderingInfo renderingInfo {
+		.renderArea = {.offset = {0, 0}, .extent = extent}, // NOLINT
+		.layerCount = 1,
+		.colorAttachmentCount = 1,
+		.pColorAttachments = &attachmentInfo
+	};
+	cmd.beginRendering(renderingInfo);
+	ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), static_cast<VkCommandBuffer>(*cmd));
+	cmd.endRendering();
+}
+
+void Overlay::destroy() {
+	if (!initialized) return;
+	ImGui_ImplVulkan_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+	initialized = false;
+}
+
+void Velo::update_overlay() {
+	overlay.record_frame_time(wallDt * 1000.0f);
+	if (!overlay.visible()) return;
+	// counts are from the draw list the previous frame recorded
+	std::uint64_t triangles = 0;
+	for (const auto& item : drawList) {
+		const auto& sub = submeshes[item.submesh];
+		triangles += static_cast<std::uint64_t>(sub.indexCount / 3) * sub.instanceCount;
+	}
+	OverlayStats stats {
+		.gpuScopes = profiler.results(),
+		.heaps = residency.heap_budgets(),
+		.presentModes = swapchain.presentModes,
+		.draws = static_cast<std::uint32_t>(drawList.size()),
+		.triangles = triangles,
+		.culledPasses = graph.culled_count(),
+		.pendingMips = textureStream.residentMip > textureStream.wantedMip ? textureStream.residentMip - textureStream.wantedMip : 0,
+		.retiring = retired.pending.size()
+	};
+	overlay.build(stats, tuning);
+
+	if (tuning.presentMode != swapchain.preferredPresentMode) {
+		swapchain.preferredPresentMode = tuning.presentMode;
+		// picked up by the resize path at the top of the next frame
+		frameBuffResized = true;
+	}
+}
@@ -0,0 +1,227 @@
+module;
+#include <vulkan/vulkan.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static constexpr vk::QueryPipelineStatisticFlags PROFILER_STATS =
+	vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations
+	| vk::QueryPipelineStatisticFlagBits::eClippingPrimitives
+	| vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations;
+/// results come back in flag bit order, each followed by the availability word
+static constexpr std::uint32_t STATS_WORDS = 4;
+
+static vk::raii::QueryPool create_query_pool(GpuContext& gpu, vk::QueryType type, std::uint32_t count, vk::QueryPipelineStatisticFlags stats = {}) {
+	auto poolExpected = gpu.device.createQueryPool({
+		.queryType = type,
+		.queryCount = count,
+		.pipelineStatistics = stats
+	});
+	if (!poolExpected.has_value()) {
+		handle_error("Failed to create query pool", poolExpected.result);
+	}
+	return std::move(*poolExpected);
+}
+
+void GpuProfiler::create(GpuContext& gpu) {
+	timestampPeriod = gpu.timestampPeriod;
+	pipelineStats = gpu.pipelineStatsSupported;
+	labels = enableValidationLayers;
+	if (timestampPeriod == 0.0f) {
+		std::println("GPU profiler: graphics queue has no timestamps, profiling disabled");
+		return;
+	}
+	for (auto& frame : frames) {
+		frame.timestamps = create_query_pool(gpu, vk::QueryType::eTimestamp, GPU_PROFILER_MAX_SCOPES * 2);
+		if (pipelineStats) {
+			frame.stats = create_query_pool(gpu, vk::QueryType::ePipelineStatistics, GPU_PROFILER_MAX_SCOPES, PROFILER_STATS);
+		}
+	}
+	uploadTimestamps = create_query_pool(gpu, vk::QueryType::eTimestamp, GPU_PROFILER_MAX_SCOPES * 2);
+	calibrate(gpu);
+	std::println("Successfully created GPU profiler ({} ns per tick, pipeline statistics {})", timestampPeriod, pipelineStats ? "on" : "off");
+}
+
+void GpuProfiler::calibrate(GpuContext& gpu) {
+	// one timestamp against the CPU clock on both sides of the submit, good to within the submit latency
+	auto cmd = gpu.begin_single_time_commands();
+	cmd.resetQueryPool(*uploadTimestamps, 0, 1);
+	cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *uploadTimestamps, 0);
+	std::uint64_t before = trace_now_ns();
+	gpu.end_single_time_commands(cmd);
+	std::uint64_t after = trace_now_ns();
+	std::uint64_t ticks = 0;
+	auto res = static_cast<vk::Result>(gpu.device.getDispatcher()->vkGetQueryPoolResults(
+		static_cast<VkDevice>(*gpu.device), static_cast<VkQueryPool>(*uploadTimestamps), 0, 1, sizeof(ticks), &ticks, sizeof(ticks),
+		static_cast<VkQueryResultFlags>(vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait)));
+	if (res != vk::Result::eSuccess) {
+		handle_error("Failed to read calibration timestamp", res);
+	}
+	calibTicks = ticks;
+	calibCpuNs = before + (after - before) / 2;
+}
+
+void GpuProfiler::trace_scope(const char* name, std::uint64_t beginTicks, std::uint64_t endTicks) const {
+	if (!trace_enabled()) return;
+	auto to_cpu = [this](std::uint64_t ticks) {
+		double deltaNs = (static_cast<double>(ticks) - static_cast<double>(calibTicks)) * static_cast<double>(timestampPeriod);
+		return static_cast<std::uint64_t>(static_cast<double>(calibCpuNs) + deltaNs);
+	};
+	trace_record(name, to_cpu(beginTicks), to_cpu(endTicks), TRACE_GPU_TRACK);
+}
+
+void GpuProfiler::begin_frame(vk::raii::CommandBuffer& cmd, std::uint32_t frameSlot) {
+	currentFrame = frameSlot;
+	auto& frame = frames[frameSlot];
+	frame.scopeCount = 0;
+	frame.statsCount = 0;
+	openCount = 0;
+	if (timestampPeriod == 0.0f) return;
+	cmd.resetQueryPool(*frame.timestamps, 0, GPU_PROFILER_MAX_SCOPES * 2);
+	if (pipelineStats) {
+		cmd.resetQueryPool(*frame.stats, 0, GPU_PROFILER_MAX_SCOPES);
+	}
+	frame.recorded = true;
+}
+
+void GpuProfiler::begin_scope(vk::raii::CommandBuffer& cmd, const char* name, bool withStats) {
+	if (labels) {
+		cmd.beginDebugUtilsLabelEXT({.pLabelName = name});
+	}
+	auto& frame = frames[currentFrame];
+	// past the limits the scope still gets its label, just no queries
+	std::uint32_t scope = UINT32_MAX;
+	if (timestampPeriod != 0.0f && frame.scopeCount < GPU_PROFILER_MAX_SCOPES) {
+		scope = frame.scopeCount++;
+		frame.names[scope] = name;
+		frame.statsIdx[scope] = UINT32_MAX;
+		cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *frame.timestamps, scope * 2);
+		if (withStats && pipelineStats) {
+			frame.statsIdx[scope] = frame.statsCount++;
+			cmd.beginQuery(*frame.stats, frame.statsIdx[scope], {});
+		}
+	}
+	if (openCount < openScopes.size()) {
+		openScopes[openCount++] = scope;
+	}
+}
+
+void GpuProfiler::end_scope(vk::raii::CommandBuffer& cmd) {
+	std::uint32_t scope = openCount > 0 ? openScopes[--openCount] : UINT32_MAX;
+	if (scope != UINT32_MAX) {
+		auto& frame = frames[currentFrame];
+		if (frame.statsIdx[scope] != UINT32_MAX) {
+			cmd.endQuery(*frame.stats, frame.statsIdx[scope]);
+		}
+		cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *frame.timestamps, scope * 2 + 1);
+	}
+	if (labels) {
+		cmd.endDebugUtilsLabelEXT();
+	}
+}
+
+std::uint32_t GpuProfiler::begin_upload(vk::raii::CommandBuffer& cmd, const char* name) {
+	if (labels) {
+		cmd.beginDebugUtilsLabelEXT({.pLabelName = name});
+	}
+	// like a pass past the scope limit, the upload keeps its label and gets no queries
+	if (timestampPeriod == 0.0f || pendingCount == pendingUploads.size()) return UINT32_MAX;
+	std::uint32_t query = nextUploadQuery;
+	nextUploadQuery = (nextUploadQuery + 2) % (GPU_PROFILER_MAX_SCOPES * 2);
+	pendingUploads[pendingCount++] = {.name = name, .query = query};
+	cmd.resetQueryPool(*uploadTimestamps, query, 2);
+	cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *uploadTimestamps, query);
+	return query;
+}
+
+void GpuProfiler::end_upload(vk::raii::CommandBuffer& cmd, std::uint32_t query) {
+	if (query != UINT32_MAX) {
+		cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, *uploadTimestamps, query + 1);
+	}
+	if (labels) {
+		cmd.endDebugUtilsLabelEXT();
+	}
+}
+
+void GpuProfiler::collect(GpuContext& gpu, std::uint32_t frameSlot) {
+	if (timestampPeriod == 0.0f) return;
+	const auto& dispatcher = *gpu.device.getDispatcher();
+	auto ticks_to_ms = [this](std::uint64_t begin, std::uint64_t end) {
+		return static_cast<double>(end - begin) * static_cast<double>(timestampPeriod) / 1e6;
+	};
+	auto read = [&](vk::QueryPool pool, std::uint32_t first, std::uint32_t count, std::span<std::uint64_t> dst, std::uint32_t words) {
+		// no wait flag, results that aren't there yet just come back unavailable
+		return static_cast<vk::Result>(dispatcher.vkGetQueryPoolResults(
+			static_cast<VkDevice>(*gpu.device), static_cast<VkQueryPool>(pool), first, count,
+			count * words * sizeof(std::uint64_t), dst.data(), words * sizeof(std::uint64_t),
+			static_cast<VkQueryResultFlags>(vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability)));
+	};
+	lastResultCount = 0;
+
+	auto& frame = frames[frameSlot];
+	if (frame.recorded && frame.scopeCount > 0) {
+		read(*frame.timestamps, 0, frame.scopeCount * 2, timestampData, 2);
+		if (frame.statsCount > 0) {
+			read(*frame.stats, 0, frame.statsCount, statsData, STATS_WORDS);
+		}
+		for (std::uint32_t scope = 0; scope < frame.scopeCount; scope++) {
+			const std::uint64_t* begin = &timestampData[scope * 4];
+			if (begin[1] == 0 || begin[3] == 0) continue;
+			GpuScopeResult result {.name = frame.names[scope], .gpuMs = ticks_to_ms(begin[0], begin[2])};
+			trace_scope(frame.names[scope], begin[0], begin[2]);
+			std::uint32_t statsIdx = frame.statsIdx[scope];
+			if (statsIdx != UINT32_MAX && statsData[statsIdx * STATS_WORDS + 3] != 0) {
+				result.vertexInvocations = statsData[statsIdx * STATS_WORDS + 0];
+				result.clippingPrimitives = statsData[statsIdx * STATS_WORDS + 1];
+				result.fragmentInvocations = statsData[statsIdx * STATS_WORDS + 2];
+			}
+			add_result(result);
+		}
+	}
+
+	std::uint32_t kept = 0;
+	for (std::uint32_t i = 0; i < pendingCount; i++) {
+		auto upload = pendingUploads[i];
+		std::array<std::uint64_t, 4> data{};
+		read(*uploadTimestamps, upload.query, 2, data, 2);
+		if (data[1] == 0 || data[3] == 0) {
+			pendingUploads[kept++] = upload;
+			continue;
+		}
+		add_result({.name = upload.name, .gpuMs = ticks_to_ms(data[0], data[2])});
+		trace_scope(upload.name, data[0], data[2]);
+	}
+	pendingCount = kept;
+}
+
+void GpuProfiler::add_result(const GpuScopeResult& result) {
+	if (lastResultCount < lastResults.size()) {
+		lastResults[lastResultCount++] = result;
+	}
+	ScopeTotals* entry = nullptr;
+	for (std::uint32_t i = 0; i < totalsCount; i++) {
+		if (std::string_view(totals[i].name) == result.name) {
+			entry = &totals[i];
+			break;
+		}
+	}
+	if (!entry) {
+		if (totalsCount == totals.size()) return;
+		entry = &totals[totalsCount++];
+		entry->name = result.name;
+	}
+	entry->gpuMs += result.gpuMs;
+	entry->fragmentInvocations += result.fragmentInvocations;
+	entry->samples++;
+}
+
+void GpuProfiler::print() const {
+	if (totalsCount == 0) return;
+	std::println("GPU scopes (averages):");
+	for (std::uint32_t i = 0; i < totalsCount; i++) {
+		const auto& entry = totals[i];
+		auto samples = static_cast<double>(entry.samples);
+		std::println("\t{}: {:.3f} ms over {} samples, {:.0f} fragment invocations", entry.name, entry.gpuMs / samples, entry.samples, static_cast<double>(entry.fragmentInvocations) / samples);
+	}
+}
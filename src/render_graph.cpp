@@ -0,0 +1,539 @@
+module;
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+struct RgAccessInfo {
+	vk::PipelineStageFlags2 stage;
+	vk::AccessFlags2 access;
+	vk::ImageLayout layout;
+};
+
+static vk::PipelineStageFlags2 shader_stages(RgPassType type) {
+	if (type == RgPassType::eCompute) {
+		return vk::PipelineStageFlagBits2::eComputeShader;
+	}
+	return vk::PipelineStageFlagBits2::eVertexShader | vk::PipelineStageFlagBits2::eFragmentShader;
+}
+
+static RgAccessInfo access_info(const RgPassUsage& use, RgPassType type) {
+	switch (use.usage) {
+		case RgUsage::eColorAttachment: {
+			vk::AccessFlags2 access{};
+			if (use.read) access |= vk::AccessFlagBits2::eColorAttachmentRead;
+			if (use.write) access |= vk::AccessFlagBits2::eColorAttachmentWrite;
+			return {vk::PipelineStageFlagBits2::eColorAttachmentOutput, access, vk::ImageLayout::eColorAttachmentOptimal};
+		}
+		case RgUsage::eDepthAttachment: {
+			// depth test always reads
+			vk::AccessFlags2 access = vk::AccessFlagBits2::eDepthStencilAttachmentRead;
+			if (use.write) access |= vk::AccessFlagBits2::eDepthStencilAttachmentWrite;
+			return {
+				vk::PipelineStageFlagBits2::eEarlyFragmentTests | vk::PipelineStageFlagBits2::eLateFragmentTests,
+				access,
+				use.write ? vk::ImageLayout::eDepthAttachmentOptimal : vk::ImageLayout::eDepthReadOnlyOptimal
+			};
+		}
+		case RgUsage::eSampled:
+			return {shader_stages(type), vk::AccessFlagBits2::eShaderSampledRead, vk::ImageLayout::eShaderReadOnlyOptimal};
+		case RgUsage::eStorage: {
+			vk::AccessFlags2 access{};
+			if (use.read) access |= vk::AccessFlagBits2::eShaderStorageRead;
+			if (use.write) access |= vk::AccessFlagBits2::eShaderStorageWrite;
+			return {shader_stages(type), access, vk::ImageLayout::eGeneral};
+		}
+		case RgUsage::eUniform:
+			return {shader_stages(type), vk::AccessFlagBits2::eUniformRead, vk::ImageLayout::eUndefined};
+		case RgUsage::eTransferSrc:
+			return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferRead, vk::ImageLayout::eTransferSrcOptimal};
+		case RgUsage::eTransferDst:
+			return {vk::PipelineStageFlagBits2::eTransfer, vk::AccessFlagBits2::eTransferWrite, vk::ImageLayout::eTransferDstOptimal};
+		case RgUsage::eVertexInput:
+			return {
+				vk::PipelineStageFlagBits2::eVertexAttributeInput | vk::PipelineStageFlagBits2::eIndexInput,
+				vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eIndexRead,
+				vk::ImageLayout::eUndefined
+			};
+		case RgUsage::eIndirect:
+			return {vk::PipelineStageFlagBits2::eDrawIndirect, vk::AccessFlagBits2::eIndirectCommandRead, vk::ImageLayout::eUndefined};
+	}
+	std::unreachable();
+}
+
+constexpr vk::AccessFlags2 WRITE_ACCESS_BITS = vk::AccessFlagBits2::eColorAttachmentWrite | vk::AccessFlagBits2::eDepthStencilAttachmentWrite | vk::AccessFlagBits2::eShaderStorageWrite | vk::AccessFlagBits2::eTransferWrite;
+
+static bool is_attachment_only(vk::ImageUsageFlags usage) {
+	constexpr vk::ImageUsageFlags attachmentBits = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eInputAttachment;
+	return (usage & ~attachmentBits) == vk::ImageUsageFlags{};
+}
+
+static void hash_combine(std::size_t& seed, std::size_t value) {
+	seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+RgPassBuilder& RgPassBuilder::use(RgHandle res, RgUsage usage, bool read, bool write) {
+	if (idx + 1 != rg.passes.size()) {
+		throw std::logic_error("RenderGraph: pass usages must be declared before adding the next pass");
+	}
+	auto& pass = rg.passes[idx];
+	for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount; i++) {
+		auto& existing = rg.usages[i];
+		if (existing.resource == res && existing.usage == usage) {
+			existing.read = existing.read || read;
+			existing.write = existing.write || write;
+			return *this;
+		}
+	}
+	rg.usages.push_back({.resource = res, .usage = usage, .read = read, .write = write});
+	pass.usageCount++;
+	return *this;
+}
+
+RgPassBuilder& RgPassBuilder::read(RgHandle res, RgUsage usage) {
+	return use(res, usage, true, false);
+}
+
+RgPassBuilder& RgPassBuilder::write(RgHandle res, RgUsage usage) {
+	return use(res, usage, false, true);
+}
+
+RgPassBuilder& RgPassBuilder::read_write(RgHandle res, RgUsage usage) {
+	return use(res, usage, true, true);
+}
+
+RgPassBuilder& RgPassBuilder::side_effect() {
+	rg.passes[idx].sideEffect = true;
+	return *this;
+}
+
+void RenderGraph::reset() {
+	resources.clear();
+	passes.clear();
+	usages.clear();
+	imgBarriers.clear();
+	buffBarriers.clear();
+	finalImgBarrier = 0;
+	culledCount = 0;
+}
+
+RgHandle RenderGraph::import_image(const char* name, vk::Image img, vk::ImageView imgView, const RgImageDesc& desc, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 initialStage) {
+	resources.push_back({
+		.name = name,
+		.isImage = true,
+		.imported = true,
+		.output = true,
+		.desc = desc,
+		.image = img,
+		.view = imgView,
+		.finalLayout = finalLayout,
+		.layout = initialLayout,
+		.writeStage = initialStage
+	});
+	return static_cast<RgHandle>(resources.size() - 1);
+}
+
+RgHandle RenderGraph::import_buffer(const char* name, vk::Buffer buff, vk::DeviceSize size) {
+	resources.push_back({
+		.name = name,
+		.isImage = false,
+		.imported = true,
+		.output = true,
+		.buffer = buff,
+		.size = size
+	});
+	return static_cast<RgHandle>(resources.size() - 1);
+}
+
+RgHandle RenderGraph::create_image(const char* name, const RgImageDesc& desc) {
+	resources.push_back({
+		.name = name,
+		.isImage = true,
+		.imported = false,
+		.output = false,
+		.desc = desc
+	});
+	return static_cast<RgHandle>(resources.size() - 1);
+}
+
+RgPassBuilder RenderGraph::add_pass(const char* name, RgPassType type, RgExecuteFn execute) {
+	passes.push_back({
+		.name = name,
+		.type = type,
+		.execute = std::move(execute),
+		.firstUsage = static_cast<std::uint32_t>(usages.size())
+	});
+	return {*this, static_cast<std::uint32_t>(passes.size() - 1)};
+}
+
+void RenderGraph::compile(GpuContext& gpu) {
+	cull();
+	compute_lifetimes();
+	realize_transients(gpu);
+	build_barriers();
+}
+
+void RenderGraph::cull() {
+	for (auto& res : resources) {
+		res.needed = res.output;
+	}
+	// walk backwards, a pass survives if something downstream needs what it writes
+	for (std::size_t p = passes.size(); p-- > 0;) {
+		auto& pass = passes[p];
+		bool keep = pass.sideEffect;
+		for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount && !keep; i++) {
+			keep = usages[i].write && resources[usages[i].resource].needed;
+		}
+		pass.culled = !keep;
+		if (!keep) {
+			culledCount++;
+			continue;
+		}
+		for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount; i++) {
+			if (usages[i].read) {
+				resources[usages[i].resource].needed = true;
+			}
+		}
+	}
+}
+
+void RenderGraph::compute_lifetimes() {
+	for (std::uint32_t p = 0; p < passes.size(); p++) {
+		const auto& pass = passes[p];
+		if (pass.culled) continue;
+		for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount; i++) {
+			auto& res = resources[usages[i].resource];
+			res.firstPass = std::min(res.firstPass, p);
+			res.lastPass = std::max(res.lastPass, p);
+		}
+	}
+}
+
+void RenderGraph::realize_transients(GpuContext& gpu) {
+	std::size_t key = 0;
+	std::uint32_t count = 0;
+	for (const auto& res : resources) {
+		if (res.imported || res.firstPass == UINT32_MAX) continue;
+		hash_combine(key, static_cast<std::size_t>(res.desc.format));
+		hash_combine(key, res.desc.extent.width);
+		hash_combine(key, res.desc.extent.height);
+		hash_combine(key, static_cast<std::size_t>(static_cast<VkImageUsageFlags>(res.desc.usage)));
+		hash_combine(key, res.firstPass);
+		hash_combine(key, res.lastPass);
+		count++;
+	}
+
+	if (key != transientKey || count != transients.size()) {
+		// graph shape or extent changed, rare enough (resize) that idling is fine
+		gpu.device.waitIdle();
+		free_transients(gpu);
+		transientKey = key;
+		transientGeneration++;
+
+		for (const auto& res : resources) {
+			if (res.imported || res.firstPass == UINT32_MAX) continue;
+			bool transientAttachment = is_attachment_only(res.desc.usage);
+			vk::ImageCreateInfo imgInfo {
+				.imageType = vk::ImageType::e2D,
+				.format = res.desc.format,
+				.extent = {res.desc.extent.width, res.desc.extent.height, 1}, // NOLINT
+				.mipLevels = 1,
+				.arrayLayers = 1,
+				.samples = vk::SampleCountFlagBits::e1,
+				.tiling = vk::ImageTiling::eOptimal,
+				.usage = transientAttachment ? res.desc.usage | vk::ImageUsageFlagBits::eTransientAttachment : res.desc.usage,
+				.sharingMode = vk::SharingMode::eExclusive,
+				.initialLayout = vk::ImageLayout::eUndefined
+			};
+			auto imgExpected = gpu.device.createImage(imgInfo);
+			if (!imgExpected.has_value()) {
+				handle_error("Failed to create transient image", imgExpected.result);
+			}
+			RgTransientImage transient {
+				.desc = res.desc,
+				.image = std::move(*imgExpected),
+				.firstPass = res.firstPass,
+				.lastPass = res.lastPass
+			};
+			transient.memReqs = transient.image.getMemoryRequirements();
+			transients.push_back(std::move(transient));
+		}
+
+		// greedy interval packing, biggest first, share a slot with anything whose lifetime doesn't overlap
+		std::vector<std::uint32_t> order(transients.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::ranges::sort(order, [this](std::uint32_t a, std::uint32_t b) {
+			return transients[a].memReqs.size > transients[b].memReqs.size;
+		});
+		struct Slot {
+			vk::DeviceSize offset;
+			vk::DeviceSize size;
+		};
+		std::vector<Slot> slots;
+		vk::DeviceSize totalSize = 0;
+		vk::DeviceSize maxAlignment = 1;
+		std::uint32_t typeBits = UINT32_MAX;
+		bool allLazy = true;
+		for (auto t : order) {
+			auto& transient = transients[t];
+			typeBits &= transient.memReqs.memoryTypeBits;
+			maxAlignment = std::max(maxAlignment, transient.memReqs.alignment);
+			allLazy = allLazy && is_attachment_only(transient.desc.usage);
+
+			std::uint32_t slotIdx = UINT32_MAX;
+			for (std::uint32_t s = 0; s < slots.size() && slotIdx == UINT32_MAX; s++) {
+				if (slots[s].size < transient.memReqs.size || slots[s].offset % transient.memReqs.alignment != 0) continue;
+				bool overlaps = std::ranges::any_of(transients, [&](const RgTransientImage& other) {
+					return other.slot == s && other.firstPass <= transient.lastPass && transient.firstPass <= other.lastPass;
+				});
+				if (!overlaps) slotIdx = s;
+			}
+			if (slotIdx == UINT32_MAX) {
+				vk::DeviceSize offset = (totalSize + transient.memReqs.alignment - 1) / transient.memReqs.alignment * transient.memReqs.alignment;
+				slots.push_back({.offset = offset, .size = transient.memReqs.size});
+				totalSize = offset + transient.memReqs.size;
+				slotIdx = static_cast<std::uint32_t>(slots.size() - 1);
+			}
+			transient.slot = slotIdx;
+			transient.offset = slots[slotIdx].offset;
+		}
+		if (!transients.empty() && typeBits == 0) {
+			throw std::runtime_error("RenderGraph: transient attachments share no memory type");
+		}
+
+		if (!transients.empty()) {
+			VkMemoryRequirements memReqs {
+				.size = totalSize,
+				.alignment = maxAlignment,
+				.memoryTypeBits = typeBits
+			};
+			// tilers can back attachment-only transients with lazily allocated memory, never committed on desktop
+			VmaAllocationCreateInfo allocCreateInfo = {};
+			allocCreateInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+			std::uint32_t memTypeIdx = 0;
+			lazilyAllocated = allLazy && vmaFindMemoryTypeIndex(gpu.allocator, typeBits, &allocCreateInfo, &memTypeIdx) == VK_SUCCESS;
+			if (!lazilyAllocated) {
+				allocCreateInfo.usage = VMA_MEMORY_USAGE_UNKNOWN;
+				allocCreateInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+			}
+			VkResult result = vmaAllocateMemory(gpu.allocator, &memReqs, &allocCreateInfo, &transientMemory, nullptr);
+			if (result != VK_SUCCESS) {
+				handle_error("Failed to allocate transient attachment memory", vk::Result(result));
+			}
+
+			for (auto& transient : transients) {
+				result = vmaBindImageMemory2(gpu.allocator, transientMemory, transient.offset, *transient.image, nullptr);
+				if (result != VK_SUCCESS) {
+					handle_error("Failed to bind transient image memory", vk::Result(result));
+				}
+				transient.view = create_image_view(gpu.device, *transient.image, transient.desc.format, transient.desc.aspect, 1);
+			}
+			std::println("Successfully created {} transient attachments in {} bytes ({} slots, lazily allocated: {})", transients.size(), totalSize, slots.size(), lazilyAllocated);
+		}
+	}
+
+	std::uint32_t t = 0;
+	for (auto& res : resources) {
+		if (res.imported || res.firstPass == UINT32_MAX) continue;
+		res.transientIdx = t;
+		res.image = *transients[t].image;
+		res.view = *transients[t].view;
+		t++;
+	}
+	// slot stages/access come from this frame's usages, then seed each transient's initial state with them
+	for (auto& transient : transients) {
+		transient.slotStages = {};
+		transient.slotAccess = {};
+	}
+	for (const auto& pass : passes) {
+		if (pass.culled) continue;
+		for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount; i++) {
+			const auto& res = resources[usages[i].resource];
+			if (res.imported) continue;
+			auto info = access_info(usages[i], pass.type);
+			std::uint32_t slot = transients[res.transientIdx].slot;
+			for (auto& transient : transients) {
+				if (transient.slot != slot) continue;
+				transient.slotStages |= info.stage;
+				transient.slotAccess |= info.access;
+			}
+		}
+	}
+	for (auto& res : resources) {
+		if (res.imported || res.firstPass == UINT32_MAX) continue;
+		const auto& transient = transients[res.transientIdx];
+		res.layout = vk::ImageLayout::eUndefined;
+		res.writeStage = transient.slotStages;
+		res.writeAccess = transient.slotAccess & WRITE_ACCESS_BITS;
+	}
+}
+
+void RenderGraph::build_barriers() {
+	for (auto& pass : passes) {
+		pass.firstImgBarrier = static_cast<std::uint32_t>(imgBarriers.size());
+		pass.firstBuffBarrier = static_cast<std::uint32_t>(buffBarriers.size());
+		if (pass.culled) continue;
+
+		for (std::uint32_t i = pass.firstUsage; i < pass.firstUsage + pass.usageCount; i++) {
+			const auto& use = usages[i];
+			auto& res = resources[use.resource];
+			auto info = access_info(use, pass.type);
+			bool transition = res.isImage && res.layout != info.layout;
+			bool barrier = false;
+			vk::PipelineStageFlags2 srcStage{};
+			vk::AccessFlags2 srcAccess{};
+
+			if (use.write || transition) {
+				// WAW / WAR / layout change: wait on the last writer and every reader since
+				barrier = transition || res.writeStage || res.readStages;
+				srcStage = res.writeStage | res.readStages;
+				srcAccess = res.writeAccess;
+			} else if (res.writeAccess && (info.stage & ~res.readStages)) {
+				// RAW, only for stages that haven't already been made to see the write
+				barrier = true;
+				srcStage = res.writeStage;
+				srcAccess = res.writeAccess;
+			}
+
+			if (barrier) {
+				if (res.isImage) {
+					imgBarriers.push_back({
+						.srcStageMask = srcStage,
+						.srcAccessMask = srcAccess,
+						.dstStageMask = info.stage,
+						.dstAccessMask = info.access,
+						.oldLayout = res.layout,
+						.newLayout = info.layout,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.image = res.image,
+						.subresourceRange = {
+							.aspectMask = res.desc.aspect,
+							.baseMipLevel = 0,
+							.levelCount = VK_REMAINING_MIP_LEVELS,
+							.baseArrayLayer = 0,
+							.layerCount = VK_REMAINING_ARRAY_LAYERS
+						}
+					});
+				} else {
+					buffBarriers.push_back({
+						.srcStageMask = srcStage,
+						.srcAccessMask = srcAccess,
+						.dstStageMask = info.stage,
+						.dstAccessMask = info.access,
+						.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+						.buffer = res.buffer,
+						.offset = 0,
+						.size = VK_WHOLE_SIZE
+					});
+				}
+			}
+
+			if (res.isImage) {
+				res.layout = info.layout;
+			}
+			if (use.write) {
+				res.writeStage = info.stage;
+				res.writeAccess = info.access & WRITE_ACCESS_BITS;
+				res.readStages = {};
+				res.readAccess = {};
+			} else if (barrier && transition) {
+				// the transition itself counts as a write every later reader is already ordered after
+				res.writeStage = info.stage;
+				res.writeAccess = {};
+				res.readStages = info.stage;
+				res.readAccess = info.access;
+			} else {
+				res.readStages |= info.stage;
+				res.readAccess |= info.access;
+			}
+		}
+		pass.imgBarrierCount = static_cast<std::uint32_t>(imgBarriers.size()) - pass.firstImgBarrier;
+		pass.buffBarrierCount = static_cast<std::uint32_t>(buffBarriers.size()) - pass.firstBuffBarrier;
+	}
+
+	finalImgBarrier = static_cast<std::uint32_t>(imgBarriers.size());
+	for (const auto& res : resources) {
+		if (!res.imported || !res.isImage || res.finalLayout == vk::ImageLayout::eUndefined || res.finalLayout == res.layout) continue;
+		bool present = res.finalLayout == vk::ImageLayout::ePresentSrcKHR;
+		imgBarriers.push_back({
+			.srcStageMask = res.writeStage | res.readStages,
+			.srcAccessMask = res.writeAccess,
+			.dstStageMask = present ? vk::PipelineStageFlagBits2::eBottomOfPipe : vk::PipelineStageFlagBits2::eAllCommands,
+			.dstAccessMask = {},
+			.oldLayout = res.layout,
+			.newLayout = res.finalLayout,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.image = res.image,
+			.subresourceRange = {
+				.aspectMask = res.desc.aspect,
+				.baseMipLevel = 0,
+				.levelCount = VK_REMAINING_MIP_LEVELS,
+				.baseArrayLayer = 0,
+				.layerCount = VK_REMAINING_ARRAY_LAYERS
+			}
+		});
+	}
+}
+
+void RenderGraph::execute(vk::raii::CommandBuffer& cmd, GpuProfiler* profiler) const {
+	for (const auto& pass : passes) {
+		if (pass.culled) continue;
+		if (profiler) {
+			profiler->begin_scope(cmd, pass.name, pass.type == RgPassType::eGraphics);
+		}
+		if (pass.imgBarrierCount > 0 || pass.buffBarrierCount > 0) {
+			vk::DependencyInfo depInfo {
+				.dependencyFlags = {},
+				.bufferMemoryBarrierCount = pass.buffBarrierCount,
+				.pBufferMemoryBarriers = buffBarriers.data() + pass.firstBuffBarrier,
+				.imageMemoryBarrierCount = pass.imgBarrierCount,
+				.pImageMemoryBarriers = imgBarriers.data() + pass.firstImgBarrier
+			};
+			cmd.pipelineBarrier2(depInfo);
+		}
+		pass.execute(cmd, *this);
+		if (profiler) {
+			profiler->end_scope(cmd);
+		}
+	}
+	auto finalCount = static_cast<std::uint32_t>(imgBarriers.size()) - finalImgBarrier;
+	if (finalCount > 0) {
+		vk::DependencyInfo depInfo {
+			.dependencyFlags = {},
+			.imageMemoryBarrierCount = finalCount,
+			.pImageMemoryBarriers = imgBarriers.data() + finalImgBarrier
+		};
+		cmd.pipelineBarrier2(depInfo);
+	}
+}
+
+vk::Image RenderGraph::image(RgHandle res) const {
+	return resources[res].image;
+}
+
+vk::ImageView RenderGraph::view(RgHandle res) const {
+	return resources[res].view;
+}
+
+vk::Buffer RenderGraph::buffer(RgHandle res) const {
+	return resources[res].buffer;
+}
+
+void RenderGraph::free_transients(GpuContext& gpu) {
+	// images must go before the memory they're bound to
+	transients.clear();
+	if (transientMemory) {
+		vmaFreeMemory(gpu.allocator, transientMemory);
+		transientMemory = VK_NULL_HANDLE;
+	}
+	transientKey = 0;
+}
+
+void RenderGraph::destroy(GpuContext& gpu) {
+	reset();
+	free_transients(gpu);
+}
@@ -0,0 +1,155 @@
+module;
+#include <vk_mem_alloc.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+vk::DeviceSize allocation_size(VmaAllocator allocator, VmaAllocation allocation) {
+	if (!allocation) return 0;
+	VmaAllocationInfo info;
+	vmaGetAllocationInfo(allocator, allocation, &info);
+	return info.size;
+}
+
+AssetId ResidencyManager::register_asset(std::string name, AssetKind kind, std::function<vk::DeviceSize()> load, std::function<void()> evict, std::function<vk::DeviceSize()> trim) {
+	assets.push_back({
+		.name = std::move(name),
+		.kind = kind,
+		.load = std::move(load),
+		.evict = std::move(evict),
+		.trim = std::move(trim)
+	});
+	return static_cast<AssetId>(assets.size() - 1);
+}
+
+void ResidencyManager::touch(AssetId id, std::uint64_t frame) {
+	auto& asset = assets[id];
+	asset.lastUsedFrame = frame;
+	if (asset.resident) return;
+
+	try {
+		asset.bytes = asset.load();
+	} catch (const std::runtime_error& e) {
+		// most likely out of device memory, make room for at least what it used last time and retry once
+		vk::DeviceSize wanted = std::max<vk::DeviceSize>(asset.bytes, 1);
+		if (evict_lru(wanted) == 0) {
+			throw;
+		}
+		std::println("Residency: retrying '{}' after eviction ({})", asset.name, e.what());
+		asset.bytes = asset.load();
+	}
+	asset.resident = true;
+}
+
+void ResidencyManager::update(GpuContext& gpu, std::uint64_t frame) {
+	ProfileZone zone("residency_update");
+	currentFrame = frame;
+	if (heapCount == 0) {
+		const VkPhysicalDeviceMemoryProperties* memProps = nullptr;
+		vmaGetMemoryProperties(gpu.allocator, &memProps);
+		heapCount = memProps->memoryHeapCount;
+		for (std::uint32_t i = 0; i < heapCount; i++) {
+			deviceLocal[i] = (memProps->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+		}
+	}
+	vmaSetCurrentFrameIndex(gpu.allocator, static_cast<std::uint32_t>(frame));
+	vmaGetHeapBudgets(gpu.allocator, budgets.data());
+
+	for (std::uint32_t i = 0; i < heapCount; i++) {
+		if (!deviceLocal[i]) continue;
+		const auto& budget = budgets[i];
+		auto high = static_cast<vk::DeviceSize>(static_cast<double>(budget.budget) * highWatermark);
+		if (budget.usage <= high) {
+			stuckOverBudget[i] = false;
+			continue;
+		}
+
+		auto low = static_cast<vk::DeviceSize>(static_cast<double>(budget.budget) * lowWatermark);
+		vk::DeviceSize freed = evict_lru(budget.usage - low);
+		// everything may be in use every frame, saying so once beats printing it from every frame
+		if (freed > 0) {
+			stuckOverBudget[i] = false;
+			std::println("Residency: heap {} over budget ({} / {} bytes), evicted {} bytes", i, budget.usage, budget.budget, freed);
+		} else if (!stuckOverBudget[i]) {
+			stuckOverBudget[i] = true;
+			std::println("Residency: heap {} over budget ({} / {} bytes), nothing evictable", i, budget.usage, budget.budget);
+		}
+	}
+}
+
+vk::DeviceSize ResidencyManager::evict_lru(vk::DeviceSize bytes) {
+	vk::DeviceSize freed = 0;
+	// dropping fine mips costs less than losing whole assets, and trims retire the old memory on the
+	// timeline themselves so even assets in flight can take part
+	std::pmr::vector<AssetId> trimmable(scratch);
+	for (AssetId id = 0; id < assets.size(); id++) {
+		if (assets[id].resident && assets[id].trim) {
+			trimmable.push_back(id);
+		}
+	}
+	std::ranges::sort(trimmable, {}, [this](AssetId id) { return assets[id].lastUsedFrame; });
+	for (auto id : trimmable) {
+		auto& asset = assets[id];
+		while (freed < bytes) {
+			vk::DeviceSize trimmed = asset.trim();
+			if (trimmed == 0) break;
+			asset.bytes -= std::min(asset.bytes, trimmed);
+			freed += trimmed;
+		}
+	}
+	if (freed >= bytes) {
+		std::println("Residency: trimmed {} bytes of mips", freed);
+		return freed;
+	}
+
+	// anything used by a frame that may still be in flight stays
+	std::pmr::vector<AssetId> candidates(scratch);
+	for (AssetId id = 0; id < assets.size(); id++) {
+		const auto& asset = assets[id];
+		if (asset.resident && asset.lastUsedFrame + MAX_FRAMES_IN_FLIGHT <= currentFrame) {
+			candidates.push_back(id);
+		}
+	}
+	std::ranges::sort(candidates, {}, [this](AssetId id) { return assets[id].lastUsedFrame; });
+
+	for (auto id : candidates) {
+		if (freed >= bytes) break;
+		auto& asset = assets[id];
+		asset.evict();
+		asset.resident = false;
+		freed += asset.bytes;
+		evictions++;
+		std::println("Residency: evicted '{}' ({} bytes, last used frame {})", asset.name, asset.bytes, asset.lastUsedFrame);
+	}
+	return freed;
+}
+
+vk::DeviceSize ResidencyManager::resident_bytes() const {
+	vk::DeviceSize total = 0;
+	for (const auto& asset : assets) {
+		if (asset.resident) total += asset.bytes;
+	}
+	return total;
+}
+
+bool ResidencyManager::has_headroom() const {
+	for (std::uint32_t i = 0; i < heapCount; i++) {
+		if (!deviceLocal[i]) continue;
+		auto low = static_cast<vk::DeviceSize>(static_cast<double>(budgets[i].budget) * lowWatermark);
+		if (budgets[i].usage > low) return false;
+	}
+	return true;
+}
+
+void ResidencyManager::dump_stats(GpuContext& gpu, const std::filesystem::path& path) const {
+	char* stats = nullptr;
+	vmaBuildStatsString(gpu.allocator, &stats, VK_TRUE);
+	std::ofstream file(path);
+	if (file.is_open()) {
+		file << stats;
+		file.close();
+		std::println("Dumped VMA stats to {} ({} bytes resident across {} tracked assets)", path.string(), resident_bytes(), assets.size());
+	}
+	vmaFreeStatsString(gpu.allocator, stats);
+}
@@ -0,0 +1,299 @@
+module;
+#include <unistd.h>
+#include <glm/glm.hpp>
+
+module velo;
+import std;
+
+/*
+	Three passes over the obj, none of which holds more than a budget sized slice of it:
+	1. v/vt lines are appended to scratch files as raw floats, the bounds and the triangle count are taken
+	2. f lines are triangulated, resolved against the mapped scratch tables and binned by centroid into a
+	   grid of cells, each cell buffered in memory and appended to its own spill file when the buffers fill
+	3. each cell's spill file is welded in chunks of at most chunkTriangles and handed to emit
+	Vertices on a cell or chunk boundary are duplicated, every chunk indexes only its own vertices.
+*/
+
+/// 3 corners of position + uv
+constexpr std::size_t IMPORT_TRIANGLE_FLOATS = 15;
+/// weld cost per triangle: 3 Vertex, their hash map nodes and 3 indices, rounded up
+constexpr std::uint64_t IMPORT_WELD_BYTES_PER_TRIANGLE = 384;
+constexpr std::uint32_t IMPORT_MAX_GRID = 16;
+
+static const char* skip_spaces(const char* p, const char* end) {
+	while (p < end && (*p == ' ' || *p == '\t')) p++;
+	return p;
+}
+
+static const char* parse_float(const char* p, const char* end, float& out) {
+	p = skip_spaces(p, end);
+	auto [next, ec] = std::from_chars(p, end, out);
+	if (ec != std::errc{}) out = 0.0f;
+	return next;
+}
+
+/// one "v", "v/t", "v//n" or "v/t/n" corner, indices made 0 based, -1 when absent
+static const char* parse_corner(const char* p, const char* end, std::int64_t vertexCount, std::int64_t uvCount, std::int64_t& v, std::int64_t& t) {
+	auto resolve = [](std::int64_t idx, std::int64_t count) { return idx < 0 ? count + idx : idx - 1; };
+	std::int64_t raw = 0;
+	p = std::from_chars(p, end, raw).ptr;
+	v = resolve(raw, vertexCount);
+	t = -1;
+	if (p < end && *p == '/') {
+		p++;
+		if (p < end && *p != '/') {
+			p = std::from_chars(p, end, raw).ptr;
+			t = resolve(raw, uvCount);
+		}
+	}
+	// normals and anything malformed, always moves past the corner
+	while (p < end && *p != ' ' && *p != '\t' && *p != '\r') p++;
+	return p;
+}
+
+/// calls fn(line begin, line end) for every line, dropping the mapping behind it every window bytes
+template <typename Fn>
+static void for_each_line(const MappedFile& file, std::size_t window, Fn&& fn) {
+	auto bytes = file.bytes();
+	const char* begin = reinterpret_cast<const char*>(bytes.data());
+	const char* end = begin + bytes.size();
+	std::size_t released = 0;
+	for (const char* p = begin; p < end;) {
+		const char* eol = static_cast<const char*>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+		if (!eol) eol = end;
+		fn(p, eol);
+		p = eol + 1;
+		auto offset = static_cast<std::size_t>(p - begin);
+		if (offset - released >= window) {
+			file.release(released, offset - released);
+			released = offset;
+		}
+	}
+	file.release(0, bytes.size());
+}
+
+/// appends floats to a file through a fixed size buffer
+class FloatSpill {
+public:
+	explicit FloatSpill(std::filesystem::path spillPath, std::size_t capacity) : path(std::move(spillPath)), limit(capacity) {
+		buffer.reserve(capacity);
+	}
+	void push(std::span<const float> values) {
+		if (buffer.size() + values.size() > limit) flush();
+		buffer.insert(buffer.end(), values.begin(), values.end());
+	}
+	void flush() {
+		if (buffer.empty()) return;
+		std::ofstream out(path, std::ios::binary | std::ios::app);
+		out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size() * sizeof(float)));
+		if (!out) {
+			throw std::runtime_error(std::format("Failed to write import scratch file {}", path.string()));
+		}
+		written += buffer.size();
+		buffer.clear();
+	}
+	[[nodiscard]] std::size_t count() const { return written + buffer.size(); }
+	[[nodiscard]] const std::filesystem::path& file() const { return path; }
+
+private:
+	std::filesystem::path path;
+	std::size_t limit{};
+	std::vector<float> buffer;
+	std::size_t written{};
+};
+
+/// a kB field of /proc/self/status, 0 when it can't be read
+static std::uint64_t proc_status_kib(std::string_view key) {
+	std::ifstream status("/proc/self/status");
+	std::string line;
+	while (std::getline(status, line)) {
+		if (line.starts_with(key) && line.size() > key.size() && line[key.size()] == ':') {
+			std::uint64_t kib = 0;
+			auto value = std::string_view(line).substr(key.size() + 1);
+			value.remove_prefix(std::min(value.find_first_not_of(" \t"), value.size()));
+			std::from_chars(value.data(), value.data() + value.size(), kib);
+			return kib;
+		}
+	}
+	return 0;
+}
+
+/// resets VmHWM to the current RSS so it only covers what comes after, false without a writable clear_refs
+static bool reset_peak_rss() {
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	clearRefs << "5";
+	clearRefs.flush();
+	return static_cast<bool>(clearRefs);
+}
+
+/// removes the scratch directory however the import ends
+struct ScratchDir {
+	std::filesystem::path path;
+	~ScratchDir() {
+		std::error_code ec;
+		std::filesystem::remove_all(path, ec);
+	}
+};
+
+StreamImportStats stream_import_obj(const std::filesystem::path& path, std::uint64_t budget, const std::function<void(std::span<const Vertex>, std::span<const std::uint32_t>)>& emit) {
+	ProfileZone zone("stream_import_obj");
+	StreamImportStats stats{};
+	// the process peak would include whatever ran before, the import's own is the high-water mark over this
+	bool peakReset = reset_peak_rss();
+	std::uint64_t baseKib = proc_status_kib("VmRSS");
+	MappedFile obj(path);
+	ScratchDir scratch{std::filesystem::temp_directory_path() / std::format("velo_import_{}", ::getpid())};
+	std::filesystem::create_directories(scratch.path);
+	// a quarter each for the obj window, the pass 1 tables and the cell buffers, the rest for welding
+	std::size_t window = std::max<std::size_t>(budget / 4, 1 << 20);
+	std::size_t spillFloats = std::max<std::size_t>(budget / 4 / sizeof(float), IMPORT_TRIANGLE_FLOATS * 1024);
+
+	// pass 1: vertex tables, bounds, triangle count
+	FloatSpill positions(scratch.path / "positions", spillFloats / 2);
+	FloatSpill uvs(scratch.path / "uvs", spillFloats / 2);
+	glm::vec3 lo(std::numeric_limits<float>::max());
+	glm::vec3 hi(std::numeric_limits<float>::lowest());
+	for_each_line(obj, window, [&](const char* p, const char* eol) {
+		if (eol - p < 2) return;
+		if (p[0] == 'v' && p[1] == ' ') {
+			std::array<float, 3> pos{};
+			const char* q = p + 2;
+			for (auto& c : pos) q = parse_float(q, eol, c);
+			positions.push(pos);
+			lo = glm::min(lo, glm::vec3(pos[0], pos[1], pos[2]));
+			hi = glm::max(hi, glm::vec3(pos[0], pos[1], pos[2]));
+		} else if (p[0] == 'v' && p[1] == 't') {
+			std::array<float, 2> uv{};
+			const char* q = p + 2;
+			for (auto& c : uv) q = parse_float(q, eol, c);
+			uvs.push(uv);
+		} else if (p[0] == 'f' && p[1] == ' ') {
+			std::uint64_t corners = 0;
+			for (const char* q = skip_spaces(p + 2, eol); q < eol && *q != '\r'; q = skip_spaces(q, eol)) {
+				corners++;
+				while (q < eol && *q != ' ' && *q != '\t') q++;
+			}
+			if (corners >= 3) stats.triangles += corners - 2;
+		}
+	});
+	positions.flush();
+	uvs.flush();
+	if (positions.count() == 0 || stats.triangles == 0) {
+		throw std::runtime_error(std::format("{} has no triangles", path.string()));
+	}
+	for (std::uint32_t corner = 0; corner < 8; corner++) {
+		glm::vec3 p((corner & 1u) ? hi.x : lo.x, (corner & 2u) ? hi.y : lo.y, (corner & 4u) ? hi.z : lo.z);
+		stats.radius = std::max(stats.radius, glm::length(p));
+	}
+
+	// enough cells that one cell's triangles weld within the budget, assuming an even spread
+	std::uint64_t chunkTriangles = std::max<std::uint64_t>(budget / 4 / IMPORT_WELD_BYTES_PER_TRIANGLE, 4096);
+	auto grid = static_cast<std::uint32_t>(std::ceil(std::cbrt(static_cast<double>(stats.triangles) / static_cast<double>(chunkTriangles))));
+	grid = std::clamp(grid, 1u, IMPORT_MAX_GRID);
+	stats.cells = grid * grid * grid;
+	glm::vec3 cellSize = glm::max((hi - lo) / static_cast<float>(grid), glm::vec3(1e-6f));
+
+	// pass 2: triangles into cells
+	MappedFile positionTable(positions.file());
+	MappedFile uvTable = uvs.count() > 0 ? MappedFile(uvs.file()) : MappedFile{};
+	const auto* posData = reinterpret_cast<const float*>(positionTable.bytes().data());
+	const auto* uvData = reinterpret_cast<const float*>(uvTable.bytes().data());
+	auto vertexCount = static_cast<std::int64_t>(positions.count() / 3);
+	auto uvCount = static_cast<std::int64_t>(uvs.count() / 2);
+	std::vector<FloatSpill> cells;
+	cells.reserve(stats.cells);
+	for (std::uint32_t c = 0; c < stats.cells; c++) {
+		// buffers stay small and flush often when there are many cells, the total is what is bounded
+		cells.emplace_back(scratch.path / std::format("cell{}", c), std::max<std::size_t>(spillFloats / stats.cells, IMPORT_TRIANGLE_FLOATS * 64));
+	}
+	std::int64_t seenVertices = 0, seenUvs = 0;
+	std::vector<std::pair<std::int64_t, std::int64_t>> face;
+	std::uint64_t binned = 0;
+	for_each_line(obj, window, [&](const char* p, const char* eol) {
+		if (eol - p < 2) return;
+		if (p[0] == 'v' && p[1] == ' ') { seenVertices++; return; }
+		if (p[0] == 'v' && p[1] == 't') { seenUvs++; return; }
+		if (p[0] != 'f' || p[1] != ' ') return;
+		face.clear();
+		for (const char* q = skip_spaces(p + 2, eol); q < eol && *q != '\r'; q = skip_spaces(q, eol)) {
+			std::int64_t v = 0, t = 0;
+			q = parse_corner(q, eol, seenVertices, seenUvs, v, t);
+			if (v < 0 || v >= vertexCount) {
+				throw std::runtime_error(std::format("{}: face references missing vertex {}", path.string(), v + 1));
+			}
+			face.emplace_back(v, t >= 0 && t < uvCount ? t : -1);
+		}
+		// fan, same as tinyobj's default triangulation
+		for (std::size_t i = 1; i + 1 < face.size(); i++) {
+			std::array<float, IMPORT_TRIANGLE_FLOATS> tri{};
+			glm::vec3 centroid{};
+			std::array<std::size_t, 3> corners = {0, i, i + 1};
+			for (std::size_t c = 0; c < 3; c++) {
+				auto [v, t] = face[corners[c]];
+				const float* pos = posData + v * 3;
+				tri[c * 5 + 0] = pos[0];
+				tri[c * 5 + 1] = pos[1];
+				tri[c * 5 + 2] = pos[2];
+				tri[c * 5 + 3] = t >= 0 ? uvData[t * 2] : 0.0f;
+				tri[c * 5 + 4] = t >= 0 ? 1.0f - uvData[t * 2 + 1] : 0.0f;
+				centroid += glm::vec3(pos[0], pos[1], pos[2]) / 3.0f;
+			}
+			glm::uvec3 cell = glm::min(glm::uvec3(glm::max((centroid - lo) / cellSize, glm::vec3(0.0f))), glm::uvec3(grid - 1));
+			cells[(cell.z * grid + cell.y) * grid + cell.x].push(tri);
+			// scattered lookups pull in the tables page by page, let them go again now and then
+			if (++binned % chunkTriangles == 0) {
+				positionTable.release(0, positionTable.size());
+				uvTable.release(0, uvTable.size());
+			}
+		}
+	});
+	for (auto& cell : cells) {
+		cell.flush();
+	}
+
+	// pass 3: weld and emit each cell in bounded chunks
+	std::vector<Vertex> chunkVertices;
+	std::vector<std::uint32_t> chunkIndices;
+	std::unordered_map<Vertex, std::uint32_t> unique;
+	for (auto& cell : cells) {
+		if (cell.count() == 0) continue;
+		MappedFile spill(cell.file());
+		const auto* tris = reinterpret_cast<const float*>(spill.bytes().data());
+		std::size_t triCount = cell.count() / IMPORT_TRIANGLE_FLOATS;
+		for (std::size_t first = 0; first < triCount; first += chunkTriangles) {
+			std::size_t last = std::min<std::size_t>(first + chunkTriangles, triCount);
+			chunkVertices.clear();
+			chunkIndices.clear();
+			unique.clear();
+			for (std::size_t i = first * 3; i < last * 3; i++) {
+				const float* corner = tris + i * 5;
+				Vertex vertex{.pos = {corner[0], corner[1], corner[2]}, .color = {1.0f, 1.0f, 1.0f}, .texCoord = {corner[3], corner[4]}};
+				auto [it, inserted] = unique.try_emplace(vertex, static_cast<std::uint32_t>(chunkVertices.size()));
+				if (inserted) chunkVertices.push_back(vertex);
+				chunkIndices.push_back(it->second);
+			}
+			emit(chunkVertices, chunkIndices);
+			stats.vertices += chunkVertices.size();
+			stats.chunks++;
+			spill.release(first * IMPORT_TRIANGLE_FLOATS * sizeof(float), (last - first) * IMPORT_TRIANGLE_FLOATS * sizeof(float));
+		}
+		std::filesystem::remove(cell.file());
+	}
+
+	std::uint64_t peakKib = proc_status_kib("VmHWM");
+	auto peak = peakReset && peakKib >= baseKib ? std::format("{} MiB", (peakKib - baseKib) / 1024) : std::string("unknown");
+	std::println("Streamed {}: {} triangles, {} vertices in {} chunks over {} cells, import peak {} over the {} MiB resident before it (budget {} MiB)",
+		path.filename().string(), stats.triangles, stats.vertices, stats.chunks, stats.cells, peak, baseKib / 1024, budget >> 20);
+	return stats;
+}
+
+void Velo::load_model_streaming() {
+	ProfileZone zone("load_model_streaming");
+	auto stats = stream_import_obj(MODEL_PATH, config.import_budget, [this](std::span<const Vertex> chunkVertices, std::span<const std::uint32_t> chunkIndices) {
+		auto meshIdx = static_cast<std::uint32_t>(meshes.size());
+		meshes.push_back(geometry.upload(gpu, chunkVertices, chunkIndices));
+		submeshes.push_back({.mesh = meshIdx, .indexCount = static_cast<std::uint32_t>(chunkIndices.size())});
+	});
+	sceneRadius = std::max(sceneRadius, stats.radius);
+	std::println("Successfully streamed model into {} meshes, {}/{} arena vertices in use", stats.chunks, geometry.vertexAlloc.used(), geometry.vertexAlloc.capacity());
+}
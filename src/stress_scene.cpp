@@ -0,0 +1,284 @@
+module;
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <tiny_obj_loader.h>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+static constexpr std::uint32_t STRESS_CLUSTERS = 32;
+static constexpr std::uint32_t STRESS_CHECKER_SIZE = 64;
+/// checkers that fit the atlas: padded 72 px cells, 28 per shelf and 28 shelves
+static constexpr std::uint32_t STRESS_MAX_TEXTURES = (ATLAS_SIZE / (STRESS_CHECKER_SIZE + 2 * ATLAS_PADDING)) * (ATLAS_SIZE / (STRESS_CHECKER_SIZE + 2 * ATLAS_PADDING));
+static constexpr std::array<const char*, 3> STRESS_MODELS = {"viking_room.obj", "teapot.obj", "42.obj"};
+
+static std::uint32_t parse_count(std::string_view key, std::string_view value) {
+	std::uint32_t out{};
+	auto [end, ec] = std::from_chars(value.data(), value.data() + value.size(), out);
+	if (ec != std::errc{} || end != value.data() + value.size()) {
+		throw std::runtime_error(std::format("Stress scene: bad value '{}' for {}", value, key));
+	}
+	return out;
+}
+
+StressSceneDesc parse_stress_scene(std::string_view spec) {
+	StressSceneDesc desc{};
+	for (auto field : std::views::split(spec, ',')) {
+		std::string_view entry(field.begin(), field.end());
+		if (entry.empty()) continue;
+		auto eq = entry.find('=');
+		if (eq == std::string_view::npos) {
+			throw std::runtime_error(std::format("Stress scene: expected key=value, got '{}'", entry));
+		}
+		std::string_view key = entry.substr(0, eq);
+		std::string_view value = entry.substr(eq + 1);
+		if (key == "instances") {
+			desc.instances = parse_count(key, value);
+		} else if (key == "materials") {
+			desc.materials = parse_count(key, value);
+		} else if (key == "textures") {
+			desc.textures = parse_count(key, value);
+		} else if (key == "seed") {
+			desc.seed = parse_count(key, value);
+		} else if (key == "models") {
+			desc.models = parse_count(key, value) != 0;
+		} else if (key == "distribution") {
+			if (value == "uniform") desc.distribution = StressDistribution::eUniform;
+			else if (value == "grid") desc.distribution = StressDistribution::eGrid;
+			else if (value == "clusters") desc.distribution = StressDistribution::eClusters;
+			else if (value == "shell") desc.distribution = StressDistribution::eShell;
+			else throw std::runtime_error(std::format("Stress scene: unknown distribution '{}'", value));
+		} else {
+			throw std::runtime_error(std::format("Stress scene: unknown key '{}'", key));
+		}
+	}
+	desc.instances = std::max(desc.instances, 1u);
+	desc.materials = std::clamp(desc.materials, 1u, static_cast<std::uint32_t>(MAX_MATERIALS));
+	desc.textures = std::min(desc.textures, desc.materials);
+	if (desc.textures > STRESS_MAX_TEXTURES) {
+		throw std::runtime_error(std::format("Stress scene: textures={} doesn't fit the atlas, at most {}", desc.textures, STRESS_MAX_TEXTURES));
+	}
+	return desc;
+}
+
+float stress_scene_radius(const StressSceneDesc& desc) {
+	// about one unit sized object per 2x2x2 cell
+	return std::cbrt(static_cast<float>(desc.instances));
+}
+
+std::vector<StressInstance> generate_stress_instances(const StressSceneDesc& desc, std::span<const float> meshRadii, std::uint32_t materialCount) {
+	std::mt19937_64 rng(desc.seed);
+	float radius = stress_scene_radius(desc);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> scaleDist(0.5f, 1.0f);
+	std::uniform_real_distribution<float> angleDist(0.0f, glm::two_pi<float>());
+	std::uniform_int_distribution<std::uint32_t> meshPick(0, static_cast<std::uint32_t>(meshRadii.size() - 1));
+	std::uniform_int_distribution<std::uint32_t> materialPick(0, materialCount - 1);
+	std::normal_distribution<float> spread(0.0f, radius * 0.1f);
+
+	std::array<glm::vec3, STRESS_CLUSTERS> centers{};
+	for (auto& center : centers) {
+		center = glm::vec3(unit(rng), unit(rng), unit(rng)) * radius * 0.8f;
+	}
+	std::uniform_int_distribution<std::uint32_t> clusterPick(0, STRESS_CLUSTERS - 1);
+	auto gridSide = static_cast<std::uint32_t>(std::ceil(std::cbrt(static_cast<float>(desc.instances))));
+
+	std::vector<StressInstance> instances(desc.instances);
+	for (std::uint32_t i = 0; i < desc.instances; i++) {
+		glm::vec3 pos{};
+		switch (desc.distribution) {
+			case StressDistribution::eUniform:
+				pos = glm::vec3(unit(rng), unit(rng), unit(rng)) * radius;
+				break;
+			case StressDistribution::eGrid: {
+				glm::vec3 cell(static_cast<float>(i % gridSide), static_cast<float>((i / gridSide) % gridSide), static_cast<float>(i / (gridSide * gridSide)));
+				pos = (cell - static_cast<float>(gridSide - 1) * 0.5f) * 2.0f;
+				break;
+			}
+			case StressDistribution::eClusters:
+				pos = centers[clusterPick(rng)] + glm::vec3(spread(rng), spread(rng), spread(rng));
+				break;
+			case StressDistribution::eShell: {
+				glm::vec3 dir(unit(rng), unit(rng), unit(rng));
+				pos = glm::length(dir) > 1e-4f ? glm::normalize(dir) * radius : glm::vec3(radius, 0.0f, 0.0f);
+				break;
+			}
+		}
+		auto& instance = instances[i];
+		instance.mesh = meshPick(rng);
+		instance.material = materialPick(rng);
+		// every mesh normalized to about unit radius, whatever its source scale
+		float scale = scaleDist(rng) / meshRadii[instance.mesh];
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), pos);
+		model = glm::rotate(model, angleDist(rng), glm::vec3(0.0f, 1.0f, 0.0f));
+		instance.transform.model = glm::scale(model, glm::vec3(scale));
+	}
+	std::ranges::sort(instances, {}, [](const StressInstance& instance) {
+		return (static_cast<std::uint64_t>(instance.mesh) << 32) | instance.material;
+	});
+	return instances;
+}
+
+void make_cube(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) {
+	// 4 vertices a face so every face gets the full uv square
+	static constexpr std::array<glm::vec3, 6> normals = {{
+		{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}
+	}};
+	for (const auto& n : normals) {
+		glm::vec3 u = std::abs(n.y) > 0.5f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+		glm::vec3 v = glm::cross(n, u);
+		auto base = static_cast<std::uint32_t>(vertices.size());
+		for (std::uint32_t corner = 0; corner < 4; corner++) {
+			float s = (corner & 1u) ? 1.0f : -1.0f;
+			float t = (corner & 2u) ? 1.0f : -1.0f;
+			vertices.push_back({.pos = (n + u * s + v * t) * 0.5f, .color = {1.0f, 1.0f, 1.0f}, .texCoord = {s * 0.5f + 0.5f, t * 0.5f + 0.5f}});
+		}
+		indices.insert(indices.end(), {base, base + 1, base + 3, base, base + 3, base + 2});
+	}
+}
+
+void make_sphere(std::uint32_t rings, std::uint32_t segments, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices) {
+	auto base = static_cast<std::uint32_t>(vertices.size());
+	for (std::uint32_t ring = 0; ring <= rings; ring++) {
+		float v = static_cast<float>(ring) / static_cast<float>(rings);
+		float phi = v * glm::pi<float>();
+		for (std::uint32_t segment = 0; segment <= segments; segment++) {
+			float u = static_cast<float>(segment) / static_cast<float>(segments);
+			float theta = u * glm::two_pi<float>();
+			glm::vec3 pos(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+			vertices.push_back({.pos = pos, .color = {1.0f, 1.0f, 1.0f}, .texCoord = {u, v}});
+		}
+	}
+	for (std::uint32_t ring = 0; ring < rings; ring++) {
+		for (std::uint32_t segment = 0; segment < segments; segment++) {
+			std::uint32_t a = base + ring * (segments + 1) + segment;
+			std::uint32_t b = a + segments + 1;
+			indices.insert(indices.end(), {a, b, a + 1, a + 1, b, b + 1});
+		}
+	}
+}
+
+static std::vector<std::uint8_t> make_checker(glm::vec3 color) {
+	std::vector<std::uint8_t> rgba(static_cast<std::size_t>(STRESS_CHECKER_SIZE) * STRESS_CHECKER_SIZE * 4);
+	for (std::uint32_t y = 0; y < STRESS_CHECKER_SIZE; y++) {
+		for (std::uint32_t x = 0; x < STRESS_CHECKER_SIZE; x++) {
+			bool dark = ((x / 8) + (y / 8)) % 2 == 1;
+			glm::vec3 texel = dark ? color * 0.3f : color;
+			std::size_t at = (static_cast<std::size_t>(y) * STRESS_CHECKER_SIZE + x) * 4;
+			rgba[at + 0] = static_cast<std::uint8_t>(texel.r * 255.0f);
+			rgba[at + 1] = static_cast<std::uint8_t>(texel.g * 255.0f);
+			rgba[at + 2] = static_cast<std::uint8_t>(texel.b * 255.0f);
+			rgba[at + 3] = 255;
+		}
+	}
+	return rgba;
+}
+
+void Velo::create_stress_scene() {
+	ProfileZone zone("create_stress_scene");
+	StressSceneDesc desc = parse_stress_scene(config.stress_scene);
+
+	// stress meshes live for the whole run, they aren't registered with residency
+	std::vector<float> radii;
+	auto add_mesh = [&](const std::vector<Vertex>& meshVertices, const std::vector<std::uint32_t>& meshIndices) {
+		float radius = 0.0f;
+		for (const auto& vertex : meshVertices) {
+			radius = std::max(radius, glm::length(vertex.pos));
+		}
+		meshes.push_back(geometry.upload(gpu, meshVertices, meshIndices));
+		radii.push_back(std::max(radius, 1e-3f));
+	};
+	{
+		std::vector<Vertex> meshVertices;
+		std::vector<std::uint32_t> meshIndices;
+		make_cube(meshVertices, meshIndices);
+		add_mesh(meshVertices, meshIndices);
+		meshVertices.clear();
+		meshIndices.clear();
+		make_sphere(16, 32, meshVertices, meshIndices);
+		add_mesh(meshVertices, meshIndices);
+	}
+	if (desc.models) {
+		for (const char* name : STRESS_MODELS) {
+			tinyobj::attrib_t attrib;
+			std::vector<tinyobj::shape_t> shapes;
+			std::string path = MODEL_DIR + name;
+			try {
+				load_obj(path, attrib, shapes);
+			} catch (const std::exception& e) {
+				std::println("Stress scene: skipping {} ({})", path, e.what());
+				continue;
+			}
+			std::vector<Vertex> meshVertices;
+			std::vector<std::uint32_t> meshIndices;
+			weld_obj_vertices(attrib, shapes, meshVertices, meshIndices);
+			add_mesh(meshVertices, meshIndices);
+		}
+	}
+
+	// a different stream than the placement so changing one count doesn't reshuffle the other
+	std::mt19937_64 rng(desc.seed ^ 0x9E3779B97F4A7C15ull);
+	std::uniform_real_distribution<float> channel(0.15f, 1.0f);
+	auto firstMaterial = static_cast<std::uint32_t>(materials.size());
+	for (std::uint32_t m = 0; m < desc.materials; m++) {
+		glm::vec3 color(channel(rng), channel(rng), channel(rng));
+		if (m < desc.textures) {
+			auto rgba = make_checker(color);
+			add_atlas_material(rgba, STRESS_CHECKER_SIZE, STRESS_CHECKER_SIZE);
+		} else {
+			add_flat_material(color);
+		}
+	}
+
+	auto instances = generate_stress_instances(desc, radii, desc.materials);
+	std::vector<GpuInstance> transforms;
+	transforms.reserve(instances.size());
+	for (std::size_t i = 0; i < instances.size();) {
+		std::size_t end = i;
+		while (end < instances.size() && instances[end].mesh == instances[i].mesh && instances[end].material == instances[i].material) {
+			transforms.push_back(instances[end].transform);
+			end++;
+		}
+		const Mesh& mesh = meshes[instances[i].mesh];
+		submeshes.push_back({
+			.mesh = instances[i].mesh,
+			.indexCount = mesh.indexCount,
+			.material = firstMaterial + instances[i].material,
+			.firstInstance = static_cast<std::uint32_t>(i),
+			.instanceCount = static_cast<std::uint32_t>(end - i)
+		});
+		sceneTriangles += static_cast<std::uint64_t>(mesh.indexCount / 3) * (end - i);
+		i = end;
+	}
+	create_instance_buffer(transforms);
+
+	sceneRadius = stress_scene_radius(desc) + 1.0f;
+	cameraEye = glm::vec3(0.0f, 0.4f, 1.8f) * sceneRadius;
+	cameraFar = sceneRadius * 4.0f;
+	std::println("Successfully generated stress scene: {} instances of {} meshes, {} draws, {} materials ({} textured), {} triangles",
+		instances.size(), meshes.size(), submeshes.size(), desc.materials, desc.textures, sceneTriangles);
+}
+
+void Velo::create_instance_buffer(std::span<const GpuInstance> instances) {
+	vk::DeviceSize buffSize = instances.size_bytes();
+	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	void* data = nullptr;
+	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &data);
+	std::memcpy(data, instances.data(), buffSize);
+	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
+
+	defrag.forget(instanceBuff);
+	// transfer src so defrag can copy it out
+	instanceBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+	gpu.copy_buffer(stagingBuff, instanceBuff, buffSize);
+	instanceAddress = gpu.device.getBufferAddress({.buffer = instanceBuff.buffer()});
+	defrag.track(instanceBuff.allocation(), {
+		.buffer = &instanceBuff,
+		.onMoved = [this]() {
+			// push constants carry the address and the reuse hash includes it, the next frame records against the new copy
+			instanceAddress = gpu.device.getBufferAddress({.buffer = instanceBuff.buffer()});
+		}
+	});
+}
@@ -7,7 +7,7 @@ import std;
 import vulkan_hpp;
 
 static vk::SurfaceFormatKHR choose_swap_surface_format(const std::vector<vk::SurfaceFormatKHR>& availableFormats);
-static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::PresentModeKHR>& availableModes);
+static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::PresentModeKHR>& availableModes, vk::PresentModeKHR preferred);
 static vk::Extent2D choose_swap_extent(GLFWwindow* window, const vk::SurfaceCapabilitiesKHR& capabilities);
 
 void SwapchainContext::create(GLFWwindow* window, GpuContext& gpu) {
@@ -26,12 +26,16 @@ void SwapchainContext::create(GLFWwindow* window, GpuContext& gpu) {
 	auto surfaceCapabilities = *capabilitiesExpected;
 
 	auto fmt = choose_swap_surface_format(*fmtsExpected);
-	auto mode = choose_swap_present_mode(*presentExpected);
+	presentModes = *presentExpected;
+	auto mode = choose_swap_present_mode(presentModes, preferredPresentMode);
 	auto tmpExtent = choose_swap_extent(window, surfaceCapabilities);
 	// target triple buffering for mailbox mode (instead of minImageCount + 1)
 	auto minImgCount = std::max(3u, surfaceCapabilities.minImageCount);
 	minImgCount = (surfaceCapabilities.maxImageCount > 0 && minImgCount > surfaceCapabilities.maxImageCount) ? surfaceCapabilities.maxImageCount : minImgCount;
 
+	// transfer src lets frame capture copy the presented image out, dynamic resolution blits into it
+	usage = vk::ImageUsageFlagBits::eColorAttachment | (surfaceCapabilities.supportedUsageFlags & (vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eTransferDst));
+
 	vk::SwapchainCreateInfoKHR swapInfo {
 		.flags = vk::SwapchainCreateFlagsKHR(),
 		.surface = gpu.surface,
@@ -40,7 +44,7 @@ void SwapchainContext::create(GLFWwindow* window, GpuContext& gpu) {
 		.imageColorSpace = fmt.colorSpace,
 		.imageExtent = tmpExtent,
 		.imageArrayLayers = 1,
-		.imageUsage = vk::ImageUsageFlagBits::eColorAttachment,
+		.imageUsage = usage,
 		.imageSharingMode = vk::SharingMode::eExclusive,
 		.preTransform = surfaceCapabilities.currentTransform,
 		.compositeAlpha = vk::CompositeAlphaFlagBitsKHR::eOpaque,
@@ -68,6 +72,8 @@ void SwapchainContext::create(GLFWwindow* window, GpuContext& gpu) {
 	images = *imgsExpected;
 	extent = tmpExtent;
 	format = fmt.format;
+	presentMode = mode;
+	depthFormat = find_depth_format(gpu.physicalDevice);
 }
 
 static vk::Extent2D choose_swap_extent(GLFWwindow* window, const vk::SurfaceCapabilitiesKHR& capabilities) {
@@ -102,10 +108,10 @@ static vk::SurfaceFormatKHR choose_swap_surface_format(const std::vector<vk::Sur
 	return availableFormats[0];
 }
 
-static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::PresentModeKHR>& availableModes) {
-	// mailbox if available
+static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::PresentModeKHR>& availableModes, vk::PresentModeKHR preferred) {
+	// mailbox unless the overlay asked for something else
 	for (const auto& mode: availableModes) {
-		if (mode == vk::PresentModeKHR::eMailbox) {
+		if (mode == preferred) {
 			return mode;
 		}
 	}
@@ -113,12 +119,6 @@ static vk::PresentModeKHR choose_swap_present_mode(const std::vector<vk::Present
 	return vk::PresentModeKHR::eFifo;
 }
 
-void SwapchainContext::create_depth_resources(GpuContext& gpu) {
-	vk::Format depthFmt = find_depth_format(gpu.physicalDevice);
-	depthImage = VmaImage(gpu.allocator, extent.width, extent.height, 1, vk::ImageUsageFlagBits::eDepthStencilAttachment, depthFmt,  VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT, VMA_MEMORY_USAGE_AUTO);
-	depthView = create_image_view(gpu.device, depthImage.image(), depthFmt, vk::ImageAspectFlagBits::eDepth, 1);
-}
-
 vk::Format SwapchainContext::find_depth_format(vk::raii::PhysicalDevice& physicalDevice) {
 	return find_supported_format(
 		physicalDevice,
@@ -129,6 +129,7 @@ vk::Format SwapchainContext::find_depth_format(vk::raii::PhysicalDevice& physica
 }
 
 void SwapchainContext::recreate(GLFWwindow* window, GpuContext& gpu) {
+	ProfileZone zone("swapchain_recreate");
 	int width = 0, height = 0;
 	glfwGetFramebufferSize(window, &width, &height);
 	while (width == 0 || height == 0) {
@@ -140,7 +141,7 @@ void SwapchainContext::recreate(GLFWwindow* window, GpuContext& gpu) {
 	cleanup();
 	create(window, gpu);
 	create_image_views(gpu.device);
-	create_depth_resources(gpu);
+	generation++;
 }
 
 void SwapchainContext::cleanup() {
@@ -0,0 +1,80 @@
+module velo;
+import std;
+
+static std::mutex traceRegistryMutex;
+static std::vector<std::unique_ptr<TraceRing>> traceRings;
+static std::uint64_t traceStartNs{};
+static thread_local TraceRing* threadRing = nullptr;
+
+void trace_enable() {
+	traceStartNs = trace_now_ns();
+	traceEnabled.store(true, std::memory_order_relaxed);
+}
+
+static TraceRing& thread_ring() {
+	if (!threadRing) {
+		// once per thread, the zones themselves never take the lock
+		std::scoped_lock lock(traceRegistryMutex);
+		auto& ring = traceRings.emplace_back(std::make_unique<TraceRing>());
+		ring->threadIdx = static_cast<std::uint32_t>(traceRings.size() - 1);
+		threadRing = ring.get();
+	}
+	return *threadRing;
+}
+
+void trace_record(const char* name, std::uint64_t beginNs, std::uint64_t endNs, std::uint32_t track) {
+	TraceRing& ring = thread_ring();
+	// seq_cst both here and in the exporter: either it sees writing and waits, or this sees tracing already off
+	ring.writing.store(true);
+	if (!traceEnabled.load()) {
+		ring.writing.store(false, std::memory_order_release);
+		return;
+	}
+	std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+	ring.events[head % TRACE_RING_SIZE] = {
+		.name = name,
+		.beginNs = beginNs,
+		.endNs = endNs,
+		.track = track == 0 ? ring.threadIdx : track
+	};
+	ring.head.store(head + 1, std::memory_order_release);
+	ring.writing.store(false, std::memory_order_release);
+}
+
+void trace_write_chrome_json(const std::filesystem::path& path) {
+	std::ofstream file(path);
+	if (!file.is_open()) {
+		std::println("Failed to open {} for the trace", path.string());
+		return;
+	}
+	auto to_us = [](std::uint64_t ns) {
+		return static_cast<double>(ns - std::min(ns, traceStartNs)) / 1000.0;
+	};
+
+	std::scoped_lock lock(traceRegistryMutex);
+	// workers may still be running, stop recording and let any event in progress land before reading the rings
+	traceEnabled.store(false);
+	for (const auto& ring : traceRings) {
+		while (ring->writing.load(std::memory_order_acquire)) {
+			std::this_thread::yield();
+		}
+	}
+	std::size_t count = 0;
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	file << std::format(R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"GPU graphics queue"}}}})", TRACE_GPU_TRACK);
+	for (const auto& ring : traceRings) {
+		file << std::format(",\n" R"({{"name":"thread_name","ph":"M","pid":1,"tid":{},"args":{{"name":"{}"}}}})",
+			ring->threadIdx, ring->threadIdx == 0 ? "main" : std::format("thread {}", ring->threadIdx));
+		std::uint64_t head = ring->head.load(std::memory_order_acquire);
+		std::uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+		for (std::uint64_t i = first; i < head; i++) {
+			const TraceEvent& event = ring->events[i % TRACE_RING_SIZE];
+			// zone names are literals, nothing in them needs escaping
+			file << std::format(",\n" R"({{"name":"{}","ph":"X","pid":1,"tid":{},"ts":{:.3f},"dur":{:.3f}}})",
+				event.name, event.track, to_us(event.beginNs), static_cast<double>(event.endNs - event.beginNs) / 1000.0);
+			count++;
+		}
+	}
+	file << "\n]}\n";
+	std::println("Wrote {} trace events to {}", count, path.string());
+}
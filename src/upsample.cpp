@@ -0,0 +1,254 @@
+module;
+#include <vk_mem_alloc.h>
+#include <glm/glm.hpp>
+
+module velo;
+import std;
+import vulkan_hpp;
+
+void ResolutionController::update(double gpuMs, std::uint32_t latency) {
+	framesSinceChange++;
+	if (gpuMs <= 0.0) return;
+	auto ms = static_cast<float>(gpuMs);
+	smoothedMs = smoothedMs == 0.0f ? ms : smoothedMs * 0.8f + ms * 0.2f;
+	frames++;
+	scaleSum += static_cast<double>(scale);
+	if (ms > targetMs) overBudget++;
+
+	// aim a bit under the target so noise doesn't push every other frame over
+	const float aimMs = targetMs * 0.9f;
+	float next = scale;
+	// samples are latency frames old, a change only shows up in them after that
+	if (ms > targetMs * 1.1f && framesSinceChange > latency) {
+		// spike: react to the raw sample right away
+		next = scale * std::sqrt(aimMs / ms);
+	} else if (smoothedMs < targetMs * 0.75f && framesSinceChange > 30) {
+		// headroom: climb back slowly so a one frame dip doesn't cause a spike on the way up
+		next = scale * std::min(1.05f, std::sqrt(aimMs / smoothedMs));
+	}
+	// 1/64 steps, the same scale keeps recorded command buffers reusable
+	next = std::round(std::clamp(next, DYNAMIC_RES_MIN_SCALE, 1.0f) * 64.0f) / 64.0f;
+	if (next != scale) {
+		scale = next;
+		framesSinceChange = 0;
+		lowestScale = std::min(lowestScale, scale);
+	}
+}
+
+vk::Extent2D ResolutionController::render_extent(vk::Extent2D output) const {
+	auto scaled = [this](std::uint32_t size) {
+		return std::clamp(static_cast<std::uint32_t>(std::lround(static_cast<float>(size) * scale)), 1u, size);
+	};
+	return {.width = scaled(output.width), .height = scaled(output.height)};
+}
+
+void ResolutionController::print() const {
+	if (frames == 0) return;
+	std::println("Dynamic resolution: {:.2f} ms target, mean scale {:.2f}, lowest {:.2f}, {} of {} frames over target",
+		targetMs, scaleSum / static_cast<double>(frames), lowestScale, overBudget, frames);
+}
+
+void Upsampler::create(GpuContext& gpu, std::span<const std::byte> shaderCode) {
+	auto samplerExpected = gpu.device.createSampler({
+		.magFilter = vk::Filter::eLinear,
+		.minFilter = vk::Filter::eLinear,
+		.mipmapMode = vk::SamplerMipmapMode::eNearest,
+		.addressModeU = vk::SamplerAddressMode::eClampToEdge,
+		.addressModeV = vk::SamplerAddressMode::eClampToEdge,
+		.addressModeW = vk::SamplerAddressMode::eClampToEdge,
+		.maxLod = 0.0f
+	});
+	if (!samplerExpected.has_value()) {
+		handle_error("Failed to create upsample sampler", samplerExpected.result);
+	}
+	sampler = std::move(*samplerExpected);
+
+	// its own small set, the targets never go through the bindless table
+	std::array<vk::DescriptorSetLayoutBinding, 5> bindings = {{
+		{.binding = 0, .descriptorType = vk::DescriptorType::eSampledImage, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute},
+		{.binding = 1, .descriptorType = vk::DescriptorType::eSampledImage, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute},
+		{.binding = 2, .descriptorType = vk::DescriptorType::eSampledImage, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute},
+		{.binding = 3, .descriptorType = vk::DescriptorType::eStorageImage, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute},
+		{.binding = 4, .descriptorType = vk::DescriptorType::eSampler, .descriptorCount = 1, .stageFlags = vk::ShaderStageFlagBits::eCompute, .pImmutableSamplers = &*sampler}
+	}};
+	auto layoutExpected = gpu.device.createDescriptorSetLayout({
+		.bindingCount = static_cast<std::uint32_t>(bindings.size()),
+		.pBindings = bindings.data()
+	});
+	if (!layoutExpected.has_value()) {
+		handle_error("Failed to create upsample descriptor set layout", layoutExpected.result);
+	}
+	setLayout = std::move(*layoutExpected);
+
+	std::array<vk::DescriptorPoolSize, 3> poolSizes = {{
+		{.type = vk::DescriptorType::eSampledImage, .descriptorCount = 6},
+		{.type = vk::DescriptorType::eStorageImage, .descriptorCount = 2},
+		{.type = vk::DescriptorType::eSampler, .descriptorCount = 2}
+	}};
+	auto poolExpected = gpu.device.createDescriptorPool({
+		.flags = vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet,
+		.maxSets = 2,
+		.poolSizeCount = static_cast<std::uint32_t>(poolSizes.size()),
+		.pPoolSizes = poolSizes.data()
+	});
+	if (!poolExpected.has_value()) {
+		handle_error("Failed to create upsample descriptor pool", poolExpected.result);
+	}
+	pool = std::move(*poolExpected);
+	std::array<vk::DescriptorSetLayout, 2> setLayouts = {*setLayout, *setLayout};
+	auto setsExpected = gpu.device.allocateDescriptorSets({
+		.descriptorPool = *pool,
+		.descriptorSetCount = static_cast<std::uint32_t>(setLayouts.size()),
+		.pSetLayouts = setLayouts.data()
+	});
+	if (!setsExpected.has_value()) {
+		handle_error("Failed to allocate upsample descriptor sets", setsExpected.result);
+	}
+	sets = std::move(*setsExpected);
+
+	vk::PushConstantRange pcRange {
+		.stageFlags = vk::ShaderStageFlagBits::eCompute,
+		.offset = 0,
+		.size = sizeof(UpsamplePushConstants)
+	};
+	auto pipelineLayoutExpected = gpu.device.createPipelineLayout({
+		.setLayoutCount = 1,
+		.pSetLayouts = &*setLayout,
+		.pushConstantRangeCount = 1,
+		.pPushConstantRanges = &pcRange
+	});
+	if (!pipelineLayoutExpected.has_value()) {
+		handle_error("Failed to create upsample pipeline layout", pipelineLayoutExpected.result);
+	}
+	pipelineLayout = std::move(*pipelineLayoutExpected);
+
+	auto moduleExpected = gpu.device.createShaderModule({
+		.codeSize = shaderCode.size(),
+		.pCode = reinterpret_cast<const std::uint32_t*>(shaderCode.data())
+	});
+	if (!moduleExpected.has_value()) {
+		handle_error("Failed to create upsample shader module", moduleExpected.result);
+	}
+	auto pipelineExpected = gpu.device.createComputePipeline(nullptr, {
+		.stage = {.stage = vk::ShaderStageFlagBits::eCompute, .module = **moduleExpected, .pName = "upsampleMain"},
+		.layout = *pipelineLayout
+	});
+	if (!pipelineExpected.has_value()) {
+		handle_error("Failed to create upsample pipeline", pipelineExpected.result);
+	}
+	pipeline = std::move(*pipelineExpected);
+	std::println("Successfully created upsample pipeline");
+}
+
+void Upsampler::resize(GpuContext& gpu, vk::Extent2D extent, std::uint32_t swapchainGeneration) {
+	ProfileZone zone("upsample_resize");
+	colorView.clear();
+	motionView.clear();
+	for (auto& view : historyViews) {
+		view.clear();
+	}
+	color = VmaImage(gpu.allocator, extent.width, extent.height, 1,
+		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, SCENE_COLOR_FORMAT, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+	motion = VmaImage(gpu.allocator, extent.width, extent.height, 1,
+		vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled, MOTION_FORMAT, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+	colorView = create_image_view(gpu.device, color.image(), SCENE_COLOR_FORMAT, vk::ImageAspectFlagBits::eColor, 1);
+	motionView = create_image_view(gpu.device, motion.image(), MOTION_FORMAT, vk::ImageAspectFlagBits::eColor, 1);
+	for (std::size_t i = 0; i < history.size(); i++) {
+		history[i] = VmaImage(gpu.allocator, extent.width, extent.height, 1,
+			vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc, SCENE_COLOR_FORMAT, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
+		historyViews[i] = create_image_view(gpu.device, history[i].image(), SCENE_COLOR_FORMAT, vk::ImageAspectFlagBits::eColor, 1);
+		historyValid[i] = false;
+	}
+
+	// layouts match what the render graph transitions them to for each usage
+	for (std::uint32_t i = 0; i < 2; i++) {
+		std::array<vk::DescriptorImageInfo, 4> infos = {{
+			{.imageView = *colorView, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal},
+			{.imageView = *motionView, .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal},
+			{.imageView = *historyViews[i ^ 1], .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal},
+			{.imageView = *historyViews[i], .imageLayout = vk::ImageLayout::eGeneral}
+		}};
+		std::array<vk::WriteDescriptorSet, 4> writes{};
+		for (std::uint32_t binding = 0; binding < writes.size(); binding++) {
+			writes[binding] = {
+				.dstSet = *sets[i],
+				.dstBinding = binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = binding == 3 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage,
+				.pImageInfo = &infos[binding]
+			};
+		}
+		gpu.device.updateDescriptorSets(writes, nullptr);
+	}
+	generation = swapchainGeneration;
+	std::println("Successfully created dynamic resolution targets ({}x{})", extent.width, extent.height);
+}
+
+glm::vec2 Upsampler::jitter(std::uint64_t frame) {
+	auto halton = [](std::uint64_t index, std::uint64_t base) {
+		float result = 0.0f;
+		float fraction = 1.0f;
+		for (; index > 0; index /= base) {
+			fraction /= static_cast<float>(base);
+			result += fraction * static_cast<float>(index % base);
+		}
+		return result;
+	};
+	// starts at 1, index 0 would be the same (0, 0) every cycle
+	std::uint64_t index = frame % 8 + 1;
+	return {halton(index, 2) - 0.5f, halton(index, 3) - 0.5f};
+}
+
+void Upsampler::dispatch(vk::raii::CommandBuffer& cmd, std::uint32_t historyIdx, vk::DeviceAddress constants, vk::Extent2D outputSize) const {
+	cmd.bindPipeline(vk::PipelineBindPoint::eCompute, *pipeline);
+	cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, *pipelineLayout, 0, *sets[historyIdx], nullptr);
+	cmd.pushConstants<UpsamplePushConstants>(*pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, UpsamplePushConstants{.constants = constants});
+	auto groups = [](std::uint32_t size) { return (size + 7) / 8; };
+	cmd.dispatch(groups(outputSize.width), groups(outputSize.height), 1);
+}
+
+void Upsampler::destroy() {
+	colorView.clear();
+	motionView.clear();
+	for (auto& view : historyViews) {
+		view.clear();
+	}
+	color = VmaImage{};
+	motion = VmaImage{};
+	for (auto& img : history) {
+		img = VmaImage{};
+	}
+	pipeline.clear();
+	pipelineLayout.clear();
+	sets.clear();
+	pool.clear();
+	setLayout.clear();
+	sampler.clear();
+}
+
+void Velo::update_resolution() {
+	if (upsampler.generation != swapchain.generation) {
+		// resizes already stall in swapchain.recreate(), the targets and their sets aren't worth retiring
+		gpu.device.waitIdle();
+		upsampler.resize(gpu, swapchain.extent, swapchain.generation);
+	}
+	// only the passes that render at renderExtent, the overlay, resolve and async uploads don't move with the scale
+	double gpuMs = 0.0;
+	for (const auto& scope : profiler.results()) {
+		std::string_view name = scope.name;
+		if (name == "depth_prepass" || name == "main" || name == "main_equal") {
+			gpuMs += scope.gpuMs;
+		}
+	}
+	// a replay has to render the same frames every run, GPU timing noise would pick a different scale each time
+	if (!inputLog.replaying()) {
+		resolution.update(gpuMs, framesInFlight);
+	}
+	renderExtent = resolution.render_extent(swapchain.extent);
+	historyIdx = frameCount & 1u;
+	historyReady = upsampler.historyValid[historyIdx ^ 1] && config.upsample_mode == UpsampleMode::eTemporal;
+	// an aborted frame comes with a swapchain recreate, which resets both
+	upsampler.historyValid[historyIdx] = true;
+	frameJitter = config.upsample_mode == UpsampleMode::eTemporal ? Upsampler::jitter(frameCount) : glm::vec2(0.0f);
+}
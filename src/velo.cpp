@@ -1,6 +1,8 @@
 module;
 #include <GLFW/glfw3.h>
 #include <glm/fwd.hpp>
+#include <glm/glm.hpp>
+#include <glm/gtc/color_space.hpp>
 #include <vk_mem_alloc.h>
 #include <tiny_obj_loader.h>
 #include <unordered_map>
@@ -19,20 +21,51 @@ Velo::Velo() {
 		config.enable_x11();
 		std::println("\tEnabled X11 mode");
 	#endif
+	#if defined(DESCRIPTOR_BUFFER)
+		config.enable_descriptor_buffer();
+		std::println("\tEnabled descriptor buffer backend (when supported)");
+	#endif
+	#if defined(ALLOC_TRACKING)
+		config.enable_alloc_tracking();
+		std::println("\tEnabled allocation tracking");
+	#endif
+	#if defined(TRACE)
+		config.enable_trace();
+		std::println("\tEnabled trace capture");
+	#endif
+	#if defined(CMD_REUSE)
+		config.enable_cmd_reuse();
+		std::println("\tEnabled command buffer reuse");
+	#endif
+	#if defined(HOT_RELOAD)
+		config.enable_hot_reload();
+		std::println("\tEnabled asset hot reload");
+	#endif
+	#if defined(DYNAMIC_RESOLUTION)
+		config.enable_dynamic_resolution();
+		std::println("\tEnabled dynamic resolution");
+	#endif
+	#if defined(DEPTH_PREPASS)
+		config.enable_depth_prepass();
+		std::println("\tEnabled depth pre-pass");
+	#endif
+	config.read_env();
 	#if defined(INFOS)
 		config.is_info_gathered();
 		std::println("\tEnabled Info Fetching");
 	#endif
 }
 
-void Velo::run() {
+int Velo::run() {
 	init_window();
 	init_vulkan();
 	main_loop();
 	cleanup();
+	return config.alloc_check && allocStats.allocating_frames() > 0 ? 1 : 0;
 }
 
 void Velo::init_vulkan() {
+	ProfileZone zone("init_vulkan");
 	gpu.create_instance(context, config);
 	setup_debug_messenger();
 	gpu.create_surface(window);
@@ -40,48 +73,143 @@ void Velo::init_vulkan() {
 	gpu.create_logical_device(gpu.surface);
 	gpu.init_vma();
 	gpu.create_command_pool();
+	defrag.create(gpu);
+	profiler.create(gpu);
+	defrag.scratch = frameArena.get();
+	residency.scratch = frameArena.get();
 
 	swapchain.create(window, gpu);
 	swapchain.create_image_views(gpu.device);
-	swapchain.create_depth_resources(gpu);
+	if (config.dynamic_resolution) {
+		// the upsampled image is blitted onto the swapchain, which also converts it to the swapchain's format
+		auto features = gpu.physicalDevice.getFormatProperties(swapchain.format).optimalTilingFeatures;
+		if (!(swapchain.usage & vk::ImageUsageFlagBits::eTransferDst) || !(features & vk::FormatFeatureFlagBits::eBlitDst)) {
+			std::println("Dynamic resolution disabled, can't blit to the swapchain");
+			config.dynamic_resolution = false;
+		}
+	}
 
 	sync.create(gpu.device, static_cast<std::uint32_t>(swapchain.images.size()));
 
-	descriptors.create_layout(gpu.device);
-	descriptors.create_pool(gpu.device);
-	descriptors.create_set(gpu.device);
+	bindless.query_limits(gpu.physicalDevice);
+	if (config.use_descriptor_buffer && gpu.descriptorBufferSupported) {
+		descriptors.backend = DescriptorBackend::eBuffer;
+	}
+	descriptors.create_layout(gpu.device, bindless);
+	if (descriptors.backend == DescriptorBackend::eBuffer) {
+		descriptors.create_buffer(gpu);
+	} else {
+		descriptors.create_pool(gpu.device, bindless);
+		descriptors.create_set(gpu.device, bindless);
+	}
 
 	for (std::uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-		frames[i].create(gpu, *descriptors.set, i);
+		frames[i].create(gpu);
 	}
+	geometry.create(gpu, descriptors);
+	geometry.submit = [this](vk::raii::CommandBuffer&& cmdBuff, VmaBuffer&& staging) { submit_upload(std::move(cmdBuff), std::move(staging)); };
 
+	open_assets();
 	create_graphics_pipeline();
+	if (config.dynamic_resolution) {
+		upsampler.create(gpu, assets.load(UPSAMPLE_SHADER_PATH));
+		resolution.targetMs = config.target_frame_ms;
+	}
 	init_default_data();
+	// everything decoded has been uploaded or copied out by now
+	assets.drop_cache();
+	overlay.create(window, gpu, swapchain);
+	tuning.presentMode = swapchain.presentMode;
+	tuning.depthPrepass = config.depth_prepass;
+	swapchain.preferredPresentMode = swapchain.presentMode;
 }
 
 void Velo::main_loop() {
+	if (!config.replay_input.empty()) {
+		inputLog.start_replay(config.replay_input);
+	} else if (!config.record_input.empty()) {
+		inputLog.start_recording(config.record_input);
+	}
+	if (config.hot_reload) {
+		start_hot_reload();
+	}
+	if (!config.capture_dir.empty()) {
+		if (!(swapchain.usage & vk::ImageUsageFlagBits::eTransferSrc)) {
+			std::println("Frame capture disabled, the surface doesn't allow copying from swapchain images");
+		} else {
+			capture.start(config.capture_dir, config.capture_format, config.capture_frames, swapchain.format);
+		}
+	}
+	lastFrameTime = std::chrono::steady_clock::now();
 	while (!glfwWindowShouldClose(window) && !config.should_quit) {
 		glfwPollEvents();
-		process_input();
+		InputFrame input = next_input();
+		if (config.should_quit) break;
+		process_input(input);
+		AllocCounters before = alloc_counters();
 		draw_frame();
+		if (config.prepass_ab && frameCount % DEPTH_PREPASS_BENCH_FRAMES == 0) {
+			// same scene both ways, "main" against "depth_prepass" + "main_equal" in the profiler summary
+			tuning.depthPrepass = !tuning.depthPrepass;
+		}
+		// the first frame carries startup work
+		if (frameCount > 1) {
+			frameTimes.add(wallDt * 1000.0f);
+		}
+		if (config.track_allocs) {
+			allocStats.end_frame(frameCount, alloc_counters() - before);
+		}
+		if (config.frame_limit > 0 && frameCount >= config.frame_limit) {
+			config.should_quit = true;
+		}
 	}
 	gpu.device.waitIdle();
+	if (config.prepass_ab) {
+		// the A/B run only borrows the setting
+		tuning.depthPrepass = config.depth_prepass;
+	}
+	inputLog.finish();
+	capture.finish(frameCount);
+	if (!config.stress_scene.empty()) {
+		// one line per run, easy to collect into a table
+		std::println("stress: instances={} triangles={} textures={} frames={} mean_ms={:.3f} worst_ms={:.3f}",
+			instanceBuff.size() / sizeof(GpuInstance), sceneTriangles, atlas.entry_count(), frameTimes.frames, frameTimes.mean_ms(), frameTimes.worstMs);
+	}
+	cmdReuse.print();
+	profiler.print();
+	capture.print();
+	resolution.print();
+	if (config.write_trace) {
+		trace_write_chrome_json(TRACE_PATH);
+	}
+	if (config.track_allocs) {
+		allocStats.print();
+	}
+	if (config.alloc_check && allocStats.allocating_frames() > 0) {
+		std::println("Allocation check failed: {} frames after warmup touched the heap", allocStats.allocating_frames());
+	}
 }
 
 void Velo::cleanup() {
+	overlay.destroy();
 	swapchain.cleanup();
 
 	// VMA allocator being destroyed before vertexBuff
 	// explicitly call destructor
 	// TODO: find something cleaner
-	indexBuff = VmaBuffer{};
-	vertexBuff = VmaBuffer{};
-	materialIdxBuff = VmaBuffer{};
+	defrag.destroy(gpu);
+	retired.flush_all();
+	descriptors.descriptorBuff = VmaBuffer{};
+	geometry.destroy();
 	textureImage = VmaImage{};
-	swapchain.depthImage = VmaImage{};
-	materialImages.clear();
+	graph.destroy(gpu);
+	materialBuff = VmaBuffer{};
+	instanceBuff = VmaBuffer{};
+	capture.destroy();
+	upsampler.destroy();
+	atlas.destroy();
 	for (auto& frame: frames) {
-		frame.uniformBuffer = VmaBuffer{};
+		frame.frameAlloc.destroy();
 	}
 	vmaDestroyAllocator(gpu.allocator);
 	/*
@@ -126,47 +254,24 @@ void Velo::setup_debug_messenger() {
 	std::cout << "Successfully created DebugMessenger\n";
 }
 
-void Velo::transition_image_layout(
-		vk::Image img,
-		vk::ImageLayout oldLayout,
-		vk::ImageLayout newLayout,
-		vk::AccessFlags2 srcAccessMask,
-		vk::AccessFlags2 dstAccessMask,
-		vk::PipelineStageFlags2 srcStageMask,
-		vk::PipelineStageFlags2 dstStageMask,
-		vk::ImageAspectFlags aspectFlags
-) {
-	vk::ImageMemoryBarrier2 barrier = {
-		.srcStageMask = srcStageMask,
-		.srcAccessMask = srcAccessMask,
-		.dstStageMask = dstStageMask,
-		.dstAccessMask = dstAccessMask,
-		.oldLayout = oldLayout,
-		.newLayout = newLayout,
-		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-		.image = img,
-		.subresourceRange = {
-			.aspectMask = aspectFlags,
-			.baseMipLevel = 0,
-			.levelCount = 1,
-			.baseArrayLayer = 0,
-			.layerCount = 1
-		}
-	};
-	vk::DependencyInfo depInfo = {
-		.dependencyFlags = {},
-		.imageMemoryBarrierCount = 1,
-		.pImageMemoryBarriers = &barrier
-	};
-	frames[frameIdx].cmdBuffer.pipelineBarrier2(depInfo);
-}
-
 void Velo::draw_frame() {
+	ProfileZone zone("draw_frame");
+	if (tuning.framesInFlight != framesInFlight) {
+		// slots map to different frames from here on, let everything in flight drain first
+		gpu.device.waitIdle();
+		framesInFlight = tuning.framesInFlight;
+	}
 	uint64_t timelineValue = ++frameCount;
-	frameIdx = (timelineValue - 1) % MAX_FRAMES_IN_FLIGHT;
+	frameIdx = (timelineValue - 1) % framesInFlight;
 	FrameContext& frame = frames[frameIdx];
-	sync.wait_for_frame(gpu.device, timelineValue);
+	AllocZoneScope zones(allocStats);
+	zones.enter("wait");
+	sync.wait_for_frame(gpu.device, timelineValue, framesInFlight);
+	// the timeline just retired this slot's previous frame, nothing reads its allocations anymore
+	frame.frameAlloc.reset();
+	frameArena.reset();
+	zones.enter("profiler");
+	profiler.collect(gpu, frameIdx);
 
 	if (frameBuffResized) {
 		frameBuffResized = false;
@@ -175,7 +280,26 @@ void Velo::draw_frame() {
 		return;
 	}
 
+	std::uint64_t completedValue = timelineValue > framesInFlight ? timelineValue - framesInFlight : 0;
+	zones.enter("retire");
+	retired.flush(completedValue);
+	zones.enter("residency");
+	residency.update(gpu, timelineValue);
+	zones.enter("defrag");
+	defrag.step(gpu, timelineValue, completedValue);
+	zones.enter("reload");
+	update_hot_reload();
+	zones.enter("capture");
+	capture.collect(completedValue, timelineValue);
+	if (config.dynamic_resolution) {
+		zones.enter("resolution");
+		update_resolution();
+	} else {
+		renderExtent = swapchain.extent;
+	}
+	zones.enter("uniforms");
 	update_uniform_buffers();
+	zones.enter("acquire");
 	auto nextImgExpected = swapchain.swapchain.acquireNextImage(UINT64_MAX, *frame.acquireSem, nullptr);
 	bool recreate = nextImgExpected.result == vk::Result::eSuboptimalKHR;
 	if (nextImgExpected.result == vk::Result::eErrorOutOfDateKHR) {
@@ -192,7 +316,17 @@ void Velo::draw_frame() {
 		handle_error("Failed to acquire next swapchain image", nextImgExpected.result);
 	}
 	auto imgIdx = nextImgExpected.value;
+	zones.enter("streaming");
+	touch_scene_assets();
+	update_texture_streaming();
+	zones.enter("overlay");
+	update_overlay();
+	zones.enter("bindless");
+	bindless.flush(gpu, descriptors, completedValue);
+	captureTarget = capture.begin_frame(gpu, timelineValue, swapchain.extent, swapchain.format);
+	zones.enter("record");
 	record_command_buffer(imgIdx);
+	zones.enter("submit");
 
 	// using sync 2 feature
 	std::array<vk::SemaphoreSubmitInfo, 1> waitSemsInfo = {{
@@ -215,7 +349,7 @@ void Velo::draw_frame() {
 		}
 	}};
 	vk::CommandBufferSubmitInfo cmdInfo {
-		.commandBuffer = *frames[frameIdx].cmdBuffer
+		.commandBuffer = *frames[frameIdx].cmdBuffers[imgIdx]
 	};
 	vk::SubmitInfo2 submitInfo = {
 		.waitSemaphoreInfoCount = 1,
@@ -225,7 +359,11 @@ void Velo::draw_frame() {
 		.signalSemaphoreInfoCount = 2,
 		.pSignalSemaphoreInfos = signalSemsInfo.data()
 	};
-	gpu.graphicsQueue.submit2(submitInfo);
+	{
+		ProfileZone submitZone("submit");
+		gpu.graphicsQueue.submit2(submitInfo);
+	}
+	zones.enter("present");
 
 	const vk::PresentInfoKHR presentInfo = {
 		.waitSemaphoreCount = 1,
@@ -255,8 +393,9 @@ void Velo::create_texture_sampler() {
 		.maxAnisotropy = properties.limits.maxSamplerAnisotropy,
 		.compareEnable = vk::False,
 		.compareOp = vk::CompareOp::eAlways,
+		// textureImage only holds the resident levels, so lod 0 already is the finest resident mip
 		.minLod = 0.0f,
-		.maxLod = 0.0f,
+		.maxLod = VK_LOD_CLAMP_NONE,
 		.borderColor = vk::BorderColor::eIntOpaqueBlack,
 		.unnormalizedCoordinates = vk::False
 	};
@@ -265,6 +404,7 @@ void Velo::create_texture_sampler() {
 		handle_error("Failed to create texture sampler", samplerExpected.result);
 	}
 	textureSampler = std::move(*samplerExpected);
+	samplerSlot = bindless.add_sampler(*textureSampler);
 }
 
 vk::Format find_supported_format(vk::raii::PhysicalDevice& physicalDevice, const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features) {
@@ -280,201 +420,285 @@ vk::Format find_supported_format(vk::raii::PhysicalDevice& physicalDevice, const
 	throw std::runtime_error("Failed to find supported format");
 }
 
+bool Velo::streams_model() const {
+	std::error_code sizeErr;
+	auto modelSize = std::filesystem::file_size(MODEL_PATH, sizeErr);
+	return !sizeErr && (config.stream_import || modelSize > config.import_budget);
+}
+
 void Velo::load_model() {
+	ProfileZone zone("load_model");
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-	std::string basedir = "/home/omathot/dev/cpp/velo/models/";
+	load_obj(MODEL_PATH, attrib, shapes);
 
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str(), basedir.c_str())) {
-		throw std::runtime_error(warn + err);
-	}
+	weld_obj_vertices(attrib, shapes, vertices, indices);
+	submeshes.push_back({.mesh = static_cast<std::uint32_t>(meshes.size()), .indexCount = static_cast<std::uint32_t>(indices.size())});
+	std::cout << "Successfully loaded model, uniquevertices = " << vertices.size() << '\n';
+}
 
-	std::unordered_map<Vertex, std::uint32_t> uniqueVertices;
-	for (const auto& shape: shapes) {
-		for (const auto& idx: shape.mesh.indices) {
-			Vertex vertex{};
-			vertex.pos = {
-				attrib.vertices[3 * static_cast<ulong>(idx.vertex_index) + 0],
-				attrib.vertices[3 * static_cast<ulong>(idx.vertex_index) + 1],
-				attrib.vertices[3 * static_cast<ulong>(idx.vertex_index) + 2]
-			};
-			if (idx.texcoord_index >= 0) {
-				vertex.texCoord = {
-					attrib.texcoords[2 * static_cast<ulong>(idx.texcoord_index) + 0],
-					1.0f - attrib.texcoords[2 * static_cast<ulong>(idx.texcoord_index) + 1]
-				};
-			} else {
-				vertex.texCoord = {0.0f, 0.0f};
-			}
-			vertex.color = {1.0f, 1.0f, 1.0f};
+InputFrame Velo::next_input() {
+	auto now = std::chrono::steady_clock::now();
+	wallDt = std::chrono::duration<float>(now - lastFrameTime).count();
+	lastFrameTime = now;
+	InputFrame input {.dt = wallDt, .keys = sample_keys()};
+	if (inputLog.replaying()) {
+		// escape still works, everything else comes from the log
+		bool quit = input.down(InputKey::eQuit);
+		auto logged = inputLog.next();
+		if (!logged) {
+			config.should_quit = true;
+			return {};
+		}
+		input = *logged;
+		if (config.replay_dt > 0.0f) {
+			input.dt = config.replay_dt;
+		}
+		if (quit) {
+			input.keys |= 1u << static_cast<std::uint32_t>(InputKey::eQuit);
+		}
+	} else if (inputLog.recording()) {
+		inputLog.record(input);
+	}
+	return input;
+}
 
-			if (!uniqueVertices.contains(vertex)) {
-				uniqueVertices[vertex] = static_cast<std::uint32_t>(vertices.size());
-				vertices.push_back(vertex);
-			}
-			// if already seen index to it with vertex
-			indices.push_back(uniqueVertices[vertex]);
+std::uint16_t Velo::sample_keys() const {
+	static constexpr std::array<std::pair<InputKey, int>, static_cast<std::size_t>(InputKey::eCount)> bindings = {{
+		{InputKey::eLeft, GLFW_KEY_A},
+		{InputKey::eRight, GLFW_KEY_D},
+		{InputKey::eForward, GLFW_KEY_W},
+		{InputKey::eBack, GLFW_KEY_S},
+		{InputKey::eUp, GLFW_KEY_UP},
+		{InputKey::eDown, GLFW_KEY_DOWN},
+		{InputKey::eReverseRotation, GLFW_KEY_SPACE},
+		{InputKey::eToggleRotation, GLFW_KEY_C},
+		{InputKey::eSlower, GLFW_KEY_MINUS},
+		{InputKey::eFaster, GLFW_KEY_EQUAL},
+		{InputKey::eOverlay, GLFW_KEY_F1},
+		{InputKey::eDumpStats, GLFW_KEY_F12},
+		{InputKey::eQuit, GLFW_KEY_ESCAPE}
+	}};
+	std::uint16_t keys = 0;
+	for (const auto& [key, glfwKey] : bindings) {
+		if (glfwGetKey(window, glfwKey) == GLFW_PRESS) {
+			keys |= static_cast<std::uint16_t>(1u << static_cast<std::uint32_t>(key));
 		}
 	}
-	std::cout << "Successfully loaded model, uniquevertices = " << vertices.size() << '\n';
+	return keys;
 }
 
-void Velo::process_input() {
-	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+void Velo::process_input(const InputFrame& input) {
+	dt = input.dt;
+	totalTime += dt;
+	auto pressed = [&](InputKey key) {
+		return input.down(key) && !((prevKeys >> static_cast<std::uint32_t>(key)) & 1u);
+	};
+
+	if (input.down(InputKey::eLeft))
 		position.x -= speed * dt;
-	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+	if (input.down(InputKey::eRight))
 		position.x += speed * dt;
-	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+	if (input.down(InputKey::eForward))
 		position.z -= speed * dt;
-	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+	if (input.down(InputKey::eBack))
 		position.z += speed * dt;
-	if (glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
+	if (input.down(InputKey::eUp))
 		position.y += speed * dt;
-	if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
+	if (input.down(InputKey::eDown))
 		position.y -= speed * dt;
 
-	static bool spacePressed = false;
-	bool spacePress = glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS;
-	if (spacePress && !spacePressed) {
+	if (pressed(InputKey::eReverseRotation)) {
 		if (rotation == 0) {
 			rotation = -1;
 		}
 		rotation = -rotation;
 	}
-	spacePressed = spacePress;
 
-	static bool cPressed = false;
-	bool cPress = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
-	if (cPress && !cPressed) {
+	if (pressed(InputKey::eToggleRotation)) {
 		if (rotation == 0)
 			rotation = 1;
 		else
 			rotation = 0;
 	}
-	cPressed = cPress;
 
-	static bool minusPressed = false;
-	bool minusPress = glfwGetKey(window, GLFW_KEY_MINUS) == GLFW_PRESS;
-	if (minusPress && !minusPressed) {
+	if (pressed(InputKey::eSlower)) {
 		if (rotationSpeed >= 10)
 			rotationSpeed -= 10;
 	}
-	minusPressed = minusPress;
 
-	static bool plusPressed = false;
-	bool plusPress = glfwGetKey(window, GLFW_KEY_EQUAL) == GLFW_PRESS;
-	if (plusPress && !plusPressed) {
+	if (pressed(InputKey::eFaster)) {
 		if (rotationSpeed <= 140)
 			rotationSpeed += 10;
 	}
-	plusPressed = plusPress;
 
-	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
-		config.should_quit = true;
+	if (pressed(InputKey::eOverlay)) {
+		overlay.toggle();
+	}
+
+	if (pressed(InputKey::eDumpStats)) {
+		residency.dump_stats(gpu, "vma_stats.json");
+	}
 
-	double mouseX = 0;
-	double mouseY = 0;
-	glfwGetCursorPos(window, &mouseX, &mouseY);
+	if (input.down(InputKey::eQuit))
+		config.should_quit = true;
+	prevKeys = input.keys;
 }
 
 void Velo::init_default_data() {
+	ProfileZone zone("init_default_data");
 	create_texture_sampler();
-	if (config.enabled_codam) {
-		create_material_images();
-		create_texture_material_views();
-		load_model_per_face_material();
-	} else {
-		create_texture_image();
-		create_texture_image_view();
-		load_model();
-	}
-	create_vertex_buffer();
-	create_index_buffer();
-	if (config.enabled_codam) {
-		create_material_index_buffer();
+	if (!config.stress_scene.empty()) {
+		create_stress_scene();
+	} else if (!config.model_path.empty()) {
+		load_gltf();
 	} else {
-		// yes this is ugly. temporary
-		create_dummy_material_index_buffer();
+		if (config.enabled_codam) {
+			create_material_palette();
+			load_model_per_face_material();
+		} else {
+			materials.push_back({.texture = MaterialTexture::eStreamed});
+			if (streams_model()) {
+				load_model_streaming();
+			} else {
+				if (config.stream_import) {
+					std::println("No loose {}, importing it from the archive without the memory budget", MODEL_PATH);
+				}
+				load_model();
+			}
+		}
+		register_resident_assets();
+		// the streaming import uploads as it goes and keeps no CPU copy
+		if (!vertices.empty()) {
+			create_geometry();
+		}
+		// a single identity instance, the view data's model matrix places the model
+		std::array<GpuInstance, 1> single{};
+		create_instance_buffer(single);
+		for (const auto& sub : submeshes) {
+			sceneTriangles += sub.indexCount / 3;
+		}
 	}
+	create_material_buffer();
 }
 
-void Velo::create_material_images() {
+void Velo::register_resident_assets() {
+	// codam materials are flat colors, there is no texture to track
+	if (config.enabled_codam) return;
+	textureAsset = residency.register_asset(TEXTURE_PATH, AssetKind::eTexture,
+		[this]() {
+			create_texture_image();
+			return allocation_size(gpu.allocator, textureImage.allocation());
+		},
+		[this]() {
+			defrag.forget(textureImage);
+			bindless.release_texture(textureSlot, frameCount);
+			textureSlot = {};
+			textureImageView = nullptr;
+			textureImage = VmaImage{};
+			textureStream.allocatedMip = textureStream.mip_count();
+			textureStream.uploadedMip = textureStream.mip_count();
+			textureStream.residentMip = textureStream.mip_count();
+		},
+		[this]() -> vk::DeviceSize {
+			// finest level goes first, and the streamer may not bring it back until there is headroom again
+			if (textureStream.allocatedMip + 1 >= textureStream.mip_count()) return 0;
+			vk::DeviceSize before = allocation_size(gpu.allocator, textureImage.allocation());
+			textureStream.budgetMip = textureStream.allocatedMip + 1;
+			textureStream.lastBudgetChange = frameCount;
+			allocate_texture(textureStream.budgetMip);
+			return before - std::min(before, allocation_size(gpu.allocator, textureImage.allocation()));
+		}
+	);
+	residency.touch(textureAsset, frameCount);
+}
+
+void Velo::touch_scene_assets() {
+	if (textureAsset != INVALID_ASSET) {
+		residency.touch(textureAsset, frameCount);
+	}
+	for (auto asset : meshAssets) {
+		residency.touch(asset, frameCount);
+	}
+}
+
+void Velo::create_material_palette() {
 	std::vector<glm::vec3> colors = {
 		{1.0f, 1.0f, 1.0},
 		{0.8f, 0.8f, 0.8f},
 		{0.6f, 0.6f, 0.6f},
 		{0.4f, 0.4f, 0.4f},
 	};
-	for (std::uint32_t i = 0; i < colors.size(); i++) {
-		std::array<uint8_t, 4> pixels = {
-			static_cast<uint8_t>(colors[i].r * 255.0f),
-			static_cast<uint8_t>(colors[i].g * 255.0f),
-			static_cast<uint8_t>(colors[i].b * 255.0f),
-			255
-		};
-		int texW = 1;
-		int texH = 1;
-		mipLvls = 1;
-		vk::DeviceSize imgSize = 4;
-		VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, imgSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
-		void* data = nullptr;
-		vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &data);
-		std::memcpy(data, pixels.data(), imgSize);
-		vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
-
-		materialImages.emplace_back(gpu.allocator, static_cast<std::uint32_t>(texW), static_cast<std::uint32_t>(texH), 1, vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc | vk::ImageUsageFlagBits::eSampled, vk::Format::eR8G8B8A8Srgb, VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-		std::println("Successfully created material image");
-
-		transition_image_texture_layout(materialImages[i], vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, 1);
-		copy_buffer_to_image(stagingBuff, materialImages[i], static_cast<std::uint32_t>(texW), static_cast<std::uint32_t>(texH));
-		transition_image_texture_layout(materialImages[i], vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, 1);
+	for (const auto& color : colors) {
+		add_flat_material(color);
+	}
+	std::println("Successfully created {} flat materials", colors.size());
+}
+
+std::uint32_t Velo::add_flat_material(glm::vec3 color) {
+	if (materials.size() >= MAX_MATERIALS) {
+		throw std::runtime_error(std::format("Material table full ({} materials)", MAX_MATERIALS));
+	}
+	// authored in srgb like the textures, which the sampler hands back linear
+	materials.push_back({.params = {.baseColor = glm::vec4(glm::convertSRGBToLinear(color), 1.0f)}});
+	return static_cast<std::uint32_t>(materials.size() - 1);
+}
+
+std::uint32_t Velo::add_atlas_material(std::span<const std::uint8_t> rgba, std::uint32_t width, std::uint32_t height) {
+	if (materials.size() >= MAX_MATERIALS) {
+		throw std::runtime_error(std::format("Material table full ({} materials)", MAX_MATERIALS));
+	}
+	auto rect = atlas.add(rgba, width, height);
+	if (!rect) {
+		throw std::runtime_error(std::format("{}x{} texture does not fit the atlas", width, height));
 	}
+	materials.push_back({.params = {.uvRect = TextureAtlas::uv_rect(*rect)}, .texture = MaterialTexture::eAtlas});
+	return static_cast<std::uint32_t>(materials.size() - 1);
 }
 
-void Velo::create_texture_material_views() {
-	std::vector<vk::raii::ImageView> matviews;
-	std::vector<vk::DescriptorImageInfo> imageInfos;
-	for (std::uint32_t i = 0; i < materialImages.size(); i++) {
-		auto matView = create_image_view(gpu.device, materialImages[i].image(), vk::Format::eR8G8B8A8Srgb, vk::ImageAspectFlagBits::eColor, 1);
-		materialImageViews.push_back(std::move(matView));
-		imageInfos.push_back({
-			.sampler = textureSampler,
-			.imageView = materialImageViews[i],
-			.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal,
-		});
-	}
-
-	std::vector<vk::WriteDescriptorSet> writes;
-	writes.reserve(imageInfos.size());
-	for (std::uint32_t i = 0; i < imageInfos.size(); i++) {
-		writes.push_back({
-			.dstSet = *descriptors.set,
-			.dstBinding = 1,
-			.dstArrayElement = i,
-			.descriptorCount = 1,
-			.descriptorType = vk::DescriptorType::eCombinedImageSampler,
-			.pImageInfo = &imageInfos[i]
-		});
-	}
-	gpu.device.updateDescriptorSets(writes, nullptr);
+void Velo::create_material_buffer() {
+	ProfileZone zone("create_material_buffer");
+	if (!atlas.empty()) {
+		atlas.upload(gpu);
+		atlas.slot = bindless.add_texture(*atlas.view);
+	}
+	std::vector<GpuMaterial> params;
+	params.reserve(materials.size());
+	for (const auto& material : materials) {
+		params.push_back(material.params);
+	}
+	vk::DeviceSize buffSize = sizeof(GpuMaterial) * params.size();
+	VmaBuffer stagingBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eTransferSrc, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT);
+	void* data = nullptr;
+	vmaMapMemory(gpu.allocator, stagingBuff.allocation(), &data);
+	std::memcpy(data, params.data(), buffSize);
+	vmaUnmapMemory(gpu.allocator, stagingBuff.allocation());
+
+	materialBuff = VmaBuffer(gpu.allocator, buffSize, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst | vk::BufferUsageFlagBits::eShaderDeviceAddress);
+	gpu.copy_buffer(stagingBuff, materialBuff, buffSize);
+	descriptors.write_buffer(gpu, 2, 0, vk::DescriptorType::eStorageBuffer, materialBuff, buffSize);
+	std::println("Successfully created material buffer ({} materials, {} in the atlas)", materials.size(), atlas.entry_count());
+}
+
+std::uint32_t Velo::material_texture_slot(const Material& material) const {
+	switch (material.texture) {
+		case MaterialTexture::eAtlas: return atlas.slot.index;
+		// the streamed texture changes slots as its mips come and go
+		case MaterialTexture::eStreamed: return textureSlot.index;
+		case MaterialTexture::eNone: break;
+	}
+	return UINT32_MAX;
 }
 
 void Velo::load_model_per_face_material() {
+	ProfileZone zone("load_model_per_face_material");
 	tinyobj::attrib_t attrib;
 	std::vector<tinyobj::shape_t> shapes;
-	std::vector<tinyobj::material_t> materials;
-	std::string warn, err;
-	std::string basedir = "/home/omathot/dev/cpp/velo/models/";
-
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, MODEL_PATH.c_str(), basedir.c_str())) {
-		throw std::runtime_error(warn + err);
-	}
+	load_obj(MODEL_PATH, attrib, shapes);
 
 	std::unordered_map<Vertex, std::uint32_t> uniqueVertices;
 	std::uint32_t globalFaceIdx = 0;
-	materialIndices.clear();
+	std::vector<std::uint32_t> faceMaterials;
 
 	for (const auto& shape: shapes) {
 		std::uint32_t idxOffset = 0;
@@ -483,7 +707,7 @@ void Velo::load_model_per_face_material() {
 			if (std::max(matId, 0) == 0)
 				matId = 0;
 
-			materialIndices.push_back(static_cast<std::uint32_t>(matId));
+			faceMaterials.push_back(static_cast<std::uint32_t>(matId));
 			size_t numVerts = shape.mesh.num_face_vertices[faceIdx];
 			for (size_t i = 0; i < numVerts; i++) {
 				const auto& idx = shape.mesh.indices[idxOffset + i];
@@ -514,68 +738,35 @@ void Velo::load_model_per_face_material() {
 			globalFaceIdx++;
 		}
 	}
-	std::cout << "Successfully loaded model, uniquevertices = " << vertices.size() << '\n';
+	// one draw per material instead of a material lookup per fragment
+	auto grouped = group_faces_by_material(indices, faceMaterials, static_cast<std::uint32_t>(meshes.size()));
+	submeshes.insert(submeshes.end(), grouped.begin(), grouped.end());
+	std::cout << "Successfully loaded model, uniquevertices = " << vertices.size() << ", " << grouped.size() << " material submeshes\n";
 }
 
-void Velo::create_dummy_material_index_buffer() {
-    vk::DeviceSize buffSize = sizeof(std::uint32_t);
-    materialIdxBuff = VmaBuffer(gpu.allocator, buffSize,
-        vk::BufferUsageFlagBits::eStorageBuffer,
-        VMA_MEMORY_USAGE_AUTO,
-        VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT);
-
-    vk::DescriptorBufferInfo matBuffInfo {
-        .buffer = materialIdxBuff.buffer(),
-        .offset = 0,
-        .range = buffSize
-    };
-    vk::WriteDescriptorSet writeSet {
-        .dstSet = *descriptors.set,
-        .dstBinding = 2,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = vk::DescriptorType::eStorageBuffer,
-        .pBufferInfo = &matBuffInfo
-    };
-    gpu.device.updateDescriptorSets(writeSet, nullptr);
+void FrameContext::create(GpuContext& gpu) {
+	auto acquireSemExpected = gpu.device.createSemaphore(vk::SemaphoreCreateInfo{});
+	if (!acquireSemExpected.has_value()) {
+		handle_error("Failed to create render semaphore", acquireSemExpected.result);
+	}
+	acquireSem = std::move(*acquireSemExpected);
+
+	frameAlloc.create(gpu);
 }
 
-void FrameContext::create(GpuContext& gpu, vk::DescriptorSet dstSet, std::uint32_t frameIdx) {
+void FrameContext::resize_cmd_buffers(GpuContext& gpu, std::uint32_t swapchainImgCount) {
+	cmdBuffers.clear();
 	vk::CommandBufferAllocateInfo allocInfo {
 		.commandPool = *gpu.cmdPool,
 		.level = vk::CommandBufferLevel::ePrimary,
-		.commandBufferCount = 1
+		.commandBufferCount = swapchainImgCount
 	};
-
 	auto cmdBuffExpected = gpu.device.allocateCommandBuffers(allocInfo);
 	if (!cmdBuffExpected.has_value()) {
-		handle_error("Failed to allocate cmd buffer", cmdBuffExpected.result);
+		handle_error("Failed to allocate cmd buffers", cmdBuffExpected.result);
 	}
-	cmdBuffer = std::move(cmdBuffExpected->front());
-
-	auto acquireSemExpected = gpu.device.createSemaphore(vk::SemaphoreCreateInfo{});
-	if (!acquireSemExpected.has_value()) {
-		handle_error("Failed to create render semaphore", acquireSemExpected.result);
-	}
-	acquireSem = std::move(*acquireSemExpected);
-
-	uniformBuffer = VmaBuffer(gpu.allocator, sizeof(UniformBufferObject), vk::BufferUsageFlagBits::eUniformBuffer, VMA_MEMORY_USAGE_AUTO, VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT);
-	uniformBufferMapped = uniformBuffer.mapped_data();
-
-	vk::DescriptorBufferInfo buffInfo {
-		.buffer = uniformBuffer.buffer(),
-		.offset = 0,
-		.range = sizeof(UniformBufferObject)
-	};
-	vk::WriteDescriptorSet writes {
-		.dstSet = dstSet,
-		.dstBinding = 0,
-		.dstArrayElement = frameIdx,
-		.descriptorCount = 1,
-		.descriptorType = vk::DescriptorType::eUniformBuffer,
-		.pBufferInfo = &buffInfo
-	};
-	gpu.device.updateDescriptorSets(writes, nullptr);
+	cmdBuffers = std::move(*cmdBuffExpected);
+	recordedKeys.assign(swapchainImgCount, 0);
 }
 
 void SyncContext::create(vk::raii::Device& device, std::uint32_t swapchainImgCount) {
@@ -597,10 +788,11 @@ void SyncContext::create(vk::raii::Device& device, std::uint32_t swapchainImgCou
 	}
 }
 
-void SyncContext::wait_for_frame(vk::raii::Device& device, std::uint64_t frameCount) const {
+void SyncContext::wait_for_frame(vk::raii::Device& device, std::uint64_t frameCount, std::uint32_t framesInFlight) const {
+	ProfileZone zone("wait_for_frame");
 	uint64_t waitValue = 0;
-	if (frameCount > MAX_FRAMES_IN_FLIGHT) {
-		waitValue = frameCount - MAX_FRAMES_IN_FLIGHT;
+	if (frameCount > framesInFlight) {
+		waitValue = frameCount - framesInFlight;
 	}
 	vk::SemaphoreWaitInfo waitInfo = {
 		.semaphoreCount = 1,
@@ -8,11 +8,14 @@ module;
 #include <glm/gtx/hash.hpp>
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tiny_obj_loader.h>
+#define CGLTF_IMPLEMENTATION
+#include <cgltf.h>
 #include <vk_mem_alloc.h>
 
 export module velo;
 import std;
 import vulkan_hpp;
+import velo_archive;
 
 #define VULKAN_HPP_DISABLE_IMPLICIT_RESULT_VALUE_CAST
 
@@ -33,12 +36,45 @@ const std::vector<const char*> requiredDeviceExtensions = {
 };
 
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
-constexpr int MAX_OBJECTS = 100;
-constexpr int MAX_TEXTURES = 100;
-constexpr int MAX_MATERIALS = 4;
+/// first block of each frame's linear allocator, more blocks are chained on if a frame ever needs them
+constexpr vk::DeviceSize FRAME_ALLOCATOR_BLOCK_SIZE = 1 << 20;
+/// CPU scratch for containers that only live inside draw_frame(), overflow falls back to the heap
+constexpr std::size_t FRAME_ARENA_SIZE = 256 * 1024;
+/// frames before heap allocations in draw_frame() count against the zero allocation target
+constexpr std::uint64_t ALLOC_WARMUP_FRAMES = 120;
+/// timestamp scopes per frame (and in flight uploads), each takes two queries
+constexpr std::uint32_t GPU_PROFILER_MAX_SCOPES = 32;
+/// zones kept per thread, older ones are overwritten
+constexpr std::uint32_t TRACE_RING_SIZE = 1u << 16;
+/// trace track the GPU scopes are put on, threads count up from 0
+constexpr std::uint32_t TRACE_GPU_TRACK = 1000;
+const std::string TRACE_PATH = "velo_trace.json";
+/// frames of history the overlay graphs and takes percentiles over
+constexpr std::uint32_t OVERLAY_HISTORY = 240;
+/// upper bound for the bindless texture array, the actual capacity comes from device limits
+constexpr std::uint32_t BINDLESS_MAX_TEXTURES = 1u << 16;
+constexpr std::uint32_t BINDLESS_MAX_SAMPLERS = 32;
+constexpr int MAX_MATERIALS = 1024;
+/// small textures share one atlas image instead of an image (and a bindless slot) each
+constexpr std::uint32_t ATLAS_SIZE = 2048;
+constexpr std::uint32_t ATLAS_MAX_ENTRY_SIZE = 256;
+/// replicated edge texels around each entry, also the placement alignment
+constexpr std::uint32_t ATLAS_PADDING = 4;
+/// padding >> (levels - 1) stays >= 1, so no level blends neighbouring entries
+constexpr std::uint32_t ATLAS_MIP_LEVELS = 3;
+constexpr std::uint32_t GEOMETRY_ARENA_VERTICES = 1u << 20;
+constexpr std::uint32_t GEOMETRY_ARENA_INDICES = 1u << 22;
 
 constexpr std::uint32_t WIDTH = 800;
 constexpr std::uint32_t HEIGHT = 600;
+const glm::vec3 CAMERA_EYE = {0.0f, 3.0f, 7.0f};
+constexpr float CAMERA_FOV = 45.0f;
+/// textures start out at the first mip no larger than this, finer levels are streamed in on demand
+constexpr std::uint32_t TEXTURE_STREAM_START_SIZE = 64;
+/// frames between giving back one budget-dropped mip level while heaps have headroom
+constexpr std::uint32_t TEXTURE_BUDGET_RELAX_FRAMES = 240;
+/// with VELO_PREPASS_AB the depth pre-pass flips every this many frames, the profiler summary then has both variants
+constexpr std::uint32_t DEPTH_PREPASS_BENCH_FRAMES = 256;
 #if defined(CODAM)
 	const std::string MODEL_PATH = "/home/omathot/dev/cpp/velo/models/teapot2.obj";
 	const std::string TEXTURE_PATH = "/home/omathot/dev/cpp/velo/textures/teapot2.mtl";
@@ -46,13 +82,66 @@ constexpr std::uint32_t HEIGHT = 600;
 	const std::string MODEL_PATH = "/home/omathot/dev/cpp/velo/models/viking_room.obj";
 	const std::string TEXTURE_PATH = "/home/omathot/dev/cpp/velo/textures/viking_room.png";
 #endif
+const std::string MODEL_DIR = "/home/omathot/dev/cpp/velo/models/";
 const std::string SHADER_PATH = "/home/omathot/dev/cpp/velo/shaders/shader.spv";
+const std::string UPSAMPLE_SHADER_PATH = "/home/omathot/dev/cpp/velo/shaders/upsample.spv";
+
+enum class UpsampleMode : std::uint8_t {
+	/// jittered projection, reprojected history clamped to the current neighbourhood
+	eTemporal,
+	/// bilinear from the render resolution, no jitter and no history
+	eSpatial
+};
+
+enum class CaptureFormat : std::uint8_t {
+	ePng,
+	/// tightly packed rgba8, no encoding cost
+	eRaw
+};
 
 struct VeloContext {
 	bool should_quit{};
 	bool enabled_codam{};
 	bool enabled_x11{};
 	bool fetch_infos{};
+	bool use_descriptor_buffer{};
+	bool reuse_cmd_buffers{};
+	bool track_allocs{};
+	bool write_trace{};
+	bool hot_reload{};
+	bool dynamic_resolution{};
+	bool depth_prepass{};
+	/// VELO_PREPASS_AB, flips the depth pre-pass every DEPTH_PREPASS_BENCH_FRAMES frames
+	bool prepass_ab{};
+	/// VELO_TARGET_MS, GPU frame time dynamic resolution holds
+	float target_frame_ms = 1000.0f / 60.0f;
+	/// VELO_UPSAMPLE=temporal|spatial
+	UpsampleMode upsample_mode = UpsampleMode::eTemporal;
+	/// VELO_RECORD_INPUT / VELO_REPLAY_INPUT, empty when unset
+	std::string record_input;
+	std::string replay_input;
+	/// VELO_REPLAY_DT, 0 replays the recorded dt
+	float replay_dt{};
+	/// VELO_FRAMES, quits after that many frames, 0 runs until closed
+	std::uint64_t frame_limit{};
+	/// VELO_ALLOC_CHECK, the exit code reports steady state heap allocations (ALLOC_TRACKING builds only)
+	bool alloc_check{};
+	/// VELO_STRESS, generator spec (see parse_stress_scene), empty loads the regular model
+	std::string stress_scene;
+	/// VELO_MODEL, a .glb/.gltf loaded instead of the obj
+	std::string model_path;
+	/// VELO_ARCHIVE, assets found in it are read from there instead of the loose files
+	std::string archive_path = "velo.vpak";
+	/// VELO_STREAM_IMPORT=<MiB>, forces the bounded memory obj import with that budget
+	bool stream_import{};
+	/// models larger than this take the streaming import even when it isn't forced
+	std::uint64_t import_budget = 256ull << 20;
+	/// VELO_CAPTURE, directory presented frames are written to, empty when not capturing
+	std::string capture_dir;
+	/// VELO_CAPTURE_FORMAT=png|raw
+	CaptureFormat capture_format = CaptureFormat::ePng;
+	/// VELO_CAPTURE_FRAMES, frames to write (dropped ones not counted), 0 captures until exit
+	std::uint64_t capture_frames{};
 
 	vk::PhysicalDeviceFeatures deviceFeatures{};
 	vk::PhysicalDeviceProperties deviceProperties{};
@@ -63,6 +152,15 @@ struct VeloContext {
 
 	void enable_codam();
 	void enable_x11();
+	void enable_descriptor_buffer();
+	void enable_cmd_reuse();
+	void enable_alloc_tracking();
+	void enable_trace();
+	void enable_hot_reload();
+	void enable_dynamic_resolution();
+	void enable_depth_prepass();
+	/// VELO_* environment variables, for settings that change from run to run
+	void read_env();
 	bool is_info_gathered();
 	void gather_features_info();
 	void gather_extensions_info();
@@ -74,20 +172,6 @@ struct Vertex {
 	glm::vec3 color{};
 	glm::vec2 texCoord{};
 
-	static vk::VertexInputBindingDescription get_bindings_description() {
-		return {
-			.binding = 0,
-			.stride = sizeof(Vertex),
-			.inputRate = vk::VertexInputRate::eVertex};
-		};
-	static std::array<vk::VertexInputAttributeDescription, 3> get_attribute_description() {
-		return {
-			vk::VertexInputAttributeDescription(0, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, pos)),
-			vk::VertexInputAttributeDescription(1, 0, vk::Format::eR32G32B32Sfloat, offsetof(Vertex, color)),
-	        vk::VertexInputAttributeDescription(2, 0, vk::Format::eR32G32Sfloat, offsetof(Vertex, texCoord)),
-		};
-	}
-
 	bool operator==(const Vertex &other) const {
 		return pos == other.pos &&
 				color == other.color &&
@@ -119,19 +203,41 @@ public:
 	[[nodiscard]] vk::Buffer buffer() const;
 	[[nodiscard]] VmaAllocation allocation() const;
 	[[nodiscard]] void* mapped_data() const;
+	[[nodiscard]] vk::DeviceSize size() const { return _size; }
+
+	/// new buffer with identical parameters bound to memory (defragmentation destination)
+	[[nodiscard]] VkBuffer create_alias(VmaAllocation memory) const;
+	/// swaps in a buffer bound to this allocation's (moved) memory, returns the old handle to destroy
+	[[nodiscard]] VkBuffer swap_handle(VkBuffer newBuffer);
+	/// gives up ownership without destroying anything
+	void release();
 
 private:
 	VmaAllocator vmaAllocator = VK_NULL_HANDLE;
 	VkBuffer _buffer = VK_NULL_HANDLE;
 	VmaAllocation vmaAllocation = VK_NULL_HANDLE;
 	void* mapped{};
+	vk::DeviceSize _size{};
+	vk::BufferUsageFlags _usage{};
 };
 
+/// read through a buffer device address, so any per-frame allocation can hold one
 struct UniformBufferObject {
 	alignas(16) glm::mat4 model;
 	alignas(16) glm::mat4 view;
 	alignas(16) glm::mat4 proj;
+	/// last frame's unjittered proj * view * model, for motion vectors
+	alignas(16) glm::mat4 prevMvp;
+	/// xy: subpixel offset added to clip space positions, in NDC units
+	alignas(16) glm::vec4 jitter;
 };
+[[nodiscard]] UniformBufferObject make_view_uniforms(glm::vec3 position, float angle, vk::Extent2D extent, glm::vec3 eye, float farPlane);
+
+/// per instance data read by vertMain through a device address, indexed by the instance index
+struct GpuInstance {
+	glm::mat4 model{1.0f};
+};
+static_assert(sizeof(GpuInstance) == 64);
 
 class VmaImage {
 public:
@@ -158,28 +264,123 @@ public:
 	[[nodiscard]] vk::Image image() const;
 	[[nodiscard]] VmaAllocation allocation() const;
 	[[nodiscard]] void* mapped_data() const;
+	[[nodiscard]] vk::Extent2D extent() const { return {.width = _width, .height = _height}; }
+	[[nodiscard]] std::uint32_t mip_levels() const { return _mipLvls; }
+	[[nodiscard]] vk::Format format() const { return _format; }
+
+	/// new image with identical parameters bound to memory (defragmentation destination)
+	[[nodiscard]] VkImage create_alias(VmaAllocation memory) const;
+	/// swaps in an image bound to this allocation's (moved) memory, returns the old handle to destroy
+	[[nodiscard]] VkImage swap_handle(VkImage newImage);
+	/// gives up ownership without destroying anything
+	void release();
 
 private:
 	VmaAllocator vmaAllocator = VK_NULL_HANDLE;
 	VkImage _image = VK_NULL_HANDLE;
 	VmaAllocation vmaAllocation = VK_NULL_HANDLE;
 	void* mapped{};
+	std::uint32_t _width{};
+	std::uint32_t _height{};
+	std::uint32_t _mipLvls{};
+	vk::Format _format = vk::Format::eUndefined;
+	vk::ImageUsageFlags _usage{};
 };
 
+/// vertex layout as pulled by vertMain from the arena storage buffer (std430)
+struct GpuVertex {
+	glm::vec4 posU{};
+	glm::vec4 colorV{};
+};
+static_assert(sizeof(GpuVertex) == 32);
+/// staging layout of vertices, dst must hold vertices.size() elements
+void write_gpu_vertices(std::span<const Vertex> vertices, GpuVertex* dst);
+
+/// suballocation of the geometry arena, offsets are in elements not bytes
 struct Mesh {
-	VmaBuffer vertexBuff;
-	VmaBuffer indexBuff;
+	std::uint32_t vertexOffset{};
+	std::uint32_t firstIndex{};
 	std::uint32_t indexCount{};
+	std::uint32_t vertexCount{};
+};
+
+/// contiguous index range of one mesh, drawn with a single material
+struct Submesh {
+	std::uint32_t mesh{};
+	/// relative to the mesh's firstIndex
+	std::uint32_t firstIndex{};
+	std::uint32_t indexCount{};
+	std::uint32_t material{};
+	/// range in the instance buffer, every instance is drawn with this submesh's material
+	std::uint32_t firstInstance{};
+	std::uint32_t instanceCount = 1;
+};
+
+/// key is pipeline | material | mesh from most to least significant, sorting it minimizes state changes
+struct DrawItem {
+	std::uint64_t key{};
+	std::uint32_t submesh{};
+};
+
+[[nodiscard]] constexpr std::uint64_t draw_key(std::uint32_t pipeline, std::uint32_t material, std::uint32_t mesh) {
+	return (static_cast<std::uint64_t>(pipeline & 0xFFu) << 56) | (static_cast<std::uint64_t>(material & 0xFFFFFFu) << 32) | mesh;
+}
+
+/// dedups the obj's (position, uv) corners into vertices, appends to both outputs
+void weld_obj_vertices(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
+/// reorders triangles so each material's faces are contiguous (stable), returns one submesh per material used
+std::vector<Submesh> group_faces_by_material(std::vector<std::uint32_t>& indices, std::span<const std::uint32_t> faceMaterials, std::uint32_t mesh);
+/// LSD radix sort on DrawItem::key, 8 bits a pass, passes where every key shares the byte are skipped
+void radix_sort_draws(std::vector<DrawItem>& items, std::vector<DrawItem>& scratch);
+
+/// first-fit range allocator, free ranges are keyed by offset so freeing coalesces with both neighbours
+class OffsetAllocator {
+public:
+	OffsetAllocator() = default;
+	explicit OffsetAllocator(std::uint64_t size);
+	[[nodiscard]] std::optional<std::uint64_t> allocate(std::uint64_t size, std::uint64_t alignment = 1);
+	void free(std::uint64_t offset, std::uint64_t size);
+
+	[[nodiscard]] std::uint64_t capacity() const { return _capacity; }
+	[[nodiscard]] std::uint64_t used() const { return _used; }
+	[[nodiscard]] std::uint64_t largest_free() const;
+	[[nodiscard]] std::size_t fragment_count() const { return freeRanges.size(); }
+
+private:
+	std::uint64_t _capacity{};
+	std::uint64_t _used{};
+	/// offset -> size
+	std::map<std::uint64_t, std::uint64_t> freeRanges;
+};
+
+/// material parameters as read by fragMain (std430)
+struct GpuMaterial {
+	glm::vec4 baseColor{1.0f};
+	/// offset in xy, scale in zw, maps the mesh uvs into an atlas entry
+	glm::vec4 uvRect{0.0f, 0.0f, 1.0f, 1.0f};
+};
+static_assert(sizeof(GpuMaterial) == 32);
+
+enum class MaterialTexture {
+	eNone,
+	eAtlas,
+	eStreamed
 };
 
 struct Material {
-	VmaImage image;
-	vk::raii::ImageView view{nullptr};
+	GpuMaterial params;
+	MaterialTexture texture = MaterialTexture::eNone;
 };
 
 struct PushConstants {
-	std::uint32_t objIdx{};
+	/// UniformBufferObject in this frame's linear allocator
+	vk::DeviceAddress view{};
+	/// GpuInstance array, one buffer for the whole scene
+	vk::DeviceAddress instances{};
+	std::uint32_t materialIdx{};
+	/// bindless texture slot of the draw's material, UINT32_MAX for flat colors
 	std::uint32_t textureidx{};
+	std::uint32_t samplerIdx{};
 };
 
 struct GpuContext {
@@ -193,12 +394,21 @@ struct GpuContext {
 	std::uint32_t presentIdx{};
 	VmaAllocator allocator{};
 	vk::raii::CommandPool cmdPool{nullptr};
+	/// VK_EXT_descriptor_buffer is enabled whenever the device has it
+	bool descriptorBufferSupported{};
+	vk::PhysicalDeviceDescriptorBufferPropertiesEXT descriptorBufferProps{};
+	/// pipelineStatisticsQuery is enabled whenever the device has it
+	bool pipelineStatsSupported{};
+	/// nanoseconds per timestamp tick, 0 when the graphics queue can't write timestamps
+	float timestampPeriod{};
 
 	// vk::raii::CommandBuffer begin_immediate();
 	// void end_immediate(vk::raii::CommandBuffer& cmd);
 	vk::raii::CommandBuffer begin_single_time_commands();
 	void end_single_time_commands(vk::raii::CommandBuffer& cmdBuff) const;
-	void copy_buffer(VmaBuffer& srcBuff, VmaBuffer& dstBuff, vk::DeviceSize size);
+	/// ends and submits without waiting, later submits on the graphics queue are ordered after it
+	void submit_single_time_commands(vk::raii::CommandBuffer& cmdBuff) const;
+	void copy_buffer(VmaBuffer& srcBuff, VmaBuffer& dstBuff, vk::DeviceSize size, vk::DeviceSize dstOffset = 0);
 
 	void create_instance(vk::raii::Context& context, VeloContext& config);
 	void create_surface(GLFWwindow* window);
@@ -214,37 +424,760 @@ struct SwapchainContext {
 	std::vector<vk::Image> images;
 	std::vector<vk::raii::ImageView> imageViews;
 	vk::Format format = vk::Format::eUndefined;
+	vk::Format depthFormat = vk::Format::eUndefined;
 	vk::Extent2D extent{};
-	VmaImage depthImage;
-	vk::raii::ImageView depthView{nullptr};
+	/// color attachment, plus transfer src/dst when the surface allows it (frame capture, dynamic resolution)
+	vk::ImageUsageFlags usage{};
+	/// bumped by recreate(), anything recorded against the old images is stale
+	std::uint32_t generation{};
+	/// used when the surface supports it, FIFO otherwise
+	vk::PresentModeKHR preferredPresentMode = vk::PresentModeKHR::eMailbox;
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eFifo;
+	std::vector<vk::PresentModeKHR> presentModes;
 	void create(GLFWwindow* window, GpuContext& gpu);
 	void recreate(GLFWwindow* window, GpuContext& gpu);
 	void cleanup();
 
 	void create_image_views(vk::raii::Device& device);
-	void create_depth_resources(GpuContext& gpu);
 	static vk::Format find_depth_format(vk::raii::PhysicalDevice& physicalDevice);
 };
 
+struct DescriptorContext;
+
+/// slot in one of the bindless arrays, the generation catches use after release
+struct BindlessHandle {
+	std::uint32_t index = UINT32_MAX;
+	std::uint32_t generation{};
+
+	[[nodiscard]] bool valid() const { return index != UINT32_MAX; }
+};
+
+/// free list slot allocator, released slots only come back once no frame in flight can read them
+class BindlessSlots {
+public:
+	BindlessSlots() = default;
+	explicit BindlessSlots(std::uint32_t capacity) : _capacity(capacity) {}
+
+	[[nodiscard]] BindlessHandle allocate();
+	void release(BindlessHandle handle, std::uint64_t lastUseValue);
+	void recycle(std::uint64_t completedValue);
+	[[nodiscard]] bool alive(BindlessHandle handle) const;
+
+	[[nodiscard]] std::uint32_t capacity() const { return _capacity; }
+	[[nodiscard]] std::uint32_t used() const { return _used; }
+
+private:
+	std::uint32_t _capacity{};
+	std::uint32_t _used{};
+	std::vector<std::uint32_t> generations;
+	std::vector<std::uint32_t> freeList;
+	std::deque<std::pair<std::uint64_t, std::uint32_t>> retiring;
+};
+
+/*
+	Texture (binding 4) and sampler (binding 1) arrays of the global set.
+	Capacities come from the device's update after bind limits, the texture array is the set's variable
+	count binding. Writes are queued and land in a single updateDescriptorSets (or one pass of
+	getDescriptorEXT on the descriptor buffer backend) per frame from flush().
+*/
+class BindlessTable {
+public:
+	void query_limits(const vk::raii::PhysicalDevice& physicalDevice);
+	void reserve(std::uint32_t textureCap, std::uint32_t samplerCap);
+	[[nodiscard]] BindlessHandle add_texture(vk::ImageView view);
+	[[nodiscard]] BindlessHandle add_sampler(vk::Sampler sampler);
+	void release_texture(BindlessHandle handle, std::uint64_t lastUseValue);
+	void release_sampler(BindlessHandle handle, std::uint64_t lastUseValue);
+	/// call once per frame after the timeline wait, before recording
+	void flush(GpuContext& gpu, DescriptorContext& descriptors, std::uint64_t completedValue);
+	/// released slots the timeline is done with go back on the free lists, flush() does this first
+	void recycle(std::uint64_t completedValue);
+	/// turns the queued writes into set updates against set, the queue is empty afterwards
+	[[nodiscard]] std::span<const vk::WriteDescriptorSet> prepare_set_writes(vk::DescriptorSet set);
+
+	[[nodiscard]] std::uint32_t texture_capacity() const { return textures.capacity(); }
+	[[nodiscard]] std::uint32_t sampler_capacity() const { return samplers.capacity(); }
+	[[nodiscard]] std::uint32_t texture_count() const { return textures.used(); }
+
+private:
+	struct PendingWrite {
+		std::uint32_t binding{};
+		std::uint32_t index{};
+		vk::ImageView view;
+		vk::Sampler sampler;
+	};
+	BindlessSlots textures;
+	BindlessSlots samplers;
+	std::vector<PendingWrite> pending;
+	std::vector<vk::DescriptorImageInfo> imageInfos;
+	std::vector<vk::WriteDescriptorSet> writes;
+
+	void drop_pending(std::uint32_t binding, std::uint32_t index);
+};
+
+enum class DescriptorBackend : std::uint8_t {
+	eSets,
+	/// VK_EXT_descriptor_buffer, descriptors written straight into mapped memory
+	eBuffer
+};
+
+/*
+	The one global set, same shader side interface on both backends.
+	eSets allocates it from a pool and writes through updateDescriptorSets, eBuffer keeps it in a host
+	visible buffer written with getDescriptorEXT and bound with bindDescriptorBuffersEXT.
+*/
 struct DescriptorContext {
+	DescriptorBackend backend = DescriptorBackend::eSets;
 	vk::raii::DescriptorSetLayout layout{nullptr};
 	vk::raii::DescriptorPool pool{nullptr};
 	vk::raii::DescriptorSet set{nullptr};
+	VmaBuffer descriptorBuff;
+	vk::DeviceAddress descriptorBuffAddress{};
+	std::array<vk::DeviceSize, 5> bindingOffsets{};
 
-	void create_layout(vk::raii::Device& device);
-	void create_pool(vk::raii::Device& device);
-	void create_set(vk::raii::Device& device);
+	void create_layout(vk::raii::Device& device, const BindlessTable& bindless);
+	void create_pool(vk::raii::Device& device, const BindlessTable& bindless);
+	void create_set(vk::raii::Device& device, const BindlessTable& bindless);
+	void create_buffer(GpuContext& gpu);
+	void write_buffer(GpuContext& gpu, std::uint32_t binding, std::uint32_t element, vk::DescriptorType type, const VmaBuffer& buff, vk::DeviceSize range);
+	/// eBuffer only, sampled image if view is set, sampler otherwise
+	void write_image(GpuContext& gpu, std::uint32_t binding, std::uint32_t element, vk::ImageView view, vk::Sampler sampler);
+	void bind(vk::raii::CommandBuffer& cmd, vk::PipelineLayout pipelineLayout) const;
+	[[nodiscard]] vk::PipelineCreateFlags pipeline_flags() const;
 };
 
-struct FrameContext {
+/// every mesh lives in one device local vertex + index buffer pair, one bind for the whole frame
+struct GeometryArena {
+	VmaBuffer vertexBuff;
+	VmaBuffer indexBuff;
+	/// tightly packed positions at the same element offsets as vertexBuff, fed to the depth pre-pass as vertex input
+	VmaBuffer positionBuff;
+	OffsetAllocator vertexAlloc;
+	OffsetAllocator indexAlloc;
+	/// hands the recorded copies off without waiting (Velo::submit_upload), unset uploads wait for the queue
+	std::function<void(vk::raii::CommandBuffer&&, VmaBuffer&&)> submit;
+
+	void create(GpuContext& gpu, DescriptorContext& descriptors);
+	Mesh upload(GpuContext& gpu, std::span<const Vertex> vertices, std::span<const std::uint32_t> indices);
+	/// fill writes straight into the mapped staging buffer, vertices then indices
+	Mesh upload(GpuContext& gpu, std::size_t vertexCount, std::size_t indexCount, const std::function<void(GpuVertex*, std::uint32_t*)>& fill);
+	void release(const Mesh& mesh);
+	void destroy();
+};
+
+/// runs destructors once the timeline has passed the last value that could still use the object
+struct DeletionQueue {
+	std::deque<std::pair<std::uint64_t, std::move_only_function<void()>>> pending;
+
+	void retire(std::uint64_t lastUseValue, std::move_only_function<void()> fn);
+	void flush(std::uint64_t completedValue);
+	void flush_all();
+};
+
+/// resource VMA is allowed to move, onMoved rewrites whatever referenced the old handle (views, descriptors)
+struct DefragTarget {
+	VmaBuffer* buffer{};
+	VmaImage* image{};
+	std::function<void()> onMoved;
+};
+
+/*
+	Incremental defragmentation on top of VMA's pass API.
+	A pass copies at most maxBytesPerPass on its own command buffer, handles are switched once the copy
+	fence signals and the old memory is only released once every frame that could read it has retired.
+	Only tracked allocations move, everything else is ignored.
+*/
+class DefragService {
+public:
+	vk::DeviceSize maxBytesPerPass = 8ull << 20;
+	std::uint32_t maxAllocationsPerPass = 64;
+	/// frames between automatic runs, 0 to only run on start()
+	std::uint64_t intervalFrames = 3600;
+
+	void create(GpuContext& gpu);
+	void track(VmaAllocation allocation, DefragTarget target);
+	void forget(VmaBuffer& buffer);
+	void forget(VmaImage& image);
+	void start(GpuContext& gpu);
+	/// advances the current run by at most one stage, call once per frame after the timeline wait
+	void step(GpuContext& gpu, std::uint64_t timelineValue, std::uint64_t completedValue);
+	/// transient containers of a pass come from here
+	std::pmr::memory_resource* scratch = std::pmr::get_default_resource();
+	void destroy(GpuContext& gpu);
+
+	[[nodiscard]] bool active() const { return ctx != VK_NULL_HANDLE; }
+	[[nodiscard]] const VmaDefragmentationStats& totals() const { return lifetimeStats; }
+
+private:
+	enum class State : std::uint8_t {
+		eIdle,
+		eCopying,
+		eRetiring
+	};
+	struct PendingMove {
+		std::uint32_t moveIdx{};
+		VkBuffer newBuffer = VK_NULL_HANDLE;
+		VkImage newImage = VK_NULL_HANDLE;
+		VkBuffer oldBuffer = VK_NULL_HANDLE;
+		VkImage oldImage = VK_NULL_HANDLE;
+	};
+
+	State state = State::eIdle;
+	VmaDefragmentationContext ctx = VK_NULL_HANDLE;
+	VmaDefragmentationPassMoveInfo passInfo{};
+	std::unordered_map<VmaAllocation, DefragTarget> targets;
+	std::vector<PendingMove> pending;
 	vk::raii::CommandBuffer cmdBuffer{nullptr};
+	vk::raii::Fence fence{nullptr};
+	std::uint64_t retireValue{};
+	std::uint64_t lastRunFrame{};
+	VmaDefragmentationStats lifetimeStats{};
+	std::uint32_t passCount{};
+
+	void begin_pass(GpuContext& gpu);
+	void switch_handles(std::uint64_t timelineValue);
+	void end_pass(GpuContext& gpu);
+	void finish(GpuContext& gpu);
+};
+
+enum class AssetKind : std::uint8_t {
+	eMesh,
+	eTexture
+};
+using AssetId = std::uint32_t;
+constexpr AssetId INVALID_ASSET = UINT32_MAX;
+
+struct ResidentAsset {
+	std::string name;
+	AssetKind kind{};
+	vk::DeviceSize bytes{};
+	std::uint64_t lastUsedFrame{};
+	bool resident{};
+	/// (re)creates the GPU side of the asset, returns how many bytes it now occupies
+	std::function<vk::DeviceSize()> load;
+	std::function<void()> evict;
+	/// optional, drops detail (finest mip) instead of the whole asset, returns bytes freed or 0 once there is nothing left to drop
+	std::function<vk::DeviceSize()> trim;
+};
+
+/*
+	Tracks GPU memory per asset and keeps device local heaps under budget.
+	Once usage crosses highWatermark of the VMA reported budget, trimmable assets first drop detail,
+	then least recently used assets that no frame in flight can still reference are evicted until usage
+	drops to lowWatermark.
+	Evicted assets come back on the next touch().
+*/
+class ResidencyManager {
+public:
+	float highWatermark = 0.90f;
+	float lowWatermark = 0.75f;
+	/// eviction bookkeeping comes from here
+	std::pmr::memory_resource* scratch = std::pmr::get_default_resource();
+
+	AssetId register_asset(std::string name, AssetKind kind, std::function<vk::DeviceSize()> load, std::function<void()> evict, std::function<vk::DeviceSize()> trim = {});
+	/// marks the asset as used by frame, reloading it if it was evicted
+	void touch(AssetId id, std::uint64_t frame);
+	/// polls heap budgets, call once per frame after the frame's timeline wait
+	void update(GpuContext& gpu, std::uint64_t frame);
+	void dump_stats(GpuContext& gpu, const std::filesystem::path& path) const;
+	/// for assets whose footprint changes while resident (streamed mips)
+	void update_bytes(AssetId id, vk::DeviceSize bytes) { assets[id].bytes = bytes; }
+
+	[[nodiscard]] vk::DeviceSize resident_bytes() const;
+	/// every device local heap is under lowWatermark
+	[[nodiscard]] bool has_headroom() const;
+	[[nodiscard]] std::span<const VmaBudget> heap_budgets() const { return {budgets.data(), heapCount}; }
+	[[nodiscard]] std::uint64_t eviction_count() const { return evictions; }
+
+private:
+	std::vector<ResidentAsset> assets;
+	std::array<VmaBudget, VK_MAX_MEMORY_HEAPS> budgets{};
+	std::array<bool, VK_MAX_MEMORY_HEAPS> deviceLocal{};
+	/// over the high watermark with nothing left to evict, reported once until the heap drops back under it
+	std::array<bool, VK_MAX_MEMORY_HEAPS> stuckOverBudget{};
+	std::uint32_t heapCount{};
+	std::uint64_t currentFrame{};
+	std::uint64_t evictions{};
+
+	/// evicts LRU assets until bytes are freed, returns bytes actually freed
+	vk::DeviceSize evict_lru(vk::DeviceSize bytes);
+};
+
+/*
+	A texture's mip chain (RGBA8, level 0 is full res), decoded from the encoded file when a level is needed.
+	Only the coarse tail from tailMip on stays on the CPU, finer levels are decoded on a worker, uploaded and
+	dropped again. The image holds levels [allocatedMip, mip_count()), it's only reallocated when demand goes
+	finer than that or the budget trims it, so dropped mips still give their memory back.
+	allocatedMip <= uploadedMip <= residentMip, levels below uploadedMip hold nothing.
+*/
+struct StreamedTexture {
+	/// the png/jpg as read, shared with decode workers
+	std::shared_ptr<const std::vector<std::byte>> encoded;
+	/// per level, empty when not on the CPU
+	std::vector<std::vector<std::uint8_t>> mips;
+	vk::Extent2D extent{};
+	/// first level that always stays on the CPU, at most TEXTURE_STREAM_START_SIZE
+	std::uint32_t tailMip{};
+	/// finest level textureImage has memory for, mip_count() without an image
+	std::uint32_t allocatedMip{};
+	/// finest level uploaded to the image
+	std::uint32_t uploadedMip{};
+	/// finest level sampled (the view's base), mip_count() when nothing is resident
+	std::uint32_t residentMip{};
+	/// finest level the screen needs right now
+	std::uint32_t wantedMip{};
+	/// finest level the memory budget allows, raised by trims under pressure
+	std::uint32_t budgetMip{};
+	std::uint32_t lastBudgetChange{};
+	/// worker decoding levels [decodeMip, tailMip)
+	std::optional<std::future<std::vector<std::vector<std::uint8_t>>>> decode;
+	std::uint32_t decodeMip{};
+
+	/// encoded is the png/jpg file, name is only for the log; decodes the tail, finer levels come from request()
+	void load(std::span<const std::byte> file, const std::string& name);
+	/// starts decoding [mip, tailMip) on a worker unless mip is already on the CPU or a decode is running
+	void request(std::uint32_t mip);
+	/// moves a finished decode into mips, never waits
+	void poll();
+	[[nodiscard]] bool loaded() const { return !mips.empty(); }
+	[[nodiscard]] bool on_cpu(std::uint32_t mip) const { return !mips[mip].empty(); }
+	[[nodiscard]] std::uint32_t mip_count() const { return static_cast<std::uint32_t>(mips.size()); }
+	[[nodiscard]] vk::Extent2D mip_extent(std::uint32_t mip) const {
+		return {.width = std::max(1u, extent.width >> mip), .height = std::max(1u, extent.height >> mip)};
+	}
+};
+
+/// 2x2 box filter of an rgba8 level, done in srgb space
+std::vector<std::uint8_t> downsample_rgba(std::span<const std::uint8_t> src, vk::Extent2D srcExtent);
+
+struct AtlasRect {
+	std::uint32_t x{};
+	std::uint32_t y{};
+	std::uint32_t width{};
+	std::uint32_t height{};
+};
+
+/// read only mapping of a whole file, loaders read straight out of it instead of going through a std::vector
+class MappedFile {
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::filesystem::path& path);
+	~MappedFile();
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	[[nodiscard]] std::span<const std::byte> bytes() const { return {static_cast<const std::byte*>(_data), _size}; }
+	[[nodiscard]] std::size_t size() const { return _size; }
+	/// drops the resident pages of [offset, offset + length), the next read faults them back in from the file
+	void release(std::size_t offset, std::size_t length) const;
+
+private:
+	void* _data{};
+	std::size_t _size{};
+};
+
+/// velo_pack output, mapped once: header, entry data, toc, name table
+class AssetArchive {
+public:
+	/// false when path doesn't exist, throws when it isn't a valid archive
+	bool open(const std::filesystem::path& path);
+	[[nodiscard]] bool is_open() const { return !entries.empty(); }
+	/// the asset at path, from the archive when it has it and the loose file otherwise, valid until drop_cache()
+	std::span<const std::byte> load(const std::string& path);
+	/// decompresses these assets on one thread each, load() then only looks them up
+	void prefetch(std::span<const std::string> paths);
+	/// frees decompressed and loose copies, stored entries stay in the mapping
+	void drop_cache();
+
+private:
+	MappedFile file;
+	std::vector<ArchiveEntry> entries;
+	std::string_view names;
+	std::unordered_map<std::string, std::vector<std::byte>> cache;
+
+	[[nodiscard]] const ArchiveEntry* find(std::string_view name) const;
+	[[nodiscard]] std::vector<std::byte> decompress(const ArchiveEntry& entry) const;
+};
+
+struct StreamImportStats {
+	std::uint64_t triangles{};
+	std::uint64_t vertices{};
+	std::uint32_t chunks{};
+	std::uint32_t cells{};
+	/// of the positions, for framing the camera
+	float radius{};
+};
+
+/// obj import in bounded memory, whatever the file size. Positions and uvs go to mapped scratch files,
+/// triangles are binned into a grid of spatial cells spilled to disk, and each cell is welded in chunks
+/// of a bounded triangle count that emit receives (and may upload) before the next one is built.
+StreamImportStats stream_import_obj(const std::filesystem::path& path, std::uint64_t budget, const std::function<void(std::span<const Vertex>, std::span<const std::uint32_t>)>& emit);
+
+/// inotify on the directories of a set of files, reports the watched files written or renamed into place
+class AssetWatcher {
+public:
+	AssetWatcher() = default;
+	~AssetWatcher();
+	AssetWatcher(const AssetWatcher&) = delete;
+	AssetWatcher& operator=(const AssetWatcher&) = delete;
+
+	void watch(std::span<const std::filesystem::path> files);
+	/// non blocking, each changed file at most once per call
+	[[nodiscard]] std::vector<std::filesystem::path> poll();
+	[[nodiscard]] bool active() const { return fd >= 0; }
+
+private:
+	int fd = -1;
+	std::unordered_map<int, std::filesystem::path> dirs;
+	std::unordered_set<std::string> files;
+};
+
+/// welded obj, built on a worker thread
+struct ReloadedMesh {
+	std::vector<Vertex> vertices;
+	std::vector<std::uint32_t> indices;
+};
+
+/// decodes off the render thread, the results are swapped in by the next frame
+struct HotReload {
+	AssetWatcher watcher;
+	std::optional<std::future<StreamedTexture>> texture;
+	std::optional<std::future<ReloadedMesh>> mesh;
+	/// changed again while its job was running, reloaded once more when it finishes
+	bool textureDirty{};
+	bool meshDirty{};
+	/// bumped on every swap, part of the command buffer reuse key
+	std::uint64_t generation{};
+};
+
+/// one triangle list of a glTF mesh, placed in the scene's single arena mesh
+struct GltfPrimitive {
+	const cgltf_primitive* source{};
+	std::uint32_t vertexBase{};
+	std::uint32_t vertexCount{};
+	/// relative to the arena mesh's firstIndex
+	std::uint32_t firstIndex{};
+	std::uint32_t indexCount{};
+};
+
+/// a parsed .glb/.gltf whose buffers point into mapped files, kept open so the geometry can be uploaded again
+class GltfScene {
+public:
+	GltfScene() = default;
+	~GltfScene();
+	GltfScene(const GltfScene&) = delete;
+	GltfScene& operator=(const GltfScene&) = delete;
+
+	void open(const std::filesystem::path& path);
+	/// every triangle primitive of the file as one arena mesh, indices rebased onto it
+	[[nodiscard]] Mesh upload(GpuContext& gpu, GeometryArena& geometry) const;
+	/// one submesh per primitive, drawn once per node that references its mesh
+	void build_draws(std::uint32_t mesh, std::uint32_t firstMaterial, std::vector<Submesh>& submeshes, std::vector<GpuInstance>& instances) const;
+	/// from the POSITION bounds under each node's world transform, no vertex is read
+	[[nodiscard]] float radius() const;
+	[[nodiscard]] const cgltf_data* data() const { return _data; }
+	[[nodiscard]] const std::filesystem::path& path() const { return _path; }
+	[[nodiscard]] std::uint32_t vertex_count() const { return vertexCount; }
+	[[nodiscard]] std::uint32_t index_count() const { return indexCount; }
+
+private:
+	std::filesystem::path _path;
+	MappedFile file;
+	/// .gltf buffers referenced by uri, .glb keeps its binary chunk in file
+	std::vector<MappedFile> externalBuffers;
+	cgltf_data* _data{};
+	std::vector<GltfPrimitive> primitives;
+	/// primitives of mesh i are [meshPrimitives[i], meshPrimitives[i + 1])
+	std::vector<std::uint32_t> meshPrimitives;
+	std::uint32_t vertexCount{};
+	std::uint32_t indexCount{};
+};
+
+/// shelf packer for small rgba8 textures, built on the CPU and uploaded with a single submit
+class TextureAtlas {
+public:
+	/// nullopt when the texture is too large to share or the atlas is full
+	std::optional<AtlasRect> add(std::span<const std::uint8_t> rgba, std::uint32_t width, std::uint32_t height);
+	[[nodiscard]] static glm::vec4 uv_rect(const AtlasRect& rect);
+	[[nodiscard]] bool empty() const { return entries == 0; }
+	[[nodiscard]] std::uint32_t entry_count() const { return entries; }
+	void upload(GpuContext& gpu);
+	void destroy();
+
+	VmaImage image;
+	vk::raii::ImageView view{nullptr};
+	BindlessHandle slot;
+
+private:
+	/// level 0, allocated on the first add
+	std::vector<std::uint8_t> pixels;
+	std::uint32_t shelfX{};
+	std::uint32_t shelfY{};
+	std::uint32_t shelfHeight{};
+	std::uint32_t entries{};
+};
+
+extern "C++" {
+/// global operator new totals, only counted by ALLOC_TRACKING builds (see alloc_hooks.cpp)
+struct AllocCounters {
+	std::uint64_t count{};
+	std::uint64_t bytes{};
+};
+AllocCounters alloc_counters() noexcept;
+}
+
+[[nodiscard]] constexpr AllocCounters operator-(const AllocCounters& lhs, const AllocCounters& rhs) {
+	return {.count = lhs.count - rhs.count, .bytes = lhs.bytes - rhs.bytes};
+}
+
+struct AllocZoneStats {
+	const char* name{};
+	AllocCounters frame;
+	AllocCounters total;
+};
+
+/// heap allocations per draw_frame() zone, fixed storage so the bookkeeping doesn't allocate itself
+class AllocStats {
+public:
+	void add(const char* zone, AllocCounters delta);
+	/// reports the frame's zones when a steady state frame touched the heap
+	void end_frame(std::uint64_t frame, AllocCounters delta);
+	void print() const;
+	[[nodiscard]] std::uint64_t allocating_frames() const { return allocatingFrames; }
+
+private:
+	std::array<AllocZoneStats, 16> zones{};
+	std::uint32_t zoneCount{};
+	std::uint64_t steadyFrames{};
+	std::uint64_t allocatingFrames{};
+	AllocCounters steadyTotal;
+};
+
+/// attributes allocations to whichever zone was entered last, closes the current one on destruction
+class AllocZoneScope {
+public:
+	explicit AllocZoneScope(AllocStats& allocStats) : stats(allocStats) {}
+	AllocZoneScope(const AllocZoneScope&) = delete;
+	AllocZoneScope& operator=(const AllocZoneScope&) = delete;
+	~AllocZoneScope() { close(); }
+	void enter(const char* zone) {
+		close();
+		current = zone;
+		start = alloc_counters();
+	}
+
+private:
+	AllocStats& stats;
+	const char* current{};
+	AllocCounters start;
+	void close() {
+		if (current) stats.add(current, alloc_counters() - start);
+		current = nullptr;
+	}
+};
+
+/// monotonic arena rewound at the top of every draw_frame(), for containers that die with the frame
+class FrameArena {
+public:
+	FrameArena() : storage(std::make_unique<std::byte[]>(FRAME_ARENA_SIZE)), resource(storage.get(), FRAME_ARENA_SIZE, std::pmr::new_delete_resource()) {}
+	[[nodiscard]] std::pmr::memory_resource* get() { return &resource; }
+	void reset() { resource.release(); }
+
+private:
+	std::unique_ptr<std::byte[]> storage;
+	std::pmr::monotonic_buffer_resource resource;
+};
+
+struct TraceEvent {
+	const char* name{};
+	std::uint64_t beginNs{};
+	std::uint64_t endNs{};
+	/// recording thread's index, or TRACE_GPU_TRACK
+	std::uint32_t track{};
+};
+
+/// one per thread, only that thread writes, the exporter reads everything behind head once writing is clear
+struct TraceRing {
+	std::array<TraceEvent, TRACE_RING_SIZE> events{};
+	std::atomic<std::uint64_t> head{};
+	/// set around each trace_record(), the exporter waits for it after turning tracing off
+	std::atomic<bool> writing{};
+	std::uint32_t threadIdx{};
+};
+
+inline std::atomic<bool> traceEnabled{false};
+[[nodiscard]] inline bool trace_enabled() { return traceEnabled.load(std::memory_order_relaxed); }
+[[nodiscard]] inline std::uint64_t trace_now_ns() {
+	return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+void trace_enable();
+/// track 0 means the calling thread's own track
+void trace_record(const char* name, std::uint64_t beginNs, std::uint64_t endNs, std::uint32_t track = 0);
+/// Chrome trace event JSON, opens in chrome://tracing and ui.perfetto.dev, stops recording for good
+void trace_write_chrome_json(const std::filesystem::path& path);
+
+/// scoped CPU zone, one relaxed load when tracing is off
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* zoneName) : name(zoneName), beginNs(trace_enabled() ? trace_now_ns() : 0) {}
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+	~ProfileZone() {
+		if (beginNs != 0) trace_record(name, beginNs, trace_now_ns());
+	}
+
+private:
+	const char* name;
+	std::uint64_t beginNs;
+};
+
+struct GpuScopeResult {
+	const char* name{};
+	double gpuMs{};
+	/// zero for scopes recorded without pipeline statistics
+	std::uint64_t vertexInvocations{};
+	std::uint64_t clippingPrimitives{};
+	std::uint64_t fragmentInvocations{};
+};
+
+/*
+	Timestamp and pipeline statistics queries, one set of pools per frame in flight. A frame's results are
+	read back once the timeline has retired it, so collecting never waits on the GPU. Scopes show up as
+	debug-utils labels in captures when validation (and with it EXT_debug_utils) is on.
+*/
+class GpuProfiler {
+public:
+	void create(GpuContext& gpu);
+	/// reads back what the slot's previous frame wrote, right after wait_for_frame()
+	void collect(GpuContext& gpu, std::uint32_t frameSlot);
+	/// resets the slot's queries, first thing recorded in a frame's command buffer
+	void begin_frame(vk::raii::CommandBuffer& cmd, std::uint32_t frameSlot);
+	void begin_scope(vk::raii::CommandBuffer& cmd, const char* name, bool pipelineStats);
+	void end_scope(vk::raii::CommandBuffer& cmd);
+	/// for one-off command buffers, read back by the next collect() once the submit is done. Returns the
+	/// query pair to hand to end_upload(), UINT32_MAX when every pair is still pending
+	[[nodiscard]] std::uint32_t begin_upload(vk::raii::CommandBuffer& cmd, const char* name);
+	void end_upload(vk::raii::CommandBuffer& cmd, std::uint32_t query);
+	/// last collected frame, uploads included
+	[[nodiscard]] std::span<const GpuScopeResult> results() const { return {lastResults.data(), lastResultCount}; }
+	/// per scope averages over every collected frame
+	void print() const;
+
+private:
+	struct FrameQueries {
+		vk::raii::QueryPool timestamps{nullptr};
+		vk::raii::QueryPool stats{nullptr};
+		std::array<const char*, GPU_PROFILER_MAX_SCOPES> names{};
+		/// stats query index per scope, UINT32_MAX without
+		std::array<std::uint32_t, GPU_PROFILER_MAX_SCOPES> statsIdx{};
+		std::uint32_t scopeCount{};
+		std::uint32_t statsCount{};
+		bool recorded{};
+	};
+	struct PendingUpload {
+		const char* name{};
+		std::uint32_t query{};
+	};
+	struct ScopeTotals {
+		const char* name{};
+		double gpuMs{};
+		std::uint64_t fragmentInvocations{};
+		std::uint64_t samples{};
+	};
+	std::array<FrameQueries, MAX_FRAMES_IN_FLIGHT> frames;
+	vk::raii::QueryPool uploadTimestamps{nullptr};
+	std::array<PendingUpload, GPU_PROFILER_MAX_SCOPES> pendingUploads{};
+	std::uint32_t pendingCount{};
+	std::uint32_t nextUploadQuery{};
+	std::uint32_t currentFrame{};
+	std::array<std::uint32_t, 8> openScopes{};
+	std::uint32_t openCount{};
+	std::array<GpuScopeResult, GPU_PROFILER_MAX_SCOPES * 2> lastResults{};
+	std::uint32_t lastResultCount{};
+	std::array<ScopeTotals, GPU_PROFILER_MAX_SCOPES> totals{};
+	std::uint32_t totalsCount{};
+	/// readback scratch, (value, availability) per query
+	std::array<std::uint64_t, GPU_PROFILER_MAX_SCOPES * 4> timestampData{};
+	std::array<std::uint64_t, GPU_PROFILER_MAX_SCOPES * 4> statsData{};
+	float timestampPeriod{};
+	bool pipelineStats{};
+	bool labels{};
+
+	/// CPU clock (trace_now_ns) and GPU ticks sampled around the same submit, maps GPU scopes onto the trace
+	std::uint64_t calibCpuNs{};
+	std::uint64_t calibTicks{};
+
+	void add_result(const GpuScopeResult& result);
+	void calibrate(GpuContext& gpu);
+	void trace_scope(const char* name, std::uint64_t beginTicks, std::uint64_t endTicks) const;
+};
+
+struct FrameAllocation {
+	void* data{};
+	vk::DeviceAddress address{};
+	vk::DeviceSize size{};
+};
+
+/// persistently mapped bump allocator for data that lives one frame, reached through buffer device addresses
+class FrameAllocator {
+public:
+	void create(GpuContext& gpu, vk::DeviceSize blockSize = FRAME_ALLOCATOR_BLOCK_SIZE);
+	/// only allocates device memory when the frame outgrows every block so far
+	FrameAllocation allocate(vk::DeviceSize size, vk::DeviceSize alignment = 16);
+	template <typename T>
+	FrameAllocation push(const T& value) {
+		FrameAllocation alloc = allocate(sizeof(T), std::max<vk::DeviceSize>(alignof(T), 16));
+		std::memcpy(alloc.data, &value, sizeof(T));
+		return alloc;
+	}
+	/// only once the timeline has retired the frame that last used it
+	void reset();
+	void destroy();
+	[[nodiscard]] vk::DeviceSize used() const { return committed + offset; }
+	[[nodiscard]] vk::DeviceSize capacity() const;
+
+private:
+	struct Block {
+		VmaBuffer buffer;
+		vk::DeviceAddress address{};
+	};
+	GpuContext* gpu{};
+	std::vector<Block> blocks;
+	std::size_t current{};
+	vk::DeviceSize offset{};
+	/// bytes used in blocks before current
+	vk::DeviceSize committed{};
+	void add_block(vk::DeviceSize size);
+};
+
+struct FrameContext {
+	/// per swapchain image, resubmitted as is while the draw structure they were recorded with holds
+	std::vector<vk::raii::CommandBuffer> cmdBuffers;
+	/// draw structure hash each of cmdBuffers was recorded with, 0 when never recorded
+	std::vector<std::uint64_t> recordedKeys;
 	/// per frame in flight
 	vk::raii::Semaphore acquireSem{nullptr};
 
-	VmaBuffer uniformBuffer;
-	void* uniformBufferMapped{};
+	FrameAllocator frameAlloc;
+	/// where update_uniform_buffers() put this frame's view data
+	vk::DeviceAddress viewAddress{};
+	/// and the upsample constants, 0 without dynamic resolution
+	vk::DeviceAddress upsampleAddress{};
 
-	void create(GpuContext& gpu, vk::DescriptorSet dstSet, std::uint32_t frameIdx);
+	void create(GpuContext& gpu);
+	void resize_cmd_buffers(GpuContext& gpu, std::uint32_t swapchainImgCount);
+};
+
+/// CPU cost of getting a frame's command buffer ready, recorded vs resubmitted
+struct CmdReuseStats {
+	std::uint64_t recorded{};
+	std::uint64_t reused{};
+	std::chrono::nanoseconds recordTime{};
+	std::chrono::nanoseconds reuseTime{};
+
+	void print() const;
 };
 
 struct SyncContext {
@@ -253,14 +1186,466 @@ struct SyncContext {
 	std::vector<vk::raii::Semaphore> presentSems;
 
 	void create(vk::raii::Device& device, std::uint32_t swapchainImgCount);
-	void wait_for_frame(vk::raii::Device& device, std::uint64_t frameCount) const;
+	void wait_for_frame(vk::raii::Device& device, std::uint64_t frameCount, std::uint32_t framesInFlight) const;
 	void signal_timeline(vk::raii::Device& device, std::uint64_t value) const;
 };
 
+/// index into the RenderGraph resource table, only valid for the frame it was declared in
+using RgHandle = std::uint32_t;
+constexpr RgHandle RG_INVALID_HANDLE = UINT32_MAX;
+
+enum class RgPassType : std::uint8_t {
+	eGraphics,
+	eCompute,
+	eTransfer
+};
+
+/// how a pass touches a resource, stage/access/layout are derived from this and the pass type
+enum class RgUsage : std::uint8_t {
+	eColorAttachment,
+	eDepthAttachment,
+	eSampled,
+	eStorage,
+	eUniform,
+	eTransferSrc,
+	eTransferDst,
+	eVertexInput,
+	eIndirect
+};
+
+struct RgImageDesc {
+	vk::Format format = vk::Format::eUndefined;
+	vk::Extent2D extent{};
+	vk::ImageUsageFlags usage{};
+	vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eColor;
+};
+
+struct RgResource {
+	const char* name{};
+	bool isImage{};
+	bool imported{};
+	/// kept alive past the last pass (presented, read back, history...)
+	bool output{};
+
+	RgImageDesc desc{};
+	vk::Image image;
+	vk::ImageView view;
+	vk::Buffer buffer;
+	vk::DeviceSize size{};
+	/// layout an imported image must be left in at the end of the graph
+	vk::ImageLayout finalLayout = vk::ImageLayout::eUndefined;
+
+	// tracked state while compiling
+	vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+	vk::PipelineStageFlags2 writeStage{};
+	vk::AccessFlags2 writeAccess{};
+	/// readers since the last write, a write has to wait on all of them
+	vk::PipelineStageFlags2 readStages{};
+	vk::AccessFlags2 readAccess{};
+	bool needed{};
+
+	std::uint32_t firstPass = UINT32_MAX;
+	std::uint32_t lastPass{};
+	std::uint32_t transientIdx = UINT32_MAX;
+};
+
+struct RgPassUsage {
+	RgHandle resource{};
+	RgUsage usage{};
+	bool read{};
+	bool write{};
+};
+
+class RenderGraph;
+using RgExecuteFn = std::function<void(vk::raii::CommandBuffer&, const RenderGraph&)>;
+
+struct RgPass {
+	const char* name{};
+	RgPassType type{};
+	RgExecuteFn execute;
+	bool sideEffect{};
+	bool culled{};
+	std::uint32_t firstUsage{};
+	std::uint32_t usageCount{};
+	std::uint32_t firstImgBarrier{};
+	std::uint32_t imgBarrierCount{};
+	std::uint32_t firstBuffBarrier{};
+	std::uint32_t buffBarrierCount{};
+};
+
+class RgPassBuilder {
+public:
+	RgPassBuilder(RenderGraph& graph, std::uint32_t passIdx) : rg(graph), idx(passIdx) {}
+	RgPassBuilder& read(RgHandle res, RgUsage usage);
+	RgPassBuilder& write(RgHandle res, RgUsage usage);
+	RgPassBuilder& read_write(RgHandle res, RgUsage usage);
+	/// never culled, for passes whose results leave the graph some other way
+	RgPassBuilder& side_effect();
+
+private:
+	RenderGraph& rg;
+	std::uint32_t idx;
+	RgPassBuilder& use(RgHandle res, RgUsage usage, bool read, bool write);
+};
+
+/// transient image realised by the graph, memory is shared with every other transient whose lifetime does not overlap
+struct RgTransientImage {
+	RgImageDesc desc{};
+	vk::raii::Image image{nullptr};
+	vk::raii::ImageView view{nullptr};
+	vk::MemoryRequirements memReqs{};
+	vk::DeviceSize offset{};
+	std::uint32_t slot = UINT32_MAX;
+	std::uint32_t firstPass{};
+	std::uint32_t lastPass{};
+	/// stage/access of every user of this memory slot, first barrier of a frame waits on all of them
+	vk::PipelineStageFlags2 slotStages{};
+	vk::AccessFlags2 slotAccess{};
+};
+
+/*
+	Passes declare what they read and write, the graph culls whatever does not contribute to an output,
+	emits one batched barrier per pass and places transient attachments in a single aliased allocation.
+	Rebuilt every frame, containers keep their capacity so steady state doesn't allocate.
+*/
+class RenderGraph {
+public:
+	void reset();
+	RgHandle import_image(const char* name, vk::Image img, vk::ImageView view, const RgImageDesc& desc, vk::ImageLayout initialLayout, vk::ImageLayout finalLayout, vk::PipelineStageFlags2 initialStage = {});
+	RgHandle import_buffer(const char* name, vk::Buffer buff, vk::DeviceSize size);
+	RgHandle create_image(const char* name, const RgImageDesc& desc);
+	RgPassBuilder add_pass(const char* name, RgPassType type, RgExecuteFn execute);
+	void compile(GpuContext& gpu);
+	/// profiler, when given, gets a named scope around every pass
+	void execute(vk::raii::CommandBuffer& cmd, GpuProfiler* profiler = nullptr) const;
+	void destroy(GpuContext& gpu);
+
+	[[nodiscard]] vk::Image image(RgHandle res) const;
+	[[nodiscard]] vk::ImageView view(RgHandle res) const;
+	[[nodiscard]] vk::Buffer buffer(RgHandle res) const;
+	[[nodiscard]] std::uint32_t culled_count() const { return culledCount; }
+	/// bumped whenever the transient images are reallocated, command buffers recorded before that point at freed images
+	[[nodiscard]] std::uint64_t transient_generation() const { return transientGeneration; }
+
+private:
+	friend class RgPassBuilder;
+	std::vector<RgResource> resources;
+	std::vector<RgPass> passes;
+	std::vector<RgPassUsage> usages;
+	std::vector<vk::ImageMemoryBarrier2> imgBarriers;
+	std::vector<vk::BufferMemoryBarrier2> buffBarriers;
+	std::uint32_t finalImgBarrier{};
+	std::uint32_t culledCount{};
+
+	std::vector<RgTransientImage> transients;
+	/// (desc, lifetime) of every transient, memory is only re-laid out when this changes
+	std::size_t transientKey{};
+	std::uint64_t transientGeneration{};
+	VmaAllocation transientMemory{};
+	bool lazilyAllocated{};
+
+	void cull();
+	void compute_lifetimes();
+	void realize_transients(GpuContext& gpu);
+	void build_barriers();
+	void free_transients(GpuContext& gpu);
+};
+
+enum class InputKey : std::uint8_t {
+	eLeft,
+	eRight,
+	eForward,
+	eBack,
+	eUp,
+	eDown,
+	eReverseRotation,
+	eToggleRotation,
+	eSlower,
+	eFaster,
+	eOverlay,
+	eDumpStats,
+	eQuit,
+	eCount
+};
+static_assert(static_cast<std::uint32_t>(InputKey::eCount) <= 16);
+
+/// everything the simulation reads in a frame
+struct InputFrame {
+	float dt{};
+	/// one bit per InputKey, set while held
+	std::uint16_t keys{};
+
+	[[nodiscard]] bool down(InputKey key) const { return (keys >> static_cast<std::uint32_t>(key)) & 1u; }
+};
+
+/*
+	Per frame input and dt, 6 bytes a frame after an 8 byte header.
+	Replaying a log drives process_input() and the simulation clock exactly as recorded, so two runs
+	render the same sequence of frames whatever the machine's actual frame times were.
+*/
+class InputLog {
+public:
+	void start_recording(const std::filesystem::path& path);
+	/// reads the whole log up front, nothing touches the disk while frames run
+	void start_replay(const std::filesystem::path& path);
+	void record(const InputFrame& frame);
+	/// nullopt once the log is exhausted
+	[[nodiscard]] std::optional<InputFrame> next();
+	void finish();
+
+	[[nodiscard]] bool recording() const { return out.is_open(); }
+	[[nodiscard]] bool replaying() const { return replay; }
+
+private:
+	std::ofstream out;
+	std::vector<InputFrame> frames;
+	std::size_t cursor{};
+	std::uint64_t recorded{};
+	bool replay{};
+};
+
+enum class StressDistribution : std::uint8_t {
+	eUniform,
+	eGrid,
+	/// gaussian blobs around a few random centers
+	eClusters,
+	/// surface of a sphere, everything at about the same depth
+	eShell
+};
+
+struct StressSceneDesc {
+	std::uint64_t seed = 1;
+	std::uint32_t instances = 10000;
+	std::uint32_t materials = 64;
+	/// how many of the materials get their own atlas texture
+	std::uint32_t textures = 16;
+	/// mix the bundled obj models in with the procedural primitives
+	bool models = true;
+	StressDistribution distribution = StressDistribution::eUniform;
+};
+
+/// "instances=100000,materials=64,textures=16,seed=7,distribution=clusters,models=0", unset keys keep their default
+[[nodiscard]] StressSceneDesc parse_stress_scene(std::string_view spec);
+
+struct StressInstance {
+	std::uint32_t mesh{};
+	std::uint32_t material{};
+	GpuInstance transform;
+};
+
+/// same desc and inputs give the same instances, sorted by (mesh, material) so each pair is one instanced draw
+[[nodiscard]] std::vector<StressInstance> generate_stress_instances(const StressSceneDesc& desc, std::span<const float> meshRadii, std::uint32_t materialCount);
+/// half extent of the volume generate_stress_instances() fills
+[[nodiscard]] float stress_scene_radius(const StressSceneDesc& desc);
+void make_cube(std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
+void make_sphere(std::uint32_t rings, std::uint32_t segments, std::vector<Vertex>& vertices, std::vector<std::uint32_t>& indices);
+
+/// wall clock frame times over a run, printed at exit for stress scenes
+struct FrameTimeStats {
+	std::uint64_t frames{};
+	double totalMs{};
+	float worstMs{};
+
+	void add(float ms) {
+		frames++;
+		totalMs += static_cast<double>(ms);
+		worstMs = std::max(worstMs, ms);
+	}
+	[[nodiscard]] double mean_ms() const { return frames == 0 ? 0.0 : totalMs / static_cast<double>(frames); }
+};
+
+/// readback buffers in the capture ring, a frame is dropped when all of them are still in use
+constexpr std::uint32_t CAPTURE_RING_SIZE = 8;
+
+/// host visible copy of one frame, owned by its worker until the file is written
+struct CaptureSlot {
+	VmaBuffer buffer;
+	vk::Extent2D extent{};
+	bool bgra{};
+	/// timeline value of the frame copied into it, 0 when free
+	std::uint64_t frame{};
+	/// encode ms, set once the slot is handed to a worker
+	std::optional<std::future<double>> encode;
+};
+
+struct CaptureStats {
+	std::uint64_t captured{};
+	std::uint64_t dropped{};
+	std::uint64_t failed{};
+	std::uint64_t bytes{};
+	/// frames between a copy being recorded and its slot being read
+	std::uint64_t latencyFrames{};
+	double encodeMs{};
+	double worstEncodeMs{};
+	/// slot bookkeeping on the render thread, the copy itself shows up as the "capture" GPU scope
+	std::chrono::nanoseconds renderThreadTime{};
+};
+
+/*
+	Copies the presented image into a ring of host visible buffers. A slot is read once the timeline has
+	passed its frame and handed to a worker that converts and writes the file, so the render thread never
+	waits on the GPU or the disk. When every slot is still in use the frame is dropped and counted instead.
+*/
+class FrameCapture {
+public:
+	/// false when the swapchain format can't be written out as rgba8
+	bool start(const std::filesystem::path& dir, CaptureFormat fmt, std::uint64_t frameLimit, vk::Format swapchainFormat);
+	[[nodiscard]] bool active() const { return capturing; }
+	/// buffer the frame's copy goes to, null when not capturing or no slot is free
+	[[nodiscard]] vk::Buffer begin_frame(GpuContext& gpu, std::uint64_t frame, vk::Extent2D extent, vk::Format swapchainFormat);
+	/// after the wait: frames the timeline has passed go to workers, slots whose file is written are freed
+	void collect(std::uint64_t completedValue, std::uint64_t frame);
+	/// everything submitted must have completed (waitIdle), waits for the workers
+	void finish(std::uint64_t frame);
+	void print() const;
+	void destroy();
+
+private:
+	std::array<CaptureSlot, CAPTURE_RING_SIZE> slots;
+	std::filesystem::path outDir;
+	CaptureFormat format = CaptureFormat::ePng;
+	VmaAllocator allocator{};
+	std::uint64_t limit{};
+	std::uint64_t claimed{};
+	CaptureStats stats;
+	bool capturing{};
+
+	void reap(CaptureSlot& slot);
+};
+
+constexpr vk::Format SCENE_COLOR_FORMAT = vk::Format::eR16G16B16A16Sfloat;
+/// uv space offset from last frame's position to this one's
+constexpr vk::Format MOTION_FORMAT = vk::Format::eR16G16Sfloat;
+/// per axis, fragment cost goes down to a quarter
+constexpr float DYNAMIC_RES_MIN_SCALE = 0.5f;
+/// share of the previous output kept every frame by the temporal upsampler
+constexpr float UPSAMPLE_HISTORY_WEIGHT = 0.9f;
+
+/// picks the render scale from measured GPU frame time, fragment cost goes with the scale squared
+struct ResolutionController {
+	float scale = 1.0f;
+	float targetMs = 1000.0f / 60.0f;
+	float smoothedMs{};
+	std::uint32_t framesSinceChange{};
+	std::uint64_t frames{};
+	std::uint64_t overBudget{};
+	double scaleSum{};
+	float lowestScale = 1.0f;
+
+	/// gpuMs of the frame the timeline just retired, latency is how many frames old that is
+	void update(double gpuMs, std::uint32_t latency);
+	[[nodiscard]] vk::Extent2D render_extent(vk::Extent2D output) const;
+	void print() const;
+};
+
+/// matches UpsampleConstants in upsample.slang
+struct UpsampleConstants {
+	glm::vec2 renderSize{};
+	glm::vec2 outputSize{};
+	/// this frame's jitter in render pixels
+	glm::vec2 jitter{};
+	/// 0 ignores the history (spatial mode, first frame after a reset)
+	float historyWeight{};
+	std::uint32_t pad{};
+};
+
+/// matches UpsamplePush in upsample.slang, the constants change every frame and would otherwise be baked into the commands
+struct UpsamplePushConstants {
+	/// UpsampleConstants in this frame's linear allocator
+	vk::DeviceAddress constants{};
+};
+
+/*
+	Dynamic resolution targets and the compute upsampler. The main pass renders color and motion into the
+	top left render extent of full size targets, so changing the scale never reallocates anything.
+	upsampleMain resolves them against last frame's output into the other history image, which is then
+	blitted to the swapchain. Set i reads history[i ^ 1] and writes history[i].
+*/
+struct Upsampler {
+	VmaImage color;
+	VmaImage motion;
+	std::array<VmaImage, 2> history;
+	vk::raii::ImageView colorView{nullptr};
+	vk::raii::ImageView motionView{nullptr};
+	std::array<vk::raii::ImageView, 2> historyViews{nullptr, nullptr};
+	/// written at least once since the last resize, layout is eGeneral between frames
+	std::array<bool, 2> historyValid{};
+	/// swapchain generation the targets were sized for
+	std::uint32_t generation = UINT32_MAX;
+
+	vk::raii::Sampler sampler{nullptr};
+	vk::raii::DescriptorSetLayout setLayout{nullptr};
+	vk::raii::DescriptorPool pool{nullptr};
+	std::vector<vk::raii::DescriptorSet> sets;
+	vk::raii::PipelineLayout pipelineLayout{nullptr};
+	vk::raii::Pipeline pipeline{nullptr};
+
+	void create(GpuContext& gpu, std::span<const std::byte> shaderCode);
+	/// reallocates the targets, nothing in flight may still use them
+	void resize(GpuContext& gpu, vk::Extent2D extent, std::uint32_t swapchainGeneration);
+	/// Halton (2, 3) over 8 frames, in render pixels within [-0.5, 0.5]
+	[[nodiscard]] static glm::vec2 jitter(std::uint64_t frame);
+	/// constants is an UpsampleConstants in the frame's linear allocator
+	void dispatch(vk::raii::CommandBuffer& cmd, std::uint32_t historyIdx, vk::DeviceAddress constants, vk::Extent2D outputSize) const;
+	void destroy();
+};
+
+/// live settings the overlay edits, Velo applies them at frame boundaries
+struct OverlayControls {
+	std::uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
+	vk::PresentModeKHR presentMode = vk::PresentModeKHR::eMailbox;
+	bool backfaceCull = true;
+	bool depthPrepass{};
+};
+
+/// what the overlay shows, gathered right before build()
+struct OverlayStats {
+	std::span<const GpuScopeResult> gpuScopes;
+	std::span<const VmaBudget> heaps;
+	std::span<const vk::PresentModeKHR> presentModes;
+	std::uint32_t draws{};
+	std::uint64_t triangles{};
+	std::uint32_t culledPasses{};
+	/// mip levels the screen wants that are not resident yet
+	std::uint32_t pendingMips{};
+	std::size_t retiring{};
+};
+
+/*
+	Dear ImGui panel drawn by its own render graph pass after the main pass, F1 toggles it.
+	Hidden it costs one frame time store per frame: no ImGui frame, no pass, and recorded command buffers
+	stay reusable. Shown, its CPU build time and the "overlay" GPU scope are listed on their own line and
+	left out of the frame's GPU total.
+*/
+class Overlay {
+public:
+	void create(GLFWwindow* window, GpuContext& gpu, const SwapchainContext& swapchain);
+	/// installs ImGui's input callbacks while shown and restores the window's own when hidden
+	void toggle();
+	[[nodiscard]] bool visible() const { return shown; }
+	/// every frame, so the graph has history the moment it is shown
+	void record_frame_time(float ms);
+	void build(const OverlayStats& stats, OverlayControls& controls);
+	/// loads and stores target, the main pass already wrote it
+	void draw(vk::raii::CommandBuffer& cmd, vk::ImageView target, vk::Extent2D extent) const;
+	void destroy();
+
+private:
+	std::array<float, OVERLAY_HISTORY> frameTimes{};
+	std::uint32_t historyHead{};
+	std::uint32_t historyCount{};
+	float cpuMs{};
+	vk::Format colorFormat = vk::Format::eUndefined;
+	GLFWwindow* glfwWindow{};
+	bool shown{};
+	bool initialized{};
+};
+
 export class Velo {
 public:
 	Velo();
-	void run();
+	/// non zero when VELO_ALLOC_CHECK caught steady state heap allocations
+	int run();
 
 private:
 	VeloContext config;
@@ -268,29 +1653,76 @@ private:
 	vk::raii::Context context;
 	GpuContext gpu;
 	SwapchainContext swapchain;
+	BindlessTable bindless;
 	DescriptorContext descriptors;
 	vk::raii::DebugUtilsMessengerEXT debugMessenger{nullptr};
 
 	vk::raii::PipelineLayout pipelineLayout{nullptr};
 	vk::raii::Pipeline graphicsPipeline{nullptr};
+	/// vertex only, positions come from the arena's position stream
+	vk::raii::Pipeline depthPrepassPipeline{nullptr};
 	SyncContext sync;
+	RenderGraph graph;
 
 	std::vector<Vertex> vertices;
 	std::vector<std::uint32_t> indices;
-	VmaBuffer vertexBuff;
-	VmaBuffer indexBuff;
-	VmaBuffer materialIdxBuff;
+	GeometryArena geometry;
+	std::vector<Mesh> meshes;
+	/// parallel to meshes
+	std::vector<AssetId> meshAssets;
+	GltfScene gltf;
+	AssetArchive assets;
+	HotReload hotReload;
+	FrameCapture capture;
+	Upsampler upsampler;
+	ResolutionController resolution;
+	/// main pass render area, the swapchain extent without dynamic resolution
+	vk::Extent2D renderExtent{};
+	/// history image the upsampler writes this frame, it reads the other one
+	std::uint32_t historyIdx{};
+	/// the other history image holds last frame's output
+	bool historyReady{};
+	glm::vec2 frameJitter{};
+	glm::mat4 prevMvp{1.0f};
+	bool prevMvpValid{};
+	/// this frame's capture slot, part of the recorded commands
+	vk::Buffer captureTarget;
+	ResidencyManager residency;
+	AssetId textureAsset = INVALID_ASSET;
+	DeletionQueue retired;
+	DefragService defrag;
 
 	VmaImage textureImage;
-	std::uint32_t mipLvls{};
+	StreamedTexture textureStream;
+	/// bounding radius of the loaded model, drives texture mip demand
+	float sceneRadius = 1.0f;
 	vk::raii::ImageView textureImageView{nullptr};
+	BindlessHandle textureSlot;
 	vk::raii::Sampler textureSampler{nullptr};
+	BindlessHandle samplerSlot;
 
 	std::array<FrameContext, MAX_FRAMES_IN_FLIGHT> frames;
 
-	std::vector<VmaImage> materialImages;
-	std::vector<vk::raii::ImageView> materialImageViews;
-	std::vector<std::uint32_t> materialIndices;
+	std::vector<Material> materials;
+	VmaBuffer materialBuff;
+	TextureAtlas atlas;
+	std::vector<Submesh> submeshes;
+	VmaBuffer instanceBuff;
+	vk::DeviceAddress instanceAddress{};
+	std::uint64_t sceneTriangles{};
+	FrameTimeStats frameTimes;
+	glm::vec3 cameraEye = CAMERA_EYE;
+	float cameraFar = 10.0f;
+	std::vector<DrawItem> drawList;
+	std::vector<DrawItem> drawScratch;
+	CmdReuseStats cmdReuse;
+	FrameArena frameArena;
+	AllocStats allocStats;
+	GpuProfiler profiler;
+	Overlay overlay;
+	OverlayControls tuning;
+	/// runtime frames in flight, at most MAX_FRAMES_IN_FLIGHT
+	std::uint32_t framesInFlight = MAX_FRAMES_IN_FLIGHT;
 
 	float totalTime{};
 	float dt{};
@@ -300,6 +1732,12 @@ private:
 	std::uint32_t frameIdx{};
 	/// window resized bool
 	bool frameBuffResized{};
+	InputLog inputLog;
+	/// keys held last frame, for press edges
+	std::uint16_t prevKeys{};
+	/// wall clock frame time, dt is the simulation's and comes from the input log on replays
+	float wallDt{};
+	std::chrono::steady_clock::time_point lastFrameTime;
 
 	glm::vec3 position{{}};
 	float speed = 2.0f;
@@ -316,22 +1754,25 @@ private:
 
 	void setup_debug_messenger();
 	void create_graphics_pipeline();
-	[[nodiscard]] vk::raii::ShaderModule create_shader_module(const std::vector<char>& code) const;
+	[[nodiscard]] vk::raii::ShaderModule create_shader_module(std::span<const std::byte> code) const;
 	void record_command_buffer(std::uint32_t imgIdx);
+	/// everything that ends up baked into a recorded command buffer, graph resources through the transient generation; per-frame data goes through buffers instead
+	[[nodiscard]] std::uint64_t draw_structure_hash(std::uint32_t imgIdx) const;
+	void build_frame_graph(std::uint32_t imgIdx);
+	/// motionView is only set with dynamic resolution, the pipeline then has a second color attachment
+	void draw_main_pass(vk::raii::CommandBuffer& cmdBuffer, vk::ImageView colorView, vk::ImageView motionView, vk::ImageView depthView);
+	void draw_depth_prepass(vk::raii::CommandBuffer& cmdBuffer, vk::ImageView depthView);
+	/// the optional depth pre-pass and the main pass, motion is RG_INVALID_HANDLE without dynamic resolution
+	void add_scene_passes(RgHandle color, RgHandle motion, RgHandle depth);
+	/// scale from last measured GPU time, jitter and history index for this frame
+	void update_resolution();
+	/// main pass into the upsampler's targets, upsample and the blit onto output
+	void add_upsample_passes(RgHandle output, RgHandle depth);
+	/// builds the overlay's ImGui frame and applies whatever it changed
+	void update_overlay();
 	// img transitions
-	void transition_image_layout(
-		vk::Image img,
-		vk::ImageLayout oldLayout,
-		vk::ImageLayout newLayout,
-		vk::AccessFlags2 srcAccessMask,
-		vk::AccessFlags2 dstAccessMask,
-		vk::PipelineStageFlags2 srcStageMask,
-		vk::PipelineStageFlags2 dstStageMask,
-		vk::ImageAspectFlags aspectFlags
-	);
 	void transition_image_texture_layout(VmaImage& img, vk::ImageLayout oldLayout, vk::ImageLayout newLayout, std::uint32_t mips);
-	void create_vertex_buffer();
-	void create_index_buffer();
+	void create_geometry();
 	void update_uniform_buffers();
 
 	// init default data
@@ -339,14 +1780,49 @@ private:
 	void copy_buffer_to_image(const VmaBuffer& buff, VmaImage& img, std::uint32_t width, std::uint32_t height);
 	void create_texture_image_view();
 	void create_texture_sampler();
+	/// reallocates textureImage to hold levels [mip, count), copying over what is already uploaded
+	void allocate_texture(std::uint32_t mip);
+	/// uploads CPU levels [first, last) into textureImage and samples from first on
+	void upload_texture_levels(std::uint32_t first, std::uint32_t last);
+	/// submits a one-off upload without waiting, see the definition for the ordering it relies on
+	void submit_upload(vk::raii::CommandBuffer&& cmdBuff, VmaBuffer&& staging);
+	void update_texture_streaming();
+	[[nodiscard]] std::uint32_t texture_demand_mip() const;
 	void load_model();
-	void create_material_images();
-	void create_texture_material_views();
+	void create_material_palette();
+	std::uint32_t add_flat_material(glm::vec3 color);
+	/// packs into the atlas, throws if it doesn't fit
+	std::uint32_t add_atlas_material(std::span<const std::uint8_t> rgba, std::uint32_t width, std::uint32_t height);
+	void create_material_buffer();
+	[[nodiscard]] std::uint32_t material_texture_slot(const Material& material) const;
 	void load_model_per_face_material();
-	void create_material_index_buffer();
-	void create_dummy_material_index_buffer();
+	/// stream_import_obj() straight into the arena, one mesh per chunk
+	void load_model_streaming();
+	/// forced or over the budget, and only with a loose obj, an archive entry would be decompressed whole first
+	[[nodiscard]] bool streams_model() const;
+	/// through the asset archive, no material reader, callers assign their own materials
+	void load_obj(const std::string& path, tinyobj::attrib_t& attrib, std::vector<tinyobj::shape_t>& shapes);
+	/// opens the archive and decompresses the startup assets in parallel
+	void open_assets();
+	void start_hot_reload();
+	/// once a frame after the wait: launches jobs for changed files and swaps in finished ones
+	void update_hot_reload();
+	void swap_texture(StreamedTexture&& texture);
+	void swap_model(ReloadedMesh&& mesh);
+	/// config.model_path, materials from base color factors and embedded textures small enough for the atlas
+	void load_gltf();
+	/// procedural scene from config.stress_scene instead of the model
+	void create_stress_scene();
+	void create_instance_buffer(std::span<const GpuInstance> instances);
+	void build_draw_list();
 
-	void process_input();
+	void register_resident_assets();
+	void touch_scene_assets();
+
+	/// live keys (or the replayed frame) and this frame's dt, recorded when VELO_RECORD_INPUT is set
+	InputFrame next_input();
+	[[nodiscard]] std::uint16_t sample_keys() const;
+	void process_input(const InputFrame& input);
 	void draw_frame();
 
 
@@ -374,6 +1850,9 @@ private:
 	[[nodiscard]] std::uint32_t find_memory_type(std::uint32_t typeFilter, vk::MemoryPropertyFlags properties) const;
 };
 
+/// velo_bench entry point (bench/benchmarks.cpp), only linked into that target
+export int run_benchmarks(int argc, char** argv);
+
 // we hook in to quiet lsan leaks log for libraries, want to see leaks for my code
 // this may grow out of control for diff platforms/devices etc, may need to just quiet leaks alltogether
 extern "C" const char* __lsan_default_suppressions() { // NOLINT
@@ -394,21 +1873,8 @@ extern "C" const char* __lsan_default_suppressions() { // NOLINT
 }
 
 
-// temp utils
-std::vector<char> read_file(const std::string& filename) {
-	std::ifstream file(filename, std::ios::ate | std::ios::binary);
-
-	if (!file.is_open()) {
-		throw std::runtime_error("failed to open file");
-	}
-
-	std::vector<char> buffer(static_cast<ulong>(file.tellg()));
-	file.seekg(0, std::ios::beg);
-	file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
-	file.close();
-	return buffer;
-}
 void handle_error(const char* msg, vk::Result error);
 /// vector must be ordered from most desirable to least desirable
 vk::Format find_supported_format(vk::raii::PhysicalDevice& physicalDevice, const std::vector<vk::Format>& candidates, vk::ImageTiling tiling, vk::FormatFeatureFlags features);
-vk::raii::ImageView create_image_view(vk::raii::Device& device, const vk::Image& img, vk::Format fmt, vk::ImageAspectFlags aspectFlags, std::uint32_t mips);
+[[nodiscard]] vk::DeviceSize allocation_size(VmaAllocator allocator, VmaAllocation allocation);
+vk::raii::ImageView create_image_view(vk::raii::Device& device, const vk::Image& img, vk::Format fmt, vk::ImageAspectFlags aspectFlags, std::uint32_t mips, std::uint32_t baseMip = 0);
@@ -4,7 +4,7 @@ module;
 module velo;
 import vulkan_hpp;
 
-VmaBuffer::VmaBuffer(VmaAllocator allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vmaMemUsage, VmaAllocationCreateFlags flags) : vmaAllocator(allocator) {
+VmaBuffer::VmaBuffer(VmaAllocator allocator, vk::DeviceSize size, vk::BufferUsageFlags usage, VmaMemoryUsage vmaMemUsage, VmaAllocationCreateFlags flags) : vmaAllocator(allocator), _size(size), _usage(usage) {
 	vk::BufferCreateInfo buffInfo {
 		.size = size,
 		.usage = usage,
@@ -25,7 +25,7 @@ VmaBuffer::~VmaBuffer() {
 		vmaDestroyBuffer(vmaAllocator, _buffer, vmaAllocation);
 	}
 }
-VmaBuffer::VmaBuffer(VmaBuffer&& other) noexcept : vmaAllocator(other.vmaAllocator), _buffer(other._buffer), vmaAllocation(other.vmaAllocation), mapped(other.mapped) {
+VmaBuffer::VmaBuffer(VmaBuffer&& other) noexcept : vmaAllocator(other.vmaAllocator), _buffer(other._buffer), vmaAllocation(other.vmaAllocation), mapped(other.mapped), _size(other._size), _usage(other._usage) {
 	other._buffer = VK_NULL_HANDLE;
 	other.vmaAllocation = VK_NULL_HANDLE;
 	other.mapped = nullptr;
@@ -39,6 +39,8 @@ VmaBuffer& VmaBuffer::operator=(VmaBuffer&& other) noexcept {
 		mapped = other.mapped;
 		vmaAllocator = other.vmaAllocator;
 		vmaAllocation = other.vmaAllocation;
+		_size = other._size;
+		_usage = other._usage;
 
 		other._buffer = VK_NULL_HANDLE;
 		other.vmaAllocation = VK_NULL_HANDLE;
@@ -66,3 +68,42 @@ VmaAllocation VmaBuffer::allocation() const {
 void* VmaBuffer::mapped_data() const {
 	return mapped;
 }
+
+VkBuffer VmaBuffer::create_alias(VmaAllocation memory) const {
+	VmaAllocatorInfo allocatorInfo;
+	vmaGetAllocatorInfo(vmaAllocator, &allocatorInfo);
+	vk::BufferCreateInfo buffInfo {
+		.size = _size,
+		.usage = _usage,
+		.sharingMode = vk::SharingMode::eExclusive
+	};
+	VkBuffer alias = VK_NULL_HANDLE;
+	VkResult res = vkCreateBuffer(allocatorInfo.device, buffInfo, nullptr, &alias);
+	if (res != VK_SUCCESS) {
+		handle_error("Failed to create buffer alias", vk::Result(res));
+	}
+	res = vmaBindBufferMemory(vmaAllocator, memory, alias);
+	if (res != VK_SUCCESS) {
+		vkDestroyBuffer(allocatorInfo.device, alias, nullptr);
+		handle_error("Failed to bind buffer alias", vk::Result(res));
+	}
+	return alias;
+}
+
+VkBuffer VmaBuffer::swap_handle(VkBuffer newBuffer) {
+	VkBuffer old = _buffer;
+	_buffer = newBuffer;
+	// persistently mapped pointer follows the allocation
+	if (mapped) {
+		VmaAllocationInfo allocInfo;
+		vmaGetAllocationInfo(vmaAllocator, vmaAllocation, &allocInfo);
+		mapped = allocInfo.pMappedData;
+	}
+	return old;
+}
+
+void VmaBuffer::release() {
+	_buffer = VK_NULL_HANDLE;
+	vmaAllocation = VK_NULL_HANDLE;
+	mapped = nullptr;
+}
@@ -4,7 +4,7 @@ module;
 module velo;
 import std;
 
-VmaImage::VmaImage(VmaAllocator allocator, std::uint32_t width, std::uint32_t height, std::uint32_t mipLvls, vk::ImageUsageFlags usage, vk::Format fmt, VmaAllocationCreateFlags flags, VmaMemoryUsage vmaMemUsage) : vmaAllocator(allocator) {
+VmaImage::VmaImage(VmaAllocator allocator, std::uint32_t width, std::uint32_t height, std::uint32_t mipLvls, vk::ImageUsageFlags usage, vk::Format fmt, VmaAllocationCreateFlags flags, VmaMemoryUsage vmaMemUsage) : vmaAllocator(allocator), _width(width), _height(height), _mipLvls(mipLvls), _format(fmt), _usage(usage) {
 	vk::ImageCreateInfo buffInfo {
 		.imageType = vk::ImageType::e2D,
 		.format = fmt,
@@ -33,7 +33,7 @@ VmaImage::~VmaImage() {
 	}
 
 }
-VmaImage::VmaImage(VmaImage&& other) noexcept : vmaAllocator(other.vmaAllocator), _image(other._image), vmaAllocation(other.vmaAllocation), mapped(other.mapped) {
+VmaImage::VmaImage(VmaImage&& other) noexcept : vmaAllocator(other.vmaAllocator), _image(other._image), vmaAllocation(other.vmaAllocation), mapped(other.mapped), _width(other._width), _height(other._height), _mipLvls(other._mipLvls), _format(other._format), _usage(other._usage) {
 	other._image = VK_NULL_HANDLE;
 	other.vmaAllocation = VK_NULL_HANDLE;
 	other.mapped = nullptr;
@@ -48,6 +48,11 @@ VmaImage& VmaImage::operator=(VmaImage&& other) noexcept {
 		mapped = other.mapped;
 		vmaAllocator = other.vmaAllocator;
 		vmaAllocation = other.vmaAllocation;
+		_width = other._width;
+		_height = other._height;
+		_mipLvls = other._mipLvls;
+		_format = other._format;
+		_usage = other._usage;
 
 		other._image = VK_NULL_HANDLE;
 		other.vmaAllocation = VK_NULL_HANDLE;
@@ -69,4 +74,41 @@ void* VmaImage::mapped_data() const {
 	return mapped;
 }
 
+VkImage VmaImage::create_alias(VmaAllocation memory) const {
+	VmaAllocatorInfo allocatorInfo;
+	vmaGetAllocatorInfo(vmaAllocator, &allocatorInfo);
+	vk::ImageCreateInfo imgInfo {
+		.imageType = vk::ImageType::e2D,
+		.format = _format,
+		.extent = {_width, _height, 1}, // NOLINT
+		.mipLevels = _mipLvls,
+		.arrayLayers = 1,
+		.samples = vk::SampleCountFlagBits::e1,
+		.tiling = vk::ImageTiling::eOptimal,
+		.usage = _usage,
+		.sharingMode = vk::SharingMode::eExclusive
+	};
+	VkImage alias = VK_NULL_HANDLE;
+	VkResult res = vkCreateImage(allocatorInfo.device, imgInfo, nullptr, &alias);
+	if (res != VK_SUCCESS) {
+		handle_error("Failed to create image alias", vk::Result(res));
+	}
+	res = vmaBindImageMemory(vmaAllocator, memory, alias);
+	if (res != VK_SUCCESS) {
+		vkDestroyImage(allocatorInfo.device, alias, nullptr);
+		handle_error("Failed to bind image alias", vk::Result(res));
+	}
+	return alias;
+}
 
+VkImage VmaImage::swap_handle(VkImage newImage) {
+	VkImage old = _image;
+	_image = newImage;
+	return old;
+}
+
+void VmaImage::release() {
+	_image = VK_NULL_HANDLE;
+	vmaAllocation = VK_NULL_HANDLE;
+	mapped = nullptr;
+}